@@ -0,0 +1,677 @@
+// PNG encode benchmark
+//
+// Times PngEncoder on a synthetic desktop screenshot (window chrome,
+// runs of text-like glyphs, a gradient wallpaper and a noisy photo)
+// on one thread and on all cores, and compares it with:
+//   zlib   libpng-style encoding: Up-filtered rows deflated by zlib at
+//          levels 1 and 6 (when built with zlib)
+//   wic    the Windows Imaging Component encoder the service used
+//          before, with one factory shared by all iterations (Windows)
+// With zlib it also decodes every PNG the encoder wrote and checks the
+// pixels. The base64 text sent to providers is timed both after the
+// encode and streamed from it chunk by chunk. Indexed PNG is timed with
+// an exact palette on the low-colour windows and a median-cut one on the
+// whole desktop, whose PSNR is reported.
+//
+// It then times JpegEncoder at a few qualities, ImageEncoder under
+// size-targeted policies and ImageScaler's downscale to the ~1 MP cloud
+// models work at, the way screenshots for cloud providers are encoded,
+// and what EncodeCache saves when the same screen is asked for again.
+// Finally it times a tile delta for a dialog opening on the desktop (see
+// TileDeltaTracker) and checks that a client rebuilds the new frame.
+// With libjpeg the JPEGs are decoded and their PSNR reported.
+//
+// Usage: png_encode_bench [width height [iterations]]
+
+#include "base64.h"
+#include "encode_cache.h"
+#include "frame_view.h"
+#include "image_encoder.h"
+#include "image_scaler.h"
+#include "jpeg_encoder.h"
+#include "png_encoder.h"
+#include "tile_delta.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <csetjmp>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <thread>
+
+#if defined(HAVE_ZLIB)
+#include <zlib.h>
+#endif
+
+#if defined(HAVE_JPEG)
+#include <jpeglib.h>
+#endif
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <wincodec.h>
+#endif
+
+namespace {
+
+double TimeMs(int iterations, const std::function<bool()>& body) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        if (!body()) return -1.0;
+    }
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / iterations;
+}
+
+void Report(const char* name, double ms, size_t bytes, size_t rawBytes) {
+    if (ms < 0) {
+        std::printf("%-10s failed\n", name);
+        return;
+    }
+    std::printf("%-10s %9.3f ms/encode  %9.1f KB  %5.1f%% of raw  %7.1f MB/s\n", name, ms, bytes / 1024.0,
+                100.0 * bytes / rawBytes, rawBytes / (1024.0 * 1024.0) / (ms / 1000.0));
+}
+
+// Deterministic stand-in for a desktop: the mix of flat fills, repeated
+// glyphs and a little photographic noise a real one has
+std::vector<uint8_t> MakeDesktop(int width, int height) {
+    std::vector<uint8_t> pixels(static_cast<size_t>(width) * height * 4);
+    uint32_t seed = 12345;
+    auto next = [&seed] {
+        seed = seed * 1664525u + 1013904223u;
+        return seed >> 8;
+    };
+    auto fill = [&](int x0, int y0, int w, int h, uint32_t bgra) {
+        for (int y = std::max(y0, 0); y < std::min(y0 + h, height); ++y) {
+            for (int x = std::max(x0, 0); x < std::min(x0 + w, width); ++x) {
+                std::memcpy(&pixels[(static_cast<size_t>(y) * width + x) * 4], &bgra, 4);
+            }
+        }
+    };
+
+    // Wallpaper gradient
+    for (int y = 0; y < height; ++y) {
+        uint8_t shade = static_cast<uint8_t>(60 + 80 * y / height);
+        fill(0, y, width, 1, 0xFF000000u | (shade << 16) | ((shade / 2) << 8) | 40);
+    }
+
+    // 64 glyphs of 7x12, reused like the characters of real text
+    std::vector<uint16_t> glyphs(64 * 12);
+    for (auto& row : glyphs) {
+        row = static_cast<uint16_t>(next() & 0x7F);
+    }
+
+    int windows = std::max(3, width * height / 400000);
+    for (int w = 0; w < windows; ++w) {
+        int ww = width / 3 + static_cast<int>(next() % (width / 3 + 1));
+        int wh = height / 3 + static_cast<int>(next() % (height / 3 + 1));
+        int wx = static_cast<int>(next() % (width - ww / 2 + 1)) - ww / 4;
+        int wy = static_cast<int>(next() % (height - wh / 2 + 1));
+        fill(wx, wy, ww, 32, 0xFF2B579Au);                // title bar
+        fill(wx, wy + 32, ww, wh - 32, 0xFFFFFFFFu);      // client area
+        for (int line = wy + 44; line + 12 < wy + wh; line += 18) {
+            int x = wx + 12;
+            int end = wx + 12 + static_cast<int>(next() % (ww > 24 ? ww - 24 : 1));
+            while (x + 7 < end) {
+                const uint16_t* glyph = &glyphs[(next() % 64) * 12];
+                for (int gy = 0; gy < 12; ++gy) {
+                    for (int gx = 0; gx < 7; ++gx) {
+                        if (glyph[gy] & (1 << gx)) fill(x + gx, line + gy, 1, 1, 0xFF202020u);
+                    }
+                }
+                x += (next() % 6 == 0) ? 12 : 8;
+            }
+        }
+    }
+
+    // A photo: smooth colour with sensor noise
+    int pw = width / 4, ph = height / 4;
+    for (int y = 0; y < ph; ++y) {
+        for (int x = 0; x < pw; ++x) {
+            uint8_t* p = &pixels[(static_cast<size_t>(height - ph - 48 + y) * width + (width - pw - 16 + x)) * 4];
+            p[0] = static_cast<uint8_t>(x * 255 / pw + next() % 16);
+            p[1] = static_cast<uint8_t>(y * 255 / ph + next() % 16);
+            p[2] = static_cast<uint8_t>(128 + next() % 24);
+            p[3] = 255;
+        }
+    }
+
+    fill(0, height - 40, width, 40, 0xFF1F1F1Fu);           // taskbar
+    return pixels;
+}
+
+#if defined(HAVE_ZLIB)
+
+uint32_t ReadBigEndian(const uint8_t* p) {
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | p[3];
+}
+
+// Decode a PNG with zlib (checking every CRC and the Adler-32) into
+// RGBA: 8-bit RGB or RGBA, or indexed at 1, 2, 4 or 8 bits per pixel
+bool DecodePng(const std::vector<uint8_t>& png, std::vector<uint8_t>& rgba, int& width, int& height) {
+    if (png.size() < 8 || png[0] != 137 || png[1] != 'P') return false;
+    std::vector<uint8_t> idat, palette;
+    int depth = 8, colorType = 2;
+    width = height = 0;
+    for (size_t pos = 8; pos + 12 <= png.size();) {
+        uint32_t length = ReadBigEndian(&png[pos]);
+        const uint8_t* type = &png[pos + 4];
+        if (pos + 12 + length > png.size()) return false;
+        if (crc32(0, type, length + 4) != ReadBigEndian(&png[pos + 8 + length])) return false;
+        if (!std::memcmp(type, "IHDR", 4)) {
+            width = static_cast<int>(ReadBigEndian(type + 4));
+            height = static_cast<int>(ReadBigEndian(type + 8));
+            depth = type[12];
+            colorType = type[13];
+        } else if (!std::memcmp(type, "PLTE", 4)) {
+            palette.assign(type + 4, type + 4 + length);
+        } else if (!std::memcmp(type, "IDAT", 4)) {
+            idat.insert(idat.end(), type + 4, type + 4 + length);
+        }
+        pos += 12 + length;
+    }
+    bool indexed = colorType == 3;
+    if (width <= 0 || height <= 0 || (indexed ? palette.empty() : depth != 8)) return false;
+
+    size_t channels = indexed ? 1 : colorType == 6 ? 4 : 3;
+    size_t rowBytes = (static_cast<size_t>(width) * channels * depth + 7) / 8;
+    size_t bpp = std::max<size_t>(channels * depth / 8, 1);
+    std::vector<uint8_t> raw((rowBytes + 1) * height);
+    uLongf rawSize = static_cast<uLongf>(raw.size());
+    if (uncompress(raw.data(), &rawSize, idat.data(), static_cast<uLong>(idat.size())) != Z_OK ||
+        rawSize != raw.size()) {
+        return false;
+    }
+
+    rgba.resize(static_cast<size_t>(width) * height * 4);
+    std::vector<uint8_t> prev(rowBytes, 0), cur(rowBytes);
+    for (int y = 0; y < height; ++y) {
+        const uint8_t* in = &raw[(rowBytes + 1) * y];
+        int filter = in[0];
+        ++in;
+        for (size_t i = 0; i < rowBytes; ++i) {
+            int a = i >= bpp ? cur[i - bpp] : 0;
+            int b = prev[i];
+            int c = i >= bpp ? prev[i - bpp] : 0;
+            int predicted = 0;
+            switch (filter) {
+                case 0: break;
+                case 1: predicted = a; break;
+                case 2: predicted = b; break;
+                case 3: predicted = (a + b) / 2; break;
+                case 4: {
+                    int pa = std::abs(b - c), pb = std::abs(a - c), pc = std::abs(a + b - 2 * c);
+                    predicted = (pa <= pb && pa <= pc) ? a : (pb <= pc ? b : c);
+                    break;
+                }
+                default: return false;
+            }
+            cur[i] = static_cast<uint8_t>(in[i] + predicted);
+        }
+        uint8_t* out = &rgba[static_cast<size_t>(y) * width * 4];
+        for (int x = 0; x < width; ++x, out += 4) {
+            if (indexed) {
+                int bit = x * depth;
+                size_t index = (cur[bit / 8] >> (8 - depth - bit % 8)) & ((1 << depth) - 1);
+                if (index * 3 + 2 >= palette.size()) return false;
+                std::memcpy(out, &palette[index * 3], 3);
+                out[3] = 255;
+            } else {
+                std::memcpy(out, &cur[x * channels], 3);
+                out[3] = channels == 4 ? cur[x * channels + 3] : 255;
+            }
+        }
+        std::swap(prev, cur);
+    }
+    return true;
+}
+
+// Decode a PNG and compare it with the BGRA source: PSNR in dB over the
+// RGB channels (alpha must match), infinity if identical, -1 if it does
+// not decode to the source
+double PngPsnr(const std::vector<uint8_t>& png, const FrameView& source) {
+    std::vector<uint8_t> rgba;
+    int width = 0, height = 0;
+    if (!DecodePng(png, rgba, width, height) || width != source.Width() || height != source.Height()) {
+        return -1.0;
+    }
+    uint64_t squared = 0;
+    for (int y = 0; y < height; ++y) {
+        const uint8_t* bgra = source.Row(y);
+        const uint8_t* decoded = &rgba[static_cast<size_t>(y) * width * 4];
+        for (int x = 0; x < width; ++x, bgra += 4, decoded += 4) {
+            for (int k = 0; k < 3; ++k) {
+                int error = decoded[k] - bgra[2 - k];
+                squared += static_cast<uint64_t>(error * error);
+            }
+            if (png[25] == 6 && decoded[3] != bgra[3]) return -1.0;
+        }
+    }
+    if (squared == 0) return INFINITY;
+    double mse = static_cast<double>(squared) / (3.0 * width * height);
+    return 10.0 * std::log10(255.0 * 255.0 / mse);
+}
+
+// Decode a PNG and check it matches the source exactly
+bool Verify(const std::vector<uint8_t>& png, const FrameView& source) {
+    return std::isinf(PngPsnr(png, source));
+}
+
+// Up-filtered RGB rows through zlib, as a libpng encode would be
+bool EncodeZlib(const FrameView& view, int level, std::vector<uint8_t>& filtered, std::vector<uint8_t>& out) {
+    size_t rowBytes = static_cast<size_t>(view.Width()) * 3;
+    filtered.resize((rowBytes + 1) * view.Height());
+    std::vector<uint8_t> prev(rowBytes, 0), cur(rowBytes);
+    for (int y = 0; y < view.Height(); ++y) {
+        const uint8_t* bgra = view.Row(y);
+        for (int x = 0; x < view.Width(); ++x) {
+            cur[x * 3] = bgra[x * 4 + 2];
+            cur[x * 3 + 1] = bgra[x * 4 + 1];
+            cur[x * 3 + 2] = bgra[x * 4];
+        }
+        uint8_t* row = &filtered[(rowBytes + 1) * y];
+        row[0] = 2;
+        for (size_t i = 0; i < rowBytes; ++i) {
+            row[i + 1] = static_cast<uint8_t>(cur[i] - prev[i]);
+        }
+        std::swap(prev, cur);
+    }
+    uLongf size = compressBound(static_cast<uLong>(filtered.size()));
+    out.resize(size);
+    if (compress2(out.data(), &size, filtered.data(), static_cast<uLong>(filtered.size()), level) != Z_OK) {
+        return false;
+    }
+    out.resize(size);
+    return true;
+}
+
+#endif
+
+#if defined(HAVE_JPEG)
+
+struct JpegError {
+    jpeg_error_mgr manager;
+    std::jmp_buf jump;
+};
+
+// Decode with libjpeg and compare with the source: PSNR in dB over the
+// RGB channels, or -1 if the JPEG does not decode to the source's size
+double JpegPsnr(const std::vector<uint8_t>& jpeg, const FrameView& source) {
+    // Declared before setjmp: longjmp must not skip a destructor
+    std::vector<uint8_t> row(static_cast<size_t>(source.Width()) * 3);
+    double squared = 0;
+    jpeg_decompress_struct info;
+    JpegError error;
+    info.err = jpeg_std_error(&error.manager);
+    error.manager.error_exit = [](j_common_ptr common) {
+        std::longjmp(reinterpret_cast<JpegError*>(common->err)->jump, 1);
+    };
+    if (setjmp(error.jump)) {
+        jpeg_destroy_decompress(&info);
+        return -1.0;
+    }
+    jpeg_create_decompress(&info);
+    jpeg_mem_src(&info, jpeg.data(), static_cast<unsigned long>(jpeg.size()));
+    jpeg_read_header(&info, TRUE);
+    info.out_color_space = JCS_RGB;
+    jpeg_start_decompress(&info);
+    if (static_cast<int>(info.output_width) != source.Width() ||
+        static_cast<int>(info.output_height) != source.Height()) {
+        jpeg_destroy_decompress(&info);
+        return -1.0;
+    }
+
+    while (info.output_scanline < info.output_height) {
+        int y = static_cast<int>(info.output_scanline);
+        JSAMPROW rows[1] = {row.data()};
+        jpeg_read_scanlines(&info, rows, 1);
+        const uint8_t* bgra = source.Row(y);
+        for (int x = 0; x < source.Width(); ++x) {
+            for (int c = 0; c < 3; ++c) {
+                double d = row[x * 3 + c] - bgra[x * 4 + 2 - c];
+                squared += d * d;
+            }
+        }
+    }
+    jpeg_finish_decompress(&info);
+    jpeg_destroy_decompress(&info);
+
+    double mse = squared / (3.0 * source.Width() * source.Height());
+    return mse > 0 ? 10.0 * std::log10(255.0 * 255.0 / mse) : 99.0;
+}
+
+#endif
+
+#if defined(_WIN32)
+
+// The old ScreenCapture path, minus the per-call factory
+bool EncodeWic(IWICImagingFactory* factory, const FrameView& view, std::vector<uint8_t>& out) {
+    IStream* stream = nullptr;
+    if (FAILED(CreateStreamOnHGlobal(nullptr, TRUE, &stream))) return false;
+    IWICBitmapEncoder* encoder = nullptr;
+    IWICBitmapFrameEncode* frame = nullptr;
+    WICPixelFormatGUID format = GUID_WICPixelFormat32bppBGRA;
+    bool ok = SUCCEEDED(factory->CreateEncoder(GUID_ContainerFormatPng, nullptr, &encoder)) &&
+              SUCCEEDED(encoder->Initialize(stream, WICBitmapEncoderNoCache)) &&
+              SUCCEEDED(encoder->CreateNewFrame(&frame, nullptr)) &&
+              SUCCEEDED(frame->Initialize(nullptr)) &&
+              SUCCEEDED(frame->SetSize(view.Width(), view.Height())) &&
+              SUCCEEDED(frame->SetPixelFormat(&format)) &&
+              SUCCEEDED(frame->WritePixels(view.Height(), static_cast<UINT>(view.Stride()),
+                                           static_cast<UINT>(view.SpanBytes()),
+                                           const_cast<BYTE*>(view.Data()))) &&
+              SUCCEEDED(frame->Commit()) && SUCCEEDED(encoder->Commit());
+    if (ok) {
+        STATSTG stat = {};
+        LARGE_INTEGER zero = {};
+        ULONG read = 0;
+        ok = SUCCEEDED(stream->Stat(&stat, STATFLAG_NONAME)) &&
+             SUCCEEDED(stream->Seek(zero, STREAM_SEEK_SET, nullptr));
+        if (ok) {
+            out.resize(static_cast<size_t>(stat.cbSize.QuadPart));
+            ok = SUCCEEDED(stream->Read(out.data(), static_cast<ULONG>(out.size()), &read)) && read == out.size();
+        }
+    }
+    if (frame) frame->Release();
+    if (encoder) encoder->Release();
+    stream->Release();
+    return ok;
+}
+
+#endif
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    int width = 2560;
+    int height = 1440;
+    int iterations = 20;
+    if (argc >= 3) {
+        width = std::max(std::atoi(argv[1]), 16);
+        height = std::max(std::atoi(argv[2]), 16);
+    }
+    if (argc >= 4) {
+        iterations = std::max(std::atoi(argv[3]), 1);
+    }
+
+    std::vector<uint8_t> pixels = MakeDesktop(width, height);
+    FrameView view(nullptr, pixels.data(), width, height, static_cast<size_t>(width) * 4);
+    size_t rawBytes = pixels.size();
+    unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+    std::printf("%dx%d synthetic desktop, %d iterations, %u hardware threads\n", width, height, iterations, cores);
+
+    bool ok = true;
+    std::vector<uint8_t> png;
+    std::vector<int> threadCounts = {1};
+    if (cores > 1) {
+        threadCounts.push_back(static_cast<int>(cores));
+    }
+    for (int threads : threadCounts) {
+        PngEncoder::Options options;
+        options.threads = threads;
+        PngEncoder encoder(options);
+        double ms = TimeMs(iterations, [&] { return encoder.Encode(view, png); });
+        char name[32];
+        std::snprintf(name, sizeof(name), "png x%d", threads);
+        Report(name, ms, png.size(), rawBytes);
+#if defined(HAVE_ZLIB)
+        ok = ok && Verify(png, view);
+#endif
+    }
+
+    // Straight into a caller-owned buffer of the worst-case size
+    {
+        PngEncoder encoder;
+        std::vector<uint8_t> buffer(PngEncoder::MaxEncodedSize(width, height));
+        size_t written = 0;
+        double ms = TimeMs(iterations, [&] {
+            written = encoder.Encode(view, buffer.data(), buffer.size());
+            return written > 0;
+        });
+        Report("png buffer", ms, written, rawBytes);
+    }
+
+    // Base64 for a provider request: encode then convert, and the sink
+    // form converting each chunk as it is handed over
+    {
+        PngEncoder encoder;
+        std::string whole;
+        double ms = TimeMs(iterations, [&] {
+            if (!encoder.Encode(view, png)) return false;
+            whole = Base64::Encode(png);
+            return true;
+        });
+        Report("png b64", ms, whole.size(), rawBytes);
+
+        std::string streamed;
+        ms = TimeMs(iterations, [&] {
+            streamed.clear();
+            Base64Encoder base64(streamed);
+            bool encoded = encoder.Encode(view, [&base64](const uint8_t* data, size_t size) {
+                base64.Update(data, size);
+            });
+            base64.Finish();
+            return encoded;
+        });
+        Report("png stream", ms, streamed.size(), rawBytes);
+        if (streamed != whole) {
+            std::printf("png stream: differs from encode then base64\n");
+            ok = false;
+        }
+    }
+
+    // A region of the frame, encoded in place at the frame's stride
+    {
+        PngEncoder::Options options;
+        options.alpha = true;
+        PngEncoder encoder(options);
+        FrameView region = view.Crop({width / 5, height / 5, width / 2, height / 2});
+        double ms = TimeMs(iterations, [&] { return encoder.Encode(region, png); });
+        Report("png rgba", ms, png.size(), region.RowBytes() * region.Height());
+#if defined(HAVE_ZLIB)
+        ok = ok && Verify(png, region);
+#endif
+    }
+
+    // Indexed: the windows above the photo have few enough colours for
+    // an exact palette, the whole desktop needs a median-cut one
+    {
+        FrameView region = view.Crop({0, 0, width, height / 2});
+        size_t regionBytes = region.RowBytes() * region.Height();
+        for (PngEncoder::Palette palette : {PngEncoder::Palette::Off, PngEncoder::Palette::Exact}) {
+            PngEncoder::Options options;
+            options.palette = palette;
+            PngEncoder encoder(options);
+            double ms = TimeMs(iterations, [&] { return encoder.Encode(region, png); });
+            Report(palette == PngEncoder::Palette::Off ? "png ui" : "png ui pal", ms, png.size(), regionBytes);
+#if defined(HAVE_ZLIB)
+            ok = ok && Verify(png, region);
+#endif
+        }
+
+        PngEncoder::Options options;
+        options.palette = PngEncoder::Palette::Quantize;
+        PngEncoder encoder(options);
+        double ms = TimeMs(iterations, [&] { return encoder.Encode(view, png); });
+        Report("png8", ms, png.size(), rawBytes);
+#if defined(HAVE_ZLIB)
+        double psnr = PngPsnr(png, view);
+        std::printf("%-10s %9.1f dB PSNR\n", "", psnr);
+        ok = ok && psnr > 0;
+#endif
+    }
+
+#if defined(HAVE_ZLIB)
+    std::vector<uint8_t> filtered, deflated;
+    for (int level : {1, 6}) {
+        double ms = TimeMs(iterations, [&] { return EncodeZlib(view, level, filtered, deflated); });
+        char name[32];
+        std::snprintf(name, sizeof(name), "zlib -%d", level);
+        Report(name, ms, deflated.size(), rawBytes);
+    }
+    std::printf("decoded output: %s\n", ok ? "ok" : "MISMATCH");
+#endif
+
+    // Lossy, as sent to cloud providers
+    JpegEncoder jpegEncoder;
+    std::vector<uint8_t> jpeg;
+    for (int quality : {90, 80, 60}) {
+        double ms = TimeMs(iterations, [&] { return jpegEncoder.Encode(view, quality, jpeg); });
+        char name[32];
+        std::snprintf(name, sizeof(name), "jpeg q%d", quality);
+        Report(name, ms, jpeg.size(), rawBytes);
+#if defined(HAVE_JPEG)
+        double psnr = JpegPsnr(jpeg, view);
+        std::printf("%-10s %9.1f dB PSNR\n", "", psnr);
+        ok = ok && psnr > 0;
+#endif
+    }
+
+    // Policies: PNG while it fits the target, then JPEG down the ladder
+    ImageEncoder imageEncoder;
+    EncodedImage encoded;
+    for (size_t target : {size_t(1024 * 1024), size_t(256 * 1024)}) {
+        EncodePolicy policy;
+        policy.format = ImageFormat::Auto;
+        policy.maxBytes = target;
+        double ms = TimeMs(iterations, [&] { return imageEncoder.Encode(view, policy, encoded); });
+        char name[32];
+        std::snprintf(name, sizeof(name), "auto %zuK", target / 1024);
+        Report(name, ms, encoded.bytes.size(), rawBytes);
+        std::printf("%-10s as %s", "", ImageFormatName(encoded.format));
+        if (encoded.format == ImageFormat::Jpeg) {
+            std::printf(" q%d", encoded.quality);
+        }
+        std::printf(", %d attempt%s%s\n", encoded.attempts, encoded.attempts == 1 ? "" : "s",
+                    encoded.overTarget ? ", over target" : "");
+    }
+
+    // Downscaled to about 1 MP, alone and as the OpenAI policy does it
+    {
+        int scaledWidth = 0, scaledHeight = 0;
+        ImageScaler::FitWithin(width, height, 1024 * 1024, 2048, scaledWidth, scaledHeight);
+        std::vector<uint8_t> scaled(static_cast<size_t>(scaledWidth) * scaledHeight * 4);
+        double ms = TimeMs(iterations, [&] {
+            return ImageScaler::Downscale(view, scaledWidth, scaledHeight, scaled.data(),
+                                          static_cast<size_t>(scaledWidth) * 4);
+        });
+        Report("scale 1MP", ms, scaled.size(), rawBytes);
+        std::printf("%-10s to %dx%d\n", "", scaledWidth, scaledHeight);
+
+        EncodePolicy policy;
+        policy.format = ImageFormat::Auto;
+        policy.maxBytes = 1024 * 1024;
+        policy.maxPixels = 1024 * 1024;
+        policy.maxEdge = 2048;
+        ms = TimeMs(iterations, [&] { return imageEncoder.Encode(view, policy, encoded); });
+        Report("auto 1MP", ms, encoded.bytes.size(), rawBytes);
+        std::printf("%-10s as %s %dx%d, %.3f ms of it scaling\n", "", ImageFormatName(encoded.format),
+                    encoded.width, encoded.height, encoded.scaleMs);
+
+        // The same through the encode cache: what a new frame costs to
+        // hash, and a repeat request for an unchanged one
+        EncodeCache cache;
+        EncodeCache::Key key;
+        key.width = width;
+        key.height = height;
+        key.policy = policy;
+        key.base64 = true;
+        ms = TimeMs(iterations, [&] {
+            key.content = cache.ContentHash(view, 0);
+            return true;
+        });
+        Report("hash", ms, 0, rawBytes);
+
+        auto entry = std::make_shared<CachedEncoding>();
+        entry->image = encoded;
+        entry->base64 = Base64::Encode(encoded.bytes);
+        cache.Insert(key, entry);
+        std::shared_ptr<const CachedEncoding> hit;
+        ms = TimeMs(iterations, [&] {
+            key.content = cache.ContentHash(view, 1);
+            hit = cache.Find(key);
+            return hit != nullptr;
+        });
+        Report("cache hit", ms, hit ? hit->base64.size() : 0, rawBytes);
+        EncodeCache::Stats stats = cache.GetStats();
+        std::printf("%-10s %llu of %llu lookups hit, %llu hashes skipped, %.1f MB and %.1f ms saved\n", "",
+                    static_cast<unsigned long long>(stats.hits), static_cast<unsigned long long>(stats.lookups),
+                    static_cast<unsigned long long>(stats.hashesSkipped), stats.bytesSaved / (1024.0 * 1024.0),
+                    stats.msSaved);
+    }
+
+    // A dialog opens on the desktop: the next turn of a session sends
+    // only the tiles it covers, and the client's rebuilt frame must
+    // match the new one
+    {
+        std::vector<uint8_t> next = pixels;
+        int dialogX = width / 3, dialogY = height / 3;
+        int dialogWidth = std::min(480, width - dialogX), dialogHeight = std::min(320, height - dialogY);
+        for (int y = dialogY; y < dialogY + dialogHeight; ++y) {
+            for (int x = dialogX; x < dialogX + dialogWidth; ++x) {
+                bool border = y < dialogY + 28 || x == dialogX || x == dialogX + dialogWidth - 1;
+                uint32_t bgra = border ? 0xFF2B579Au : ((x / 7 + y / 13) % 5 == 0 ? 0xFF202020u : 0xFFF3F3F3u);
+                std::memcpy(&next[(static_cast<size_t>(y) * width + x) * 4], &bgra, 4);
+            }
+        }
+        FrameView nextView(nullptr, next.data(), width, height, static_cast<size_t>(width) * 4);
+
+        // Hashing the tiles is the work every delta turn adds; the
+        // atlas is then packed and encoded in place of the whole frame
+        double ms = TimeMs(iterations, [&] {
+            return !TileDeltaTracker::HashTiles(nextView, TileDeltaTracker::kDefaultTileSize).empty();
+        });
+        Report("tile hash", ms, 0, rawBytes);
+
+        TileDeltaTracker tracker;
+        TileDelta delta = tracker.Update("bench", 0, view);
+        delta = tracker.Update("bench", delta.baseline, nextView);
+        PngEncoder encoder;
+        std::vector<uint8_t> atlas;
+        int atlasWidth = 0, atlasHeight = 0;
+        ms = TimeMs(iterations, [&] {
+            TileDeltaTracker::PackTiles(nextView, delta, delta.columns, atlas, atlasWidth, atlasHeight);
+            return !delta.full && encoder.Encode(
+                FrameView(nullptr, atlas.data(), atlasWidth, atlasHeight, static_cast<size_t>(atlasWidth) * 4), png);
+        });
+        Report("delta", ms, png.size(), rawBytes);
+        std::printf("%-10s %zu of %d tiles, atlas %dx%d\n", "", delta.tiles.size(), delta.columns * delta.rows,
+                    atlasWidth, atlasHeight);
+
+        // What a client does: copy each atlas cell over its baseline tile
+        std::vector<uint8_t> rebuilt = pixels;
+        int atlasColumns = atlasWidth / delta.tileSize;
+        for (size_t k = 0; k < delta.tiles.size(); ++k) {
+            int left = delta.tiles[k] % delta.columns * delta.tileSize;
+            int top = delta.tiles[k] / delta.columns * delta.tileSize;
+            int cellX = static_cast<int>(k) % atlasColumns * delta.tileSize;
+            int cellY = static_cast<int>(k) / atlasColumns * delta.tileSize;
+            for (int y = 0; y < std::min(delta.tileSize, height - top); ++y) {
+                std::memcpy(&rebuilt[(static_cast<size_t>(top + y) * width + left) * 4],
+                            &atlas[(static_cast<size_t>(cellY + y) * atlasWidth + cellX) * 4],
+                            static_cast<size_t>(std::min(delta.tileSize, width - left)) * 4);
+            }
+        }
+        bool rebuiltOk = rebuilt == next;
+        std::printf("rebuilt frame: %s\n", rebuiltOk ? "ok" : "MISMATCH");
+        ok = ok && rebuiltOk;
+    }
+
+#if defined(_WIN32)
+    if (SUCCEEDED(CoInitializeEx(nullptr, COINIT_MULTITHREADED))) {
+        IWICImagingFactory* factory = nullptr;
+        if (SUCCEEDED(CoCreateInstance(CLSID_WICImagingFactory, nullptr, CLSCTX_INPROC_SERVER,
+                                       IID_IWICImagingFactory, reinterpret_cast<void**>(&factory)))) {
+            double ms = TimeMs(iterations, [&] { return EncodeWic(factory, view, png); });
+            Report("wic", ms, png.size(), rawBytes);
+            factory->Release();
+        }
+        CoUninitialize();
+    }
+#endif
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,141 @@
+// Region capture benchmark (Linux/X11)
+//
+// Compares three ways of getting a screen region:
+//   full    read the whole screen, fold it into a FrameBuffer, crop a copy
+//           (what CaptureRegion used to do on every call)
+//   region  read only the region from the X server (XShmGetImage)
+//   cached  copy the region out of an already current FrameBuffer
+//           through a zero-copy FrameView
+//
+// On a display with several screens it also times compositing them into
+// one desktop image and checks each output's view of the composite, and
+// the coordinate mapping, against that screen read on its own: a check
+// on real screens of what tests/desktop_layout_test covers without one.
+//
+// Usage: region_capture_bench [x y width height [iterations]]
+// Needs an X display with MIT-SHM, e.g. xvfb-run -s "-screen 0 5120x1440x24"
+// (add "-screen 1 1920x1080x24" for the multi-screen pass)
+
+#include "desktop_layout.h"
+#include "frame_buffer.h"
+#include "frame_view.h"
+#include "x11_frame_source.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+
+namespace {
+
+double TimeMs(int iterations, const std::function<bool()>& body) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        if (!body()) return -1.0;
+    }
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / iterations;
+}
+
+void Report(const char* name, double ms, size_t bytesRead) {
+    if (ms < 0) {
+        std::printf("%-9s failed\n", name);
+        return;
+    }
+    std::printf("%-9s %9.3f ms/call  %9.2f MB read/call\n", name, ms, bytesRead / (1024.0 * 1024.0));
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    Rect region = {100, 100, 400, 300};
+    int iterations = 200;
+    if (argc >= 5) {
+        region = {std::atoi(argv[1]), std::atoi(argv[2]), std::atoi(argv[3]), std::atoi(argv[4])};
+    }
+    if (argc >= 6) {
+        iterations = std::max(std::atoi(argv[5]), 1);
+    }
+
+    X11FrameSource source;
+    if (!source.Initialize()) {
+        return 1;
+    }
+    std::printf("screen %dx%d, region %dx%d at (%d,%d), %d iterations\n",
+                source.Width(), source.Height(), region.width, region.height, region.x, region.y, iterations);
+
+    FrameBuffer buffer;
+    std::vector<uint8_t> pixels;
+
+    double fullMs = TimeMs(iterations, [&] {
+        FrameUpdate update;
+        if (source.AcquireFrame(0, update) != FrameStatus::Ok) return false;
+        buffer.Apply(update);
+        source.ReleaseFrame();
+        FrameView whole(nullptr, buffer.Data(), buffer.Width(), buffer.Height(), buffer.Stride());
+        pixels = whole.Crop(region).CopyPixels();
+        return !pixels.empty();
+    });
+    Report("full", fullMs, static_cast<size_t>(source.Width()) * source.Height() * 4);
+
+    Rect clipped = region;
+    double regionMs = TimeMs(iterations, [&] {
+        clipped = region;
+        return source.ReadRegion(clipped, pixels);
+    });
+    Report("region", regionMs, static_cast<size_t>(clipped.width) * clipped.height * 4);
+
+    double cachedMs = TimeMs(iterations, [&] {
+        FrameView whole(nullptr, buffer.Data(), buffer.Width(), buffer.Height(), buffer.Stride());
+        pixels = whole.Crop(region).CopyPixels();
+        return !pixels.empty();
+    });
+    Report("cached", cachedMs, 0);
+
+    std::vector<OutputInfo> infos = X11FrameSource::EnumerateOutputs();
+    if (infos.size() < 2) {
+        return 0;
+    }
+
+    DesktopLayout layout(infos);
+    std::vector<std::unique_ptr<X11FrameSource>> sources;
+    for (const auto& info : layout.Outputs()) {
+        sources.push_back(std::make_unique<X11FrameSource>(nullptr, info.index));
+        if (!sources.back()->Initialize()) {
+            return 1;
+        }
+    }
+
+    FrameBuffer desktop;
+    desktop.Reset(layout.Width(), layout.Height());
+    double compositeMs = TimeMs(iterations, [&] {
+        for (int i = 0; i < layout.Count(); ++i) {
+            FrameUpdate update;
+            if (sources[i]->AcquireFrame(0, update) != FrameStatus::Ok) return false;
+            Rect placement = layout.Placement(i);
+            desktop.ApplyAt(update, placement.x, placement.y);
+            sources[i]->ReleaseFrame();
+        }
+        return true;
+    });
+    Report("composite", compositeMs, static_cast<size_t>(layout.Width()) * layout.Height() * 4);
+
+    // Each output's part of the composite must be exactly that screen,
+    // and composite <-> output coordinates must round-trip
+    FrameView whole(nullptr, desktop.Data(), desktop.Width(), desktop.Height(), desktop.Stride());
+    bool ok = true;
+    for (int i = 0; i < layout.Count(); ++i) {
+        Rect placement = layout.Placement(i);
+        Rect own = {0, 0, placement.width, placement.height};
+        ok = ok && sources[i]->ReadRegion(own, pixels) && whole.Crop(placement).CopyPixels() == pixels;
+
+        int x = 0, y = 0, position = -1, outputX = 0, outputY = 0;
+        ok = ok && layout.FromOutput(i, placement.width - 1, 7, x, y) &&
+             layout.ToOutput(x, y, position, outputX, outputY) &&
+             position == i && outputX == placement.width - 1 && outputY == 7;
+    }
+    std::printf("composite of %d outputs, %dx%d: %s\n", layout.Count(), layout.Width(), layout.Height(),
+                ok ? "ok" : "MISMATCH");
+    return ok ? 0 : 1;
+}
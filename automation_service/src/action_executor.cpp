@@ -1,6 +1,9 @@
 #include "action_executor.h"
+#include "base64.h"
 #include <winhttp.h>
+#include <algorithm>
 #include <set>
+#include <sstream>
 
 ActionExecutor::ActionExecutor() : initialized_(false) {
     uiAutomation_ = std::make_unique<UIAutomation>();
@@ -9,9 +12,37 @@ ActionExecutor::ActionExecutor() : initialized_(false) {
     credentialStore_ = std::make_unique<CredentialStore>();
     aiProvider_ = std::make_unique<AIProvider>(*credentialStore_);
     asyncManager_ = std::make_unique<AsyncRequestManager>();
+
+    // Local inference saturates the GPU, so Ollama runs one at a time.
+    // Cloud providers are rate-limited server-side; allow a little overlap.
+    asyncManager_->SetProviderLimit("ollama", 1);
+    asyncManager_->SetProviderLimit("openai", 2);
+    asyncManager_->SetProviderLimit("anthropic", 2);
+
+    // Cloud uploads dominate request time, so their screenshots go as
+    // PNG only while that stays small, JPEG otherwise. They are also
+    // downscaled to what each model resamples to anyway: GPT-4o fits
+    // images to 768 px on the short side (about 1 MP for a wide screen),
+    // Claude to 1568 px on the long side and about 1.15 MP. Ollama is
+    // local: full resolution, lossless, whatever the size.
+    EncodePolicy openai;
+    openai.format = ImageFormat::Auto;
+    openai.quality = 80;
+    openai.maxBytes = kCloudScreenshotBytes;
+    openai.maxPixels = 1024 * 1024;
+    openai.maxEdge = 2048;
+    screenCapture_->SetEncodePolicy("openai", openai);
+
+    EncodePolicy anthropic = openai;
+    anthropic.maxPixels = 1150000;
+    anthropic.maxEdge = 1568;
+    screenCapture_->SetEncodePolicy("anthropic", anthropic);
+    screenCapture_->SetEncodePolicy("ollama", EncodePolicy());
 }
 
 ActionExecutor::~ActionExecutor() {
+    // The capture threads outlive inputController_
+    screenCapture_->SetLayoutListener(nullptr);
 }
 
 bool ActionExecutor::Initialize() {
@@ -25,12 +56,24 @@ bool ActionExecutor::Initialize() {
         return false;
     }
     
+    // Input and UI tree bounds use the same coordinates as the composite
+    // screenshot, whose origin moves when a display mode change lays the
+    // desktop out again
+    screenCapture_->SetLayoutListener([this](const DesktopLayout& layout) {
+        inputController_->SetDesktopBounds(layout.Bounds());
+        uiAutomation_->SetDesktopBounds(layout.Bounds());
+    });
+    
     // Initialize Screen Capture
     if (!screenCapture_->Initialize()) {
         LOG_ERROR(L"Failed to initialize Screen Capture");
         return false;
     }
     
+    DesktopLayout layout = screenCapture_->GetLayout();
+    inputController_->SetDesktopBounds(layout.Bounds());
+    uiAutomation_->SetDesktopBounds(layout.Bounds());
+    
     initialized_ = true;
     LOG_INFO(L"Action Executor initialized successfully");
     return true;
@@ -52,7 +95,7 @@ json ActionExecutor::GetCapabilities() {
     };
 }
 
-json ActionExecutor::CaptureScreen() {
+json ActionExecutor::CaptureScreen(const json& params, bool base64) {
     if (!initialized_) {
         return {
             {"success", false},
@@ -61,29 +104,225 @@ json ActionExecutor::CaptureScreen() {
     }
     
     try {
-        // Capture screen
-        ImageData pixels = screenCapture_->CaptureScreen();
+        // Latest frame from the capture thread; no wait on the desktop
+        auto frame = screenCapture_->GetLatestFrame();
         
-        if (pixels.empty()) {
+        if (!frame || frame->pixels.Empty()) {
             return {
                 {"success", false},
                 {"error", "Failed to capture screen"}
             };
         }
         
-        // Get dimensions
-        int width, height;
-        screenCapture_->GetScreenDimensions(width, height);
+        // The whole virtual desktop, or just one output of it
+        FrameView image = screenCapture_->GetRegionView({0, 0, frame->width, frame->height}, frame);
+        if (params.contains("output")) {
+            if (!params["output"].is_number_integer()) {
+                return {
+                    {"success", false},
+                    {"error", "output must be an output index"}
+                };
+            }
+            image = screenCapture_->GetOutputView(params["output"].get<int>(), frame);
+            if (image.Empty()) {
+                return {
+                    {"success", false},
+                    {"error", "Unknown output"}
+                };
+            }
+        }
         
-        // Encode to PNG base64
-        std::string base64Image = screenCapture_->EncodeToPNG(pixels, width, height);
+        // Optional region of that image: encoded straight from the frame's rows
+        Rect region = {0, 0, image.Width(), image.Height()};
+        if (params.contains("region")) {
+            const json& r = params["region"];
+            if (!r.is_object() || !r.contains("x") || !r.contains("y") ||
+                !r.contains("width") || !r.contains("height")) {
+                return {
+                    {"success", false},
+                    {"error", "region requires x, y, width and height"}
+                };
+            }
+            region = {r["x"].get<int>(), r["y"].get<int>(), r["width"].get<int>(), r["height"].get<int>()};
+        }
         
-        return {
+        FrameView view = image.Crop(region);
+        if (view.Empty()) {
+            return {
+                {"success", false},
+                {"error", "Region is outside the screen"}
+            };
+        }
+        
+        // Delta mode: only the tiles that changed since the image this
+        // session's client holds (its baseline id), see TileDeltaTracker
+        bool delta = false;
+        std::string session;
+        uint64_t baseline = 0;
+        if (params.contains("delta")) {
+            if (!params["delta"].is_boolean()) {
+                return {
+                    {"success", false},
+                    {"error", "delta must be true or false"}
+                };
+            }
+            delta = params["delta"].get<bool>();
+        }
+        if (delta) {
+            if (!params.contains("session_id") || !params["session_id"].is_string() ||
+                params["session_id"].get<std::string>().empty()) {
+                return {
+                    {"success", false},
+                    {"error", "delta requires a session_id"}
+                };
+            }
+            session = params["session_id"].get<std::string>();
+            if (params.contains("baseline")) {
+                if (!params["baseline"].is_number_unsigned()) {
+                    return {
+                        {"success", false},
+                        {"error", "baseline must be an id from an earlier delta response"}
+                    };
+                }
+                baseline = params["baseline"].get<uint64_t>();
+            }
+        }
+        // PNG, lossless (indexed when the screen has at most 256 colors),
+        // or png8: always indexed, quantized if need be
+        EncodePolicy policy;
+        if (params.contains("format")) {
+            if (!params["format"].is_string() ||
+                !ParseImageFormat(params["format"].get<std::string>(), policy.format) ||
+                (policy.format != ImageFormat::Png && policy.format != ImageFormat::Png8)) {
+                return {
+                    {"success", false},
+                    {"error", "format must be png or png8"}
+                };
+            }
+        }
+        
+        TileDelta tiles;
+        if (delta) {
+            tiles = tileDeltas_.Update(session, baseline, view);
+        }
+        
+        // Encode to PNG: the whole image (reusing the encoding of an
+        // unchanged screen, and its base64 text when asked for) or an
+        // atlas of the changed tiles. Otherwise returned as a binary
+        // value: raw bytes on binary connections, base64 on JSON ones
+        // (see NativeMessaging::SendMessage)
+        bool cached = false;
+        std::shared_ptr<const CachedEncoding> encoding;
+        std::vector<byte> png;
+        int atlasWidth = 0;
+        int atlasHeight = 0;
+        if (!delta || tiles.full) {
+            encoding = screenCapture_->EncodeCached(view, frame->generation, policy, base64, &cached);
+            if (!encoding) {
+                if (delta) {
+                    tileDeltas_.Forget(session);
+                }
+                return {
+                    {"success", false},
+                    {"error", "Failed to encode screen"}
+                };
+            }
+        } else if (!tiles.tiles.empty()) {
+            std::vector<uint8_t> atlas;
+            TileDeltaTracker::PackTiles(view, tiles, tiles.columns, atlas, atlasWidth, atlasHeight);
+            EncodedImage encoded;
+            if (!screenCapture_->Encode(
+                    FrameView(nullptr, atlas.data(), atlasWidth, atlasHeight, static_cast<size_t>(atlasWidth) * 4),
+                    policy, encoded)) {
+                // The tracker already counts these tiles as sent
+                tileDeltas_.Forget(session);
+                return {
+                    {"success", false},
+                    {"error", "Failed to encode changed tiles"}
+                };
+            }
+            png = std::move(encoded.bytes);
+        }
+        
+        auto age = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - frame->capturedAt).count();
+        
+        // Move, not copy: the response may be several MB and is
+        // streamed out in chunks by NativeMessaging::SendMessage
+        json response = {
             {"success", true},
-            {"screenshot", base64Image},
-            {"width", width},
-            {"height", height}
+            {"width", view.Width()},
+            {"height", view.Height()},
+            {"generation", frame->generation},
+            {"age_ms", age},
+            {"cached", cached}
         };
+        if (encoding) {
+            // The cache keeps its bytes, so the response gets the one copy,
+            // straight from the shared encoding. On a hit it is all the work
+            // left, and ms_saved is net of it.
+            auto copyStart = std::chrono::steady_clock::now();
+            if (base64) {
+                response["screenshot"] = encoding->base64;
+            } else {
+                response["screenshot"] = json::binary(encoding->image.bytes);
+            }
+            if (cached) {
+                screenCapture_->ChargeEncodeCacheCopy(std::chrono::duration<double, std::milli>(
+                    std::chrono::steady_clock::now() - copyStart).count());
+            }
+        } else if (!png.empty()) {
+            response["screenshot"] = json::binary(std::move(png));
+        }
+        if (delta) {
+            json info = {
+                {"baseline", tiles.baseline},
+                {"full", tiles.full},
+                {"tile_size", tiles.tileSize},
+                {"columns", tiles.columns},
+                {"rows", tiles.rows}
+            };
+            if (!tiles.full) {
+                info["tiles"] = tiles.tiles;
+                info["atlas_columns"] = atlasWidth / tiles.tileSize;
+            }
+            response["delta"] = std::move(info);
+        }
+        if (params.contains("output")) {
+            response["output"] = params["output"];
+        }
+        if (params.contains("region")) {
+            response["region"] = {
+                {"x", std::max(region.x, 0)},
+                {"y", std::max(region.y, 0)},
+                {"width", view.Width()},
+                {"height", view.Height()}
+            };
+        }
+        
+        // Where each output sits in the composite (click coordinates), and
+        // whether its part of the image is stale because capture fails
+        std::vector<ScreenCapture::OutputStatus> status = screenCapture_->GetOutputStatus();
+        json outputs = json::array();
+        for (int i = 0; i < frame->layout.Count(); ++i) {
+            const OutputInfo& info = frame->layout.Outputs()[i];
+            Rect placement = frame->layout.Placement(i);
+            bool failing = std::any_of(status.begin(), status.end(), [&info](const ScreenCapture::OutputStatus& s) {
+                return s.index == info.index && s.failing;
+            });
+            outputs.push_back({
+                {"index", info.index},
+                {"name", info.name},
+                {"primary", info.primary},
+                {"x", placement.x},
+                {"y", placement.y},
+                {"width", placement.width},
+                {"height", placement.height},
+                {"failing", failing}
+            });
+        }
+        response["outputs"] = std::move(outputs);
+        return response;
         
     } catch (const std::exception& e) {
         return {
@@ -93,6 +332,53 @@ json ActionExecutor::CaptureScreen() {
     }
 }
 
+json ActionExecutor::GetCaptureStats() {
+    PixelPool::Stats pool = screenCapture_->GetPoolStats();
+    EncodeCache::Stats cache = screenCapture_->GetEncodeCacheStats();
+    TileDeltaTracker::Stats deltas = tileDeltas_.GetStats();
+    json outputs = json::array();
+    for (const auto& status : screenCapture_->GetOutputStatus()) {
+        outputs.push_back({
+            {"index", status.index},
+            {"failing", status.failing},
+            {"failures", status.failures},
+            {"recoveries", status.recoveries}
+        });
+    }
+    return {
+        {"success", true},
+        {"outputs", std::move(outputs)},
+        {"frame_pool", {
+            {"allocations", pool.allocations},
+            {"reuses", pool.reuses},
+            {"leased", pool.leased},
+            {"peak_leased", pool.peakLeased},
+            {"idle", pool.idle},
+            {"leased_bytes", pool.leasedBytes},
+            {"reserved_bytes", pool.reservedBytes},
+            {"peak_reserved_bytes", pool.peakReservedBytes}
+        }},
+        {"encode_cache", {
+            {"lookups", cache.lookups},
+            {"hits", cache.hits},
+            {"hit_rate", cache.lookups ? static_cast<double>(cache.hits) / cache.lookups : 0.0},
+            {"hashes_skipped", cache.hashesSkipped},
+            {"evictions", cache.evictions},
+            {"bytes_saved", cache.bytesSaved},
+            {"ms_saved", cache.msSaved},
+            {"entries", cache.entries},
+            {"bytes", cache.bytes}
+        }},
+        {"tile_delta", {
+            {"captures", deltas.updates},
+            {"full_images", deltas.fullImages},
+            {"tiles_sent", deltas.tilesSent},
+            {"tiles_skipped", deltas.tilesSkipped},
+            {"sessions", deltas.sessions}
+        }}
+    };
+}
+
 json ActionExecutor::GetUITree() {
     if (!initialized_) {
         return {
@@ -118,6 +404,11 @@ json ActionExecutor::GetUITree() {
 }
 
 json ActionExecutor::ExecuteAction(const json& action) {
+    std::lock_guard<std::mutex> lock(inputMutex_);
+    return ExecuteActionLocked(action);
+}
+
+json ActionExecutor::ExecuteActionLocked(const json& action, const Deadline& deadline) {
     if (!initialized_) {
         return {
             {"success", false},
@@ -147,7 +438,7 @@ json ActionExecutor::ExecuteAction(const json& action) {
         } else if (actionType == "press_keys") {
             return ExecutePressKeys(params);
         } else if (actionType == "wait") {
-            return ExecuteWait(params);
+            return ExecuteWait(params, deadline);
         } else {
             return {
                 {"success", false},
@@ -162,7 +453,7 @@ json ActionExecutor::ExecuteAction(const json& action) {
     }
 }
 
-json ActionExecutor::ExecuteActions(const json& actions) {
+json ActionExecutor::ExecuteActions(const json& actions, const Deadline& deadline) {
     if (!actions.is_array()) {
         return {
             {"success", false},
@@ -172,8 +463,18 @@ json ActionExecutor::ExecuteActions(const json& actions) {
     
     json results = json::array();
     
+    // Hold the input lock for the whole batch so another batch can't interleave
+    std::lock_guard<std::mutex> lock(inputMutex_);
+    
+    bool deadlineExceeded = false;
     for (const auto& action : actions) {
-        json result = ExecuteAction(action);
+        // Out of time: report what ran rather than overrun
+        if (deadline.Expired()) {
+            deadlineExceeded = true;
+            break;
+        }
+
+        json result = ExecuteActionLocked(action, deadline);
         results.push_back(result);
         
         // Stop on first failure
@@ -182,10 +483,14 @@ json ActionExecutor::ExecuteActions(const json& actions) {
         }
     }
     
-    return {
+    json response = {
         {"success", true},
         {"results", results}
     };
+    if (deadlineExceeded) {
+        response["deadline_exceeded"] = true;
+    }
+    return response;
 }
 
 json ActionExecutor::ExecuteClick(const json& params) {
@@ -196,11 +501,15 @@ json ActionExecutor::ExecuteClick(const json& params) {
     int x = params["x"];
     int y = params["y"];
 
-    int screenW, screenH;
-    screenCapture_->GetScreenDimensions(screenW, screenH);
-    if (x < 0 || y < 0 || x >= screenW || y >= screenH) {
+    // Coordinates span the whole virtual desktop (every output), as in
+    // the composite screenshot
+    DesktopLayout layout = screenCapture_->GetLayout();
+    if (x < 0 || y < 0 || x >= layout.Width() || y >= layout.Height()) {
         return {{"success", false}, {"error", "Coordinates out of screen bounds"}};
     }
+    if (layout.OutputAt(x, y) < 0) {
+        return {{"success", false}, {"error", "Coordinates fall between displays"}};
+    }
 
     MouseButton button = MouseButton::Left;
     if (params.contains("button")) {
@@ -263,7 +572,7 @@ json ActionExecutor::ExecutePressKeys(const json& params) {
     return {{"success", true}, {"action", "press_keys"}};
 }
 
-json ActionExecutor::ExecuteWait(const json& params) {
+json ActionExecutor::ExecuteWait(const json& params, const Deadline& deadline) {
     if (!params.contains("ms")) {
         return {{"success", false}, {"error", "Missing ms parameter"}};
     }
@@ -272,9 +581,15 @@ json ActionExecutor::ExecuteWait(const json& params) {
     if (ms < 0 || ms > 30000) {
         return {{"success", false}, {"error", "Wait duration must be 0-30000ms"}};
     }
-    inputController_->Wait(ms);
+    // Never sleep past the batch deadline
+    int waited = deadline.Clamp(ms);
+    inputController_->Wait(waited);
     
-    return {{"success", true}, {"action", "wait"}};
+    json result = {{"success", true}, {"action", "wait"}};
+    if (waited < ms) {
+        result["waited_ms"] = waited;
+    }
+    return result;
 }
 
 MouseButton ActionExecutor::ParseMouseButton(const std::string& buttonStr) {
@@ -328,7 +643,12 @@ WORD ActionExecutor::ParseVirtualKey(const std::string& keyStr) {
     return 0;
 }
 
-json ActionExecutor::CheckLocalLLM() {
+json ActionExecutor::CheckLocalLLM(const Deadline& deadline) {
+    if (deadline.Expired()) {
+        return {{"success", true}, {"available", false}, {"error", "Deadline exceeded"}};
+    }
+
+
     // Check if Ollama is running by hitting its /api/tags endpoint
     HINTERNET hSession = WinHttpOpen(
         L"BrowserAI/1.0",
@@ -365,8 +685,8 @@ json ActionExecutor::CheckLocalLLM() {
                 {"error", "Failed to create HTTP request"}};
     }
 
-    // Set a short timeout (3 seconds)
-    DWORD timeout = 3000;
+    // Set a short timeout (3 seconds, less if the caller's deadline is nearer)
+    DWORD timeout = static_cast<DWORD>(std::max(deadline.Clamp(3000), 1));
     WinHttpSetOption(hRequest, WINHTTP_OPTION_CONNECT_TIMEOUT, &timeout, sizeof(timeout));
     WinHttpSetOption(hRequest, WINHTTP_OPTION_RECEIVE_TIMEOUT, &timeout, sizeof(timeout));
 
@@ -450,43 +770,192 @@ json ActionExecutor::RequestActions(const json& params) {
         return {{"success", false}, {"error", "Unknown provider: " + provider}};
     }
 
+    // Screenshot encoding: the provider's policy, optionally overridden
+    // per request by image: {format: auto|png|png8|jpeg, quality, max_bytes,
+    // max_pixels, max_edge}
+    EncodePolicy policy = screenCapture_->GetEncodePolicy(provider);
+    if (params.contains("image")) {
+        const json& image = params["image"];
+        if (!image.is_object()) {
+            return {{"success", false}, {"error", "image must be an object"}};
+        }
+        if (image.contains("format") &&
+            (!image["format"].is_string() || !ParseImageFormat(image["format"].get<std::string>(), policy.format))) {
+            return {{"success", false}, {"error", "image.format must be auto, png, png8 or jpeg"}};
+        }
+        if (image.contains("quality")) {
+            if (!image["quality"].is_number_integer() ||
+                image["quality"].get<int>() < 1 || image["quality"].get<int>() > 100) {
+                return {{"success", false}, {"error", "image.quality must be 1-100"}};
+            }
+            policy.quality = image["quality"].get<int>();
+        }
+        if (image.contains("max_bytes")) {
+            if (!image["max_bytes"].is_number_integer() || image["max_bytes"].get<int64_t>() < 0) {
+                return {{"success", false}, {"error", "image.max_bytes must be a byte count (0 = no target)"}};
+            }
+            policy.maxBytes = image["max_bytes"].get<size_t>();
+        }
+        if (image.contains("max_pixels")) {
+            if (!image["max_pixels"].is_number_integer() || image["max_pixels"].get<int64_t>() < 0) {
+                return {{"success", false}, {"error", "image.max_pixels must be a pixel count (0 = full resolution)"}};
+            }
+            policy.maxPixels = image["max_pixels"].get<int64_t>();
+        }
+        if (image.contains("max_edge")) {
+            if (!image["max_edge"].is_number_integer() || image["max_edge"].get<int64_t>() < 0) {
+                return {{"success", false}, {"error", "image.max_edge must be a length in pixels (0 = none)"}};
+            }
+            policy.maxEdge = static_cast<int>(std::min<int64_t>(image["max_edge"].get<int64_t>(), INT32_MAX));
+        }
+    }
+
+    // Optional budget for the whole pipeline, queueing included. Each
+    // stage shrinks its own timeout to what is left.
+    Deadline deadline;
+    if (!Deadline::FromParams(params, deadline)) {
+        return {{"success", false}, {"error", Deadline::kInvalidBudget}};
+    }
+
+    // Optional latest-wins key: a newer request of the same session
+    // replaces one still queued or running
+    std::string session = params.value("session_id", "");
+
+    // Take the latest published frame up front so a duplicate can be
+    // recognised before any encoding or provider call is spent on it. The
+    // frame is shared with the capture thread's pool, not copied, and
+    // (past the first frame after startup) taking it does not wait.
+    std::shared_ptr<const CapturedFrame> frame;
+
+    try {
+        frame = screenCapture_->GetLatestFrame(deadline);
+    } catch (...) {
+        LOG_ERROR(L"Screen capture failed during RequestActions");
+    }
+    if (!frame) {
+        frame = std::make_shared<const CapturedFrame>();
+    }
+
+    // Same provider, request, screen and policy would get the same answer;
+    // later submitters attach to the computation already in flight. A
+    // published frame never changes, so its generation stands for the
+    // screen, and with it the UI tree, which is only walked once the work
+    // runs. A flight runs under one deadline, so requests carrying their
+    // own deadline are not coalesced, and neither are requests without a
+    // frame to key on.
+    std::string coalesceKey;
+    if (!deadline.IsSet() && frame->generation != 0) {
+        std::ostringstream key;
+        key << provider << '|' << frame->generation << '|'
+            << ImageFormatName(policy.format) << '/' << policy.quality << '/'
+            << policy.maxBytes << '/' << policy.maxPixels << '/' << policy.maxEdge << '|' << userRequest;
+        coalesceKey = key.str();
+    }
+
     // Capture references for the lambda
     auto* executor = this;
 
-    std::string requestId = asyncManager_->Submit([executor, provider, userRequest]() -> json {
-        // Capture screen
-        std::string screenshot;
-        json uiTree;
-
-        try {
-            ImageData pixels = executor->screenCapture_->CaptureScreen();
-            if (!pixels.empty()) {
-                int w, h;
-                executor->screenCapture_->GetScreenDimensions(w, h);
-                screenshot = executor->screenCapture_->EncodeToPNG(pixels, w, h);
+    auto submission = asyncManager_->Submit(
+        [executor, provider, userRequest, frame, policy, deadline](CancellationToken& cancel) -> json {
+            const json cancelled = {{"success", false}, {"error", "Request cancelled"}};
+
+            // Spent the budget waiting in the queue
+            if (deadline.Expired()) {
+                return {{"success", false}, {"error", "Deadline exceeded"}, {"deadline_exceeded", true}};
             }
-        } catch (...) {
-            LOG_ERROR(L"Screen capture failed during RequestActions");
-        }
 
-        try {
-            uiTree = executor->uiAutomation_->GetUITree();
-        } catch (...) {
-            LOG_ERROR(L"UI tree capture failed during RequestActions");
-            uiTree = json::object();
-        }
+            // The walk stops midway if every subscriber cancels
+            json uiTree;
+            try {
+                uiTree = executor->uiAutomation_->GetUITree(nullptr, &cancel, deadline);
+            } catch (...) {
+                LOG_ERROR(L"UI tree capture failed during RequestActions");
+                uiTree = json::object();
+            }
+            if (cancel.IsCancelled()) {
+                return cancelled;
+            }
 
-        return executor->aiProvider_->GetActions(provider, screenshot, uiTree, userRequest);
-    });
+            ProviderImage screenshot;
+            json screenshotInfo;
+            try {
+                // An unchanged screen under the same policy was encoded
+                // (and base64-encoded) by an earlier request already
+                bool cached = false;
+                std::shared_ptr<const CachedEncoding> encoding;
+                if (!frame->pixels.Empty()) {
+                    encoding = executor->screenCapture_->EncodeCached(
+                        executor->screenCapture_->GetRegionView({0, 0, frame->width, frame->height}, frame),
+                        frame->generation, policy, true, &cached);
+                }
+                if (encoding) {
+                    const EncodedImage& encoded = encoding->image;
+                    screenshot.base64 = encoding->base64;
+                    screenshot.mediaType = encoded.MediaType();
+                    screenshot.width = encoded.width;
+                    screenshot.height = encoded.height;
+                    screenshot.sourceWidth = encoded.sourceWidth;
+                    screenshot.sourceHeight = encoded.sourceHeight;
+
+                    // Reported with the result: what the upload cost, and
+                    // the transform its coordinates went through
+                    screenshotInfo = {
+                        {"format", ImageFormatName(encoded.format)},
+                        {"media_type", screenshot.mediaType},
+                        {"width", encoded.width},
+                        {"height", encoded.height},
+                        {"source_width", encoded.sourceWidth},
+                        {"source_height", encoded.sourceHeight},
+                        {"scale_x", static_cast<double>(encoded.sourceWidth) / encoded.width},
+                        {"scale_y", static_cast<double>(encoded.sourceHeight) / encoded.height},
+                        {"scale_ms", encoded.scaleMs},
+                        {"bytes", encoded.bytes.size()},
+                        {"encode_ms", encoded.encodeMs},
+                        {"attempts", encoded.attempts},
+                        {"cached", cached}
+                    };
+                    if (encoded.format == ImageFormat::Jpeg) {
+                        screenshotInfo["quality"] = encoded.quality;
+                    }
+                    if (encoded.overTarget) {
+                        screenshotInfo["over_target"] = true;
+                    }
+                }
+            } catch (...) {
+                LOG_ERROR(L"Screenshot encoding failed during RequestActions");
+            }
+            if (cancel.IsCancelled()) {
+                return cancelled;
+            }
+
+            json result = executor->aiProvider_->GetActions(provider, screenshot, uiTree, userRequest,
+                                                            &cancel, deadline);
+            if (deadline.Expired() && !result.value("success", false)) {
+                result["deadline_exceeded"] = true;
+            }
+            if (!screenshotInfo.is_null()) {
+                result["screenshot"] = std::move(screenshotInfo);
+            }
+            return result;
+        }, provider, coalesceKey, session);
 
-    return {{"request_id", requestId}, {"status", "queued"}};
+    json response = {{"request_id", submission.requestId}, {"status", "queued"}};
+    if (submission.coalesced) {
+        response["coalesced"] = true;
+    }
+    if (!submission.superseded.empty()) {
+        response["superseded"] = submission.superseded;
+    }
+    return response;
 }
 
 json ActionExecutor::PollRequest(const json& params) {
     if (!params.contains("request_id")) {
         return {{"success", false}, {"error", "Missing request_id"}};
     }
-    return asyncManager_->Poll(params["request_id"]);
+    int waitMs = params.value("wait_ms", 0);
+    int64_t knownVersion = params.value("version", static_cast<int64_t>(-1));
+    return asyncManager_->Poll(params["request_id"], waitMs, knownVersion);
 }
 
 json ActionExecutor::CancelRequest(const json& params) {
@@ -7,8 +7,11 @@
 #include "credential_store.h"
 #include "ai_provider.h"
 #include "async_request.h"
+#include "deadline.h"
+#include "tile_delta.h"
 #include <nlohmann/json.hpp>
 #include <memory>
+#include <mutex>
 
 using json = nlohmann::json;
 
@@ -21,11 +24,14 @@ public:
 
     // Existing handlers (sync)
     json ExecuteAction(const json& action);
-    json ExecuteActions(const json& actions);
+    json ExecuteActions(const json& actions, const Deadline& deadline = Deadline());
     json GetCapabilities();
-    json CaptureScreen();
+    // With base64, the screenshot comes back as base64 text rather than
+    // a binary value
+    json CaptureScreen(const json& params = json::object(), bool base64 = false);
     json GetUITree();
-    json CheckLocalLLM();
+    json CheckLocalLLM(const Deadline& deadline = Deadline());
+    json GetCaptureStats();
 
     // New handlers
     json RequestActions(const json& params);      // async: submit AI request
@@ -43,13 +49,23 @@ private:
     std::unique_ptr<AIProvider> aiProvider_;
     std::unique_ptr<AsyncRequestManager> asyncManager_;
 
+    // Per-session baselines for capture_screen's delta mode
+    TileDeltaTracker tileDeltas_;
+
     bool initialized_;
 
+    // Size target for screenshots sent to cloud providers
+    static constexpr size_t kCloudScreenshotBytes = 1024 * 1024;
+
+    // Handlers run concurrently; input sequences must not interleave
+    std::mutex inputMutex_;
+
+    json ExecuteActionLocked(const json& action, const Deadline& deadline = Deadline());
     json ExecuteClick(const json& params);
     json ExecuteType(const json& params);
     json ExecuteScroll(const json& params);
     json ExecutePressKeys(const json& params);
-    json ExecuteWait(const json& params);
+    json ExecuteWait(const json& params, const Deadline& deadline);
     MouseButton ParseMouseButton(const std::string& buttonStr);
     WORD ParseVirtualKey(const std::string& keyStr);
 };
@@ -25,15 +25,25 @@ AIProvider::AIProvider(CredentialStore& credStore)
 
 
 json AIProvider::GetActions(const std::string& provider,
-                            const std::string& screenshotBase64,
+                            const ProviderImage& screenshot,
                             const json& uiTree,
-                            const std::string& userRequest) {
+                            const std::string& userRequest,
+                            CancellationToken* cancel,
+                            const Deadline& deadline) {
+    // One coordinate space for the model: the pixels of the image it is
+    // shown. Its actions are mapped back in ParseActionsFromResponse.
+    json scaledTree;
+    if (screenshot.Scaled()) {
+        scaledTree = screenshot.ToImageSpace(uiTree);
+    }
+    const json& tree = screenshot.Scaled() ? scaledTree : uiTree;
+
     if (provider == "openai") {
         std::string key = credStore_.LoadKey("openai");
         if (key.empty()) {
             return {{"success", false}, {"error", "OpenAI API key not configured. Add via Settings."}};
         }
-        return CallOpenAI(key, screenshotBase64, uiTree, userRequest);
+        return CallOpenAI(key, screenshot, tree, userRequest, cancel, deadline);
     }
 
     if (provider == "anthropic") {
@@ -41,11 +51,11 @@ json AIProvider::GetActions(const std::string& provider,
         if (key.empty()) {
             return {{"success", false}, {"error", "Anthropic API key not configured. Add via Settings."}};
         }
-        return CallAnthropic(key, screenshotBase64, uiTree, userRequest);
+        return CallAnthropic(key, screenshot, tree, userRequest, cancel, deadline);
     }
 
     if (provider == "ollama") {
-        return CallOllama(screenshotBase64, uiTree, userRequest);
+        return CallOllama(screenshot, tree, userRequest, cancel, deadline);
     }
 
     return {{"success", false}, {"error", "Unknown provider: " + provider}};
@@ -78,9 +88,11 @@ json AIProvider::GetProviderStatus() {
 
 
 json AIProvider::CallOpenAI(const std::string& apiKey,
-                             const std::string& screenshot,
+                             const ProviderImage& screenshot,
                              const json& uiTree,
-                             const std::string& request) {
+                             const std::string& request,
+                             CancellationToken* cancel,
+                             const Deadline& deadline) {
     json payload = {
         {"model", "gpt-4o"},
         {"max_tokens", 1000},
@@ -90,7 +102,7 @@ json AIProvider::CallOpenAI(const std::string& apiKey,
                 {{"type", "text"},
                  {"text", "User request: " + request + "\n\nUI Tree: " + uiTree.dump(2)}},
                 {{"type", "image_url"},
-                 {"image_url", {{"url", "data:image/png;base64," + screenshot}}}}
+                 {"image_url", {{"url", "data:" + screenshot.mediaType + ";base64," + screenshot.base64}}}}
             })}}
         })}
     };
@@ -100,7 +112,7 @@ json AIProvider::CallOpenAI(const std::string& apiKey,
     };
 
     HttpResponse resp = http_.Post(L"api.openai.com", 443,
-        L"/v1/chat/completions", payload.dump(), headers, true);
+        L"/v1/chat/completions", payload.dump(), headers, true, 60000, cancel, deadline);
 
     if (!resp.success) {
         std::string errMsg = "OpenAI API error: " + resp.error;
@@ -112,7 +124,7 @@ json AIProvider::CallOpenAI(const std::string& apiKey,
     try {
         json result = json::parse(resp.body);
         std::string content = result["choices"][0]["message"]["content"];
-        return ParseActionsFromResponse(content);
+        return ParseActionsFromResponse(content, screenshot);
     } catch (const std::exception& e) {
         return {{"success", false}, {"error", std::string("Failed to parse OpenAI response: ") + e.what()}};
     }
@@ -120,16 +132,18 @@ json AIProvider::CallOpenAI(const std::string& apiKey,
 
 
 json AIProvider::CallAnthropic(const std::string& apiKey,
-                                const std::string& screenshot,
+                                const ProviderImage& screenshot,
                                 const json& uiTree,
-                                const std::string& request) {
+                                const std::string& request,
+                                CancellationToken* cancel,
+                                const Deadline& deadline) {
     json payload = {
         {"model", "claude-sonnet-4-20250514"},
         {"max_tokens", 1024},
         {"messages", json::array({
             {{"role", "user"}, {"content", json::array({
                 {{"type", "image"},
-                 {"source", {{"type", "base64"}, {"media_type", "image/png"}, {"data", screenshot}}}},
+                 {"source", {{"type", "base64"}, {"media_type", screenshot.mediaType}, {"data", screenshot.base64}}}},
                 {{"type", "text"},
                  {"text", SYSTEM_PROMPT + "\n\nUser request: " + request + "\n\nUI Tree: " + uiTree.dump()}}
             })}}
@@ -142,7 +156,7 @@ json AIProvider::CallAnthropic(const std::string& apiKey,
     };
 
     HttpResponse resp = http_.Post(L"api.anthropic.com", 443,
-        L"/v1/messages", payload.dump(), headers, true);
+        L"/v1/messages", payload.dump(), headers, true, 60000, cancel, deadline);
 
     if (!resp.success) {
         std::string errMsg = "Anthropic API error: " + resp.error;
@@ -154,16 +168,18 @@ json AIProvider::CallAnthropic(const std::string& apiKey,
     try {
         json result = json::parse(resp.body);
         std::string content = result["content"][0]["text"];
-        return ParseActionsFromResponse(content);
+        return ParseActionsFromResponse(content, screenshot);
     } catch (const std::exception& e) {
         return {{"success", false}, {"error", std::string("Failed to parse Anthropic response: ") + e.what()}};
     }
 }
 
 
-json AIProvider::CallOllama(const std::string& screenshot,
+json AIProvider::CallOllama(const ProviderImage& screenshot,
                              const json& uiTree,
-                             const std::string& request) {
+                             const std::string& request,
+                             CancellationToken* cancel,
+                             const Deadline& deadline) {
     std::string prompt = SYSTEM_PROMPT + "\n\nUser request: " + request
                          + "\n\nUI Tree:\n" + uiTree.dump(2);
 
@@ -173,12 +189,12 @@ json AIProvider::CallOllama(const std::string& screenshot,
         {"stream", false}
     };
 
-    if (!screenshot.empty()) {
-        payload["images"] = json::array({screenshot});
+    if (!screenshot.base64.empty()) {
+        payload["images"] = json::array({screenshot.base64});
     }
 
     HttpResponse resp = http_.Post(L"localhost", 11434,
-        L"/api/generate", payload.dump(), {}, false, 120000);  // 2min timeout for local inference
+        L"/api/generate", payload.dump(), {}, false, 120000, cancel, deadline);  // 2min timeout for local inference
 
     if (!resp.success) {
         return {{"success", false},
@@ -188,14 +204,14 @@ json AIProvider::CallOllama(const std::string& screenshot,
     try {
         json result = json::parse(resp.body);
         std::string content = result.value("response", "");
-        return ParseActionsFromResponse(content);
+        return ParseActionsFromResponse(content, screenshot);
     } catch (const std::exception& e) {
         return {{"success", false}, {"error", std::string("Failed to parse Ollama response: ") + e.what()}};
     }
 }
 
 
-json AIProvider::ParseActionsFromResponse(const std::string& responseText) {
+json AIProvider::ParseActionsFromResponse(const std::string& responseText, const ProviderImage& screenshot) {
     std::string text = responseText;
 
     // Trim whitespace
@@ -253,6 +269,10 @@ json AIProvider::ParseActionsFromResponse(const std::string& responseText) {
         if (!validated_action.contains("confidence")) {
             validated_action["confidence"] = 0.7;
         }
+        // ValidateAction's range is generous; the real bound is the image
+        if (validated_action.contains("params") && !screenshot.ToPhysical(validated_action["params"])) {
+            continue;
+        }
         validated.push_back(validated_action);
     }
 
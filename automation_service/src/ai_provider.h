@@ -3,6 +3,7 @@
 #include "common.h"
 #include "http_client.h"
 #include "credential_store.h"
+#include "provider_image.h"
 #include <nlohmann/json.hpp>
 #include <string>
 
@@ -21,11 +22,19 @@ public:
     ~AIProvider() = default;
 
     // Main entry point: get actions from an AI provider.
-    // screenshotBase64 and uiTree are captured internally by caller.
+    // screenshot and uiTree are captured internally by caller; the
+    // screenshot's media type goes into the data URL or media_type field.
+    // If the screenshot was downscaled, the model gets UI tree bounds in
+    // its pixels, and click/scroll coordinates come back in physical
+    // (screenshot) pixels. Actions aimed outside the sent image are dropped.
+    // Cancelling the token aborts the in-flight HTTP call; the provider
+    // timeout is shrunk to what is left of the deadline.
     json GetActions(const std::string& provider,
-                    const std::string& screenshotBase64,
+                    const ProviderImage& screenshot,
                     const json& uiTree,
-                    const std::string& userRequest);
+                    const std::string& userRequest,
+                    CancellationToken* cancel = nullptr,
+                    const Deadline& deadline = Deadline());
 
     // Get status of all providers (which have keys configured, which are available)
     json GetProviderStatus();
@@ -35,22 +44,30 @@ private:
     HttpClient http_;
 
     json CallOpenAI(const std::string& apiKey,
-                    const std::string& screenshot,
+                    const ProviderImage& screenshot,
                     const json& uiTree,
-                    const std::string& request);
+                    const std::string& request,
+                    CancellationToken* cancel,
+                    const Deadline& deadline);
 
     json CallAnthropic(const std::string& apiKey,
-                       const std::string& screenshot,
+                       const ProviderImage& screenshot,
                        const json& uiTree,
-                       const std::string& request);
+                       const std::string& request,
+                       CancellationToken* cancel,
+                       const Deadline& deadline);
 
-    json CallOllama(const std::string& screenshot,
+    json CallOllama(const ProviderImage& screenshot,
                     const json& uiTree,
-                    const std::string& request);
+                    const std::string& request,
+                    CancellationToken* cancel,
+                    const Deadline& deadline);
 
     // Parse AI text response into validated action array.
-    // Strips markdown fences, parses JSON, validates each action.
-    json ParseActionsFromResponse(const std::string& responseText);
+    // Strips markdown fences, parses JSON, validates each action, then
+    // maps click/scroll coordinates from the sent image back to the
+    // screenshot it was scaled from, dropping any aimed outside the image.
+    json ParseActionsFromResponse(const std::string& responseText, const ProviderImage& screenshot);
 
     // Validate a single action (bounds, types, limits)
     bool ValidateAction(const json& action);
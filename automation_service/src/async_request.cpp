@@ -1,9 +1,19 @@
 #include "async_request.h"
+#include <algorithm>
 #include <sstream>
 #include <iomanip>
+#include <utility>
 
-AsyncRequestManager::AsyncRequestManager() {
-    workerThread_ = std::thread(&AsyncRequestManager::WorkerLoop, this);
+#if defined(_WIN32)
+#include "common.h"
+#endif
+
+AsyncRequestManager::AsyncRequestManager(size_t workerCount)
+    : workerCount_(std::max<size_t>(workerCount, 1)) {
+    for (size_t i = 0; i < workerCount_; ++i) {
+        workers_.emplace_back(&AsyncRequestManager::WorkerLoop, this);
+    }
+    janitorThread_ = std::thread(&AsyncRequestManager::JanitorLoop, this);
 }
 
 AsyncRequestManager::~AsyncRequestManager() {
@@ -11,13 +21,37 @@ AsyncRequestManager::~AsyncRequestManager() {
 }
 
 void AsyncRequestManager::Shutdown() {
-    running_ = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        running_ = false;
+    }
+    // Release any long-polls
+    for (auto& shard : shards_) {
+        std::shared_lock<std::shared_mutex> shardLock(shard.mutex);
+        for (auto& [id, req] : shard.requests) {
+            { std::lock_guard<std::mutex> waitLock(req->waitMutex); }
+            req->changed.notify_all();
+        }
+    }
     cv_.notify_all();
-    if (workerThread_.joinable()) {
-        workerThread_.join();
+    janitorCv_.notify_all();
+    for (auto& worker : workers_) {
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+    workers_.clear();
+    if (janitorThread_.joinable()) {
+        janitorThread_.join();
     }
 }
 
+void AsyncRequestManager::SetProviderLimit(const std::string& provider, size_t limit) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    queues_[provider].limit = std::max<size_t>(limit, 1);
+    cv_.notify_all();
+}
+
 std::string AsyncRequestManager::GenerateId() {
     static std::mt19937 rng(std::random_device{}());
     static const char chars[] = "abcdefghijklmnopqrstuvwxyz0123456789";
@@ -29,42 +63,164 @@ std::string AsyncRequestManager::GenerateId() {
     return id;
 }
 
-std::string AsyncRequestManager::Submit(std::function<json()> work) {
-    std::lock_guard<std::mutex> lock(mutex_);
+const char* AsyncRequestManager::StateName(State state) {
+    switch (state) {
+        case State::Queued:     return "queued";
+        case State::Processing: return "processing";
+        case State::Complete:   return "complete";
+        case State::Error:      return "error";
+        case State::Cancelled:  return "cancelled";
+    }
+    return "unknown";
+}
 
-    CleanupStale();
+AsyncRequestManager::Shard& AsyncRequestManager::ShardFor(const std::string& id) {
+    return shards_[std::hash<std::string>{}(id) % kShardCount];
+}
 
-    auto req = std::make_shared<Request>();
-    req->id = GenerateId();
-    req->status = "queued";
-    req->work = std::move(work);
+std::shared_ptr<AsyncRequestManager::Request> AsyncRequestManager::Find(const std::string& id) {
+    Shard& shard = ShardFor(id);
+    std::shared_lock<std::shared_mutex> lock(shard.mutex);
+    auto it = shard.requests.find(id);
+    return it != shard.requests.end() ? it->second : nullptr;
+}
 
-    requests_[req->id] = req;
-    workQueue_.push(req);
-    cv_.notify_one();
+bool AsyncRequestManager::Transition(Request& req, State from, State to) {
+    uint64_t word = req.stateWord.load();
+    do {
+        if (StateOf(word) != from) return false;
+    } while (!req.stateWord.compare_exchange_weak(word,
+                 (static_cast<uint64_t>(VersionOf(word) + 1) << 8) | static_cast<uint64_t>(to)));
 
-    return req->id;
+    // Taking waitMutex orders this against a long-poll between its
+    // predicate check and its wait, so the wakeup can't be lost
+    { std::lock_guard<std::mutex> lock(req.waitMutex); }
+    req.changed.notify_all();
+    return true;
 }
 
-json AsyncRequestManager::Poll(const std::string& requestId) {
-    std::lock_guard<std::mutex> lock(mutex_);
+AsyncRequestManager::Submission AsyncRequestManager::Submit(Work work, const std::string& provider,
+                                                            const std::string& coalesceKey,
+                                                            const std::string& session) {
+    Submission submission;
+    std::shared_ptr<Flight> abandoned;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
 
-    auto it = requests_.find(requestId);
-    if (it == requests_.end()) {
-        return {{"request_id", requestId}, {"status", "not_found"}};
+        auto req = std::make_shared<Request>();
+        req->id = GenerateId();
+        req->provider = provider;
+        req->session = session;
+        submission.requestId = req->id;
+
+        std::shared_ptr<Flight> flight;
+        if (!coalesceKey.empty()) {
+            auto it = inflight_.find(coalesceKey);
+            if (it != inflight_.end()) {
+                flight = it->second;
+            }
+        }
+
+        if (flight) {
+            // Join the existing flight at whatever stage it has reached
+            State state = flight->started ? State::Processing : State::Queued;
+            req->stateWord = (uint64_t{1} << 8) | static_cast<uint64_t>(state);
+            submission.coalesced = true;
+        } else {
+            flight = std::make_shared<Flight>();
+            flight->key = coalesceKey;
+            flight->work = std::move(work);
+
+            ProviderQueue& queue = queues_[provider];
+            flight->queue = &queue;
+            flight->ticket = queue.enqueued++;
+            queue.pending.push_back(flight);
+            if (!coalesceKey.empty()) {
+                inflight_[coalesceKey] = flight;
+            }
+
+            req->stateWord = (uint64_t{1} << 8) | static_cast<uint64_t>(State::Queued);
+            cv_.notify_one();
+        }
+
+        req->flight = flight;
+        flight->subscribers.push_back(req);
+
+        {
+            Shard& shard = ShardFor(req->id);
+            std::unique_lock<std::shared_mutex> shardLock(shard.mutex);
+            shard.requests[req->id] = req;
+        }
+
+        // Latest wins: the session's previous request is no longer wanted
+        if (!session.empty()) {
+            std::shared_ptr<Request> previous = std::exchange(sessions_[session], req);
+            if (previous) {
+                submission.superseded = previous->id;
+                abandoned = CancelLocked(previous, req->id);
+            }
+        }
+    }
+
+    if (abandoned) {
+        // Aborts any in-flight HTTP call; the worker discards the result
+        abandoned->cancel.Cancel();
     }
 
-    auto& req = it->second;
-    json response = {{"request_id", requestId}, {"status", req->status}};
+    return submission;
+}
 
-    if (req->status == "complete" || req->status == "error") {
-        response["result"] = req->result;
-        // Merge actions into top level for convenience
-        if (req->result.contains("actions")) {
-            response["actions"] = req->result["actions"];
+json AsyncRequestManager::Poll(const std::string& requestId, int waitMs, int64_t knownVersion) {
+    // Holding our own reference keeps req alive if it is evicted meanwhile
+    std::shared_ptr<Request> req = Find(requestId);
+    if (!req) {
+        return {{"request_id", requestId}, {"status", "not_found"}};
+    }
+
+    uint64_t word = req->stateWord.load();
+    if (waitMs > 0 && !IsFinal(StateOf(word))) {
+        // Over the waiter cap the poll answers now; the caller polls again
+        if (pollWaiters_.fetch_add(1) < kMaxPollWaiters) {
+            int64_t baseline = knownVersion >= 0 ? knownVersion : VersionOf(word);
+            std::unique_lock<std::mutex> lock(req->waitMutex);
+            req->changed.wait_for(lock,
+                std::chrono::milliseconds(std::min(waitMs, kMaxPollWaitMs)),
+                [&] { return !running_ || VersionOf(req->stateWord.load()) > baseline; });
+            word = req->stateWord.load();
         }
-        if (req->result.contains("error")) {
-            response["error"] = req->result["error"];
+        --pollWaiters_;
+    }
+
+    // A poll counts as a use for LRU eviction
+    req->referenced.store(true, std::memory_order_relaxed);
+
+    State state = StateOf(word);
+    json response = {{"request_id", requestId}, {"status", StateName(state)}, {"version", VersionOf(word)},
+                     {"workers", workerCount_}, {"busy_workers", busyWorkers_.load()}};
+
+    if (state == State::Queued) {
+        // Requests ahead of this one on the same provider
+        const Flight& flight = *req->flight;
+        int64_t ahead = static_cast<int64_t>(flight.ticket - flight.queue->dequeued.load());
+        response["queue_position"] = std::max<int64_t>(ahead, 0);
+    }
+
+    if (state == State::Cancelled && !req->supersededBy.empty()) {
+        response["superseded_by"] = req->supersededBy;
+    }
+
+    if (state == State::Complete || state == State::Error) {
+        // Published before the state word moved to a final state
+        std::shared_ptr<const json> result = std::atomic_load(&req->result);
+        if (result) {
+            response["result"] = *result;
+            // Merge actions into top level for convenience
+            if (result->contains("actions")) {
+                response["actions"] = (*result)["actions"];
+            }
+            if (result->contains("error")) {
+                response["error"] = (*result)["error"];
+            }
         }
     }
 
@@ -72,80 +228,229 @@ json AsyncRequestManager::Poll(const std::string& requestId) {
 }
 
 json AsyncRequestManager::Cancel(const std::string& requestId) {
-    std::lock_guard<std::mutex> lock(mutex_);
-
-    auto it = requests_.find(requestId);
-    if (it == requests_.end()) {
+    std::shared_ptr<Request> req = Find(requestId);
+    if (!req) {
         return {{"request_id", requestId}, {"status", "not_found"}};
     }
 
-    auto& req = it->second;
-    if (req->status == "queued") {
-        req->status = "cancelled";
-    } else if (req->status == "processing") {
-        req->cancelFlag = true;
-        // Worker will check the flag and discard result
+    std::shared_ptr<Flight> abandoned;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        abandoned = CancelLocked(req);
+    }
+
+    if (abandoned) {
+        // Aborts any in-flight HTTP call; the worker discards the result
+        abandoned->cancel.Cancel();
     }
+
+    uint64_t word = req->stateWord.load();
+    return {{"request_id", requestId}, {"status", StateName(StateOf(word))}, {"version", VersionOf(word)}};
+}
+
+std::shared_ptr<AsyncRequestManager::Flight> AsyncRequestManager::CancelLocked(
+    const std::shared_ptr<Request>& req, const std::string& supersededBy) {
+    State state = StateOf(req->stateWord.load());
     // If already complete/error/cancelled, no-op
+    if (IsFinal(state)) return nullptr;
+
+    auto flight = req->flight;
+    auto& subscribers = flight->subscribers;
+    subscribers.erase(std::remove(subscribers.begin(), subscribers.end(), req), subscribers.end());
+    req->supersededBy = supersededBy;
+    Transition(*req, state, State::Cancelled);
+    req->completedAt = std::chrono::steady_clock::now();
+    Settle(req);
 
-    return {{"request_id", requestId}, {"status", req->status}};
+    // Other subscribers still want the result; only the last one out
+    // stops the work. A queued flight is dropped by NextRunnable.
+    if (!subscribers.empty()) return nullptr;
+    Forget(flight);
+    return flight->started ? flight : nullptr;
+}
+
+void AsyncRequestManager::Settle(const std::shared_ptr<Request>& req) {
+    if (!req->session.empty()) {
+        auto it = sessions_.find(req->session);
+        if (it != sessions_.end() && it->second == req) {
+            sessions_.erase(it);
+        }
+    }
+    Retain(req);
+}
+
+void AsyncRequestManager::Forget(const std::shared_ptr<Flight>& flight) {
+    if (flight->key.empty()) return;
+    auto it = inflight_.find(flight->key);
+    if (it != inflight_.end() && it->second == flight) {
+        inflight_.erase(it);
+    }
+}
+
+std::shared_ptr<AsyncRequestManager::Flight> AsyncRequestManager::NextRunnable() {
+    if (queues_.empty()) return nullptr;
+
+    // Start with the provider after the one served last
+    auto start = queues_.upper_bound(lastServed_);
+    auto it = start;
+    for (size_t visited = 0; visited < queues_.size(); ++visited, ++it) {
+        if (it == queues_.end()) it = queues_.begin();
+
+        auto& queue = it->second;
+        while (!queue.pending.empty() && queue.active < queue.limit) {
+            auto flight = queue.pending.front();
+            queue.pending.pop_front();
+            ++queue.dequeued;
+
+            // Every subscriber cancelled while it waited
+            if (flight->subscribers.empty()) continue;
+
+            flight->started = true;
+            for (auto& req : flight->subscribers) {
+                Transition(*req, State::Queued, State::Processing);
+            }
+
+            ++queue.active;
+            lastServed_ = it->first;
+            return flight;
+        }
+    }
+    return nullptr;
 }
 
 void AsyncRequestManager::WorkerLoop() {
+#if defined(_WIN32)
     LOG_INFO(L"AsyncRequestManager worker thread started");
 
+    // Work walks the UI tree through UI Automation, which needs COM on this thread
+    ComInitializer comInit;
+#endif
+
     while (running_) {
-        std::shared_ptr<Request> req;
+        std::shared_ptr<Flight> flight;
 
         {
             std::unique_lock<std::mutex> lock(mutex_);
-            cv_.wait(lock, [this] { return !running_ || !workQueue_.empty(); });
+            cv_.wait(lock, [this, &flight] {
+                if (!running_) return true;
+                flight = NextRunnable();
+                return flight != nullptr;
+            });
 
             if (!running_) break;
-            if (workQueue_.empty()) continue;
 
-            req = workQueue_.front();
-            workQueue_.pop();
-
-            if (req->status == "cancelled") continue;
-            req->status = "processing";
+            ++busyWorkers_;
         }
 
         // Execute work outside lock
+        json result;
+        bool failed = false;
         try {
-            json result = req->work();
+            result = flight->work(flight->cancel);
+        } catch (const std::exception& e) {
+            failed = true;
+            result = {{"success", false}, {"error", e.what()}};
+        }
+        // Release whatever the work captured (screenshots) now, not when
+        // the last subscriber is evicted
+        flight->work = nullptr;
 
+        // One immutable result shared by every subscriber. Results are
+        // small action lists; serialized size is a fair proxy for the
+        // memory they hold.
+        bool succeeded = !failed && result.value("success", false);
+        std::shared_ptr<const json> published;
+        size_t resultBytes = 0;
+        if (!flight->cancel.IsCancelled()) {
+            published = std::make_shared<const json>(std::move(result));
+            resultBytes = published->dump().size();
+        }
+
+        {
             std::lock_guard<std::mutex> lock(mutex_);
-            if (req->cancelFlag) {
-                req->status = "cancelled";
-            } else {
-                req->status = result.value("success", false) ? "complete" : "error";
-                req->result = result;
+            Forget(flight);
+
+            auto now = std::chrono::steady_clock::now();
+            for (auto& req : flight->subscribers) {
+                // Publish the result before the state word says it's there
+                if (published) {
+                    std::atomic_store(&req->result, published);
+                    Transition(*req, State::Processing, succeeded ? State::Complete : State::Error);
+                } else {
+                    Transition(*req, State::Processing, State::Cancelled);
+                }
+                req->completedAt = now;
+                req->resultBytes = resultBytes;
+                Settle(req);
             }
-        } catch (const std::exception& e) {
-            std::lock_guard<std::mutex> lock(mutex_);
-            req->status = "error";
-            req->result = {{"success", false}, {"error", e.what()}};
+            flight->subscribers.clear();
+
+            --busyWorkers_;
+            --flight->queue->active;
         }
 
-        req->completedAt = std::chrono::steady_clock::now();
+        // A provider slot opened up; another worker may now be able to run
+        cv_.notify_all();
     }
 
+#if defined(_WIN32)
     LOG_INFO(L"AsyncRequestManager worker thread stopped");
+#endif
 }
 
-void AsyncRequestManager::CleanupStale() {
-    // Called under lock. Remove completed/error/cancelled entries older than 5 minutes.
-    auto now = std::chrono::steady_clock::now();
-    auto cutoff = std::chrono::minutes(5);
+void AsyncRequestManager::JanitorLoop() {
+    std::unique_lock<std::mutex> lock(mutex_);
 
-    for (auto it = requests_.begin(); it != requests_.end(); ) {
-        auto& req = it->second;
-        bool isFinished = (req->status == "complete" || req->status == "error" || req->status == "cancelled");
-        if (isFinished && (now - req->completedAt) > cutoff) {
-            it = requests_.erase(it);
-        } else {
-            ++it;
+    while (running_) {
+        // Sleep until the earliest deadline (or a 1s tick when idle) so
+        // expiry never runs on the Submit/Poll path
+        auto wakeAt = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+        if (!expiries_.empty()) {
+            wakeAt = std::min(wakeAt, expiries_.top().at);
         }
+        janitorCv_.wait_until(lock, wakeAt, [this] { return !running_.load(); });
+
+        auto now = std::chrono::steady_clock::now();
+        while (!expiries_.empty() && expiries_.top().at <= now) {
+            std::string id = expiries_.top().id;
+            expiries_.pop();
+
+            auto req = Find(id);
+            if (req && req->retained && req->completedAt + kRetention <= now) {
+                Evict(req);
+            }
+        }
+    }
+}
+
+void AsyncRequestManager::Retain(const std::shared_ptr<Request>& req) {
+    req->retained = true;
+    retained_.push_front(req);
+    req->lruPos = retained_.begin();
+    retainedBytes_ += req->resultBytes;
+
+    expiries_.push({req->completedAt + kRetention, req->id});
+
+    while (retained_.size() > kMaxRetained || retainedBytes_ > kMaxRetainedBytes) {
+        auto& oldest = retained_.back();
+        // Polled since the last sweep: clear the mark and move it to the
+        // front. Each entry is spared at most once per pass, so this ends.
+        if (oldest->referenced.exchange(false, std::memory_order_relaxed) && retained_.size() > 1) {
+            retained_.splice(retained_.begin(), retained_, oldest->lruPos);
+            continue;
+        }
+        Evict(oldest);
     }
 }
+
+void AsyncRequestManager::Evict(const std::shared_ptr<Request>& req) {
+    // Copy: req may alias the list node being erased
+    std::shared_ptr<Request> victim = req;
+    retained_.erase(victim->lruPos);
+    retainedBytes_ -= victim->resultBytes;
+    victim->retained = false;
+
+    Shard& shard = ShardFor(victim->id);
+    std::unique_lock<std::shared_mutex> shardLock(shard.mutex);
+    shard.requests.erase(victim->id);
+}
@@ -1,11 +1,17 @@
 #pragma once
 
-#include "common.h"
+#include "cancellation.h"
 #include <nlohmann/json.hpp>
 #include <string>
 #include <map>
+#include <unordered_map>
+#include <array>
+#include <deque>
+#include <list>
 #include <queue>
+#include <vector>
 #include <mutex>
+#include <shared_mutex>
 #include <thread>
 #include <functional>
 #include <atomic>
@@ -19,44 +25,211 @@ using json = nlohmann::json;
  * Async Request Manager
  *
  * Manages background execution of long-running AI requests.
- * Single worker thread processes one request at a time.
- * Browser polls for results via request IDs.
+ * A pool of workers serves one FIFO queue per provider key. Each
+ * provider has its own concurrency cap, and workers pick providers
+ * round-robin, so a slow local model can't hold up cloud requests.
+ * Browser polls for results via request IDs. Polls may long-poll:
+ * they block until the request's status version moves past the one
+ * the caller already has, or the wait expires.
+ *
+ * Finished requests are retained for polling for up to kRetention,
+ * bounded by kMaxRetained entries and kMaxRetainedBytes of results;
+ * past either bound the least recently polled result is evicted.
+ * Expiry runs on a background tick off a min-heap of deadlines, so
+ * Submit never pays for cleanup.
+ *
+ * Polls never take the scheduler lock. Requests live in a sharded hash
+ * map; each carries its state and version packed in one atomic word,
+ * and its result is published as an immutable shared_ptr, so a poll
+ * reads a consistent snapshot under only a shared shard lock.
+ *
+ * Work runs as a flight that one or more requests subscribe to.
+ * Submitting with a coalesce key that matches a queued or running
+ * flight attaches a new request id to it instead of queueing the work
+ * again; every subscriber receives the same immutable result. The
+ * flight is aborted only once all of its subscribers have cancelled.
+ *
+ * Submitting with a session key opts into latest-wins: the session's
+ * previous request, if still queued or running, is cancelled as
+ * superseded, so workers only spend time on what the user wants now.
  */
 class AsyncRequestManager {
 public:
-    AsyncRequestManager();
+    explicit AsyncRequestManager(size_t workerCount = 4);
     ~AsyncRequestManager();
 
-    // Submit work. Returns a request_id immediately.
-    std::string Submit(std::function<json()> work);
+    // Work receives the request's cancellation token and should pass it
+    // to anything that blocks (HTTP calls, UI tree walks).
+    using Work = std::function<json(CancellationToken&)>;
+
+    struct Submission {
+        std::string requestId;
+        bool coalesced = false;    // attached to an existing flight
+        std::string superseded;    // earlier request of the session it cancelled
+    };
+
+    // Submit work on a provider's queue. Returns a request_id immediately.
+    // If coalesceKey is non-empty and a queued or running flight has the
+    // same key, the new request attaches to it rather than running work
+    // again. If session is non-empty, the session's previous unfinished
+    // request is cancelled (after attaching, so a resubmit of the same
+    // thing keeps its flight).
+    Submission Submit(Work work, const std::string& provider = "default",
+                      const std::string& coalesceKey = "", const std::string& session = "");
+
+    // Max requests of one provider running at once (default 1)
+    void SetProviderLimit(const std::string& provider, size_t limit);
 
     // Poll for result. Returns status and result if complete.
-    json Poll(const std::string& requestId);
+    // With waitMs > 0, blocks until the status version exceeds
+    // knownVersion (or the version at call time if knownVersion < 0).
+    json Poll(const std::string& requestId, int waitMs = 0, int64_t knownVersion = -1);
+
+    // Upper bound on a single long-poll
+    static constexpr int kMaxPollWaitMs = 30000;
 
-    // Cancel a pending or in-progress request.
+    // Long-polls allowed to wait at once. Past this, a poll answers at
+    // once as if it had no wait. Kept below the width of the dispatch
+    // lane polls wait on, so an over-cap poll always finds a worker.
+    static constexpr int kMaxPollWaiters = 12;
+
+    // Retention limits for finished requests
+    static constexpr std::chrono::minutes kRetention{5};
+    static constexpr size_t kMaxRetained = 256;
+    static constexpr size_t kMaxRetainedBytes = 32 * 1024 * 1024;
+
+    // Cancel a pending or in-progress request. In-progress work is
+    // aborted through its token, freeing the worker promptly.
     json Cancel(const std::string& requestId);
 
-    // Shut down the worker thread.
+    // Shut down the worker threads.
     void Shutdown();
 
 private:
+    enum class State : uint8_t { Queued, Processing, Complete, Error, Cancelled };
+
+    static const char* StateName(State state);
+    static bool IsFinal(State state) { return state >= State::Complete; }
+
+    // State word layout: version in the high 56 bits, State in the low 8
+    static State StateOf(uint64_t word) { return static_cast<State>(word & 0xFF); }
+    static int64_t VersionOf(uint64_t word) { return static_cast<int64_t>(word >> 8); }
+
+    struct ProviderQueue;
+    struct Request;
+
+    // One execution of work, shared by every request coalesced onto it
+    struct Flight {
+        std::string key;                       // coalesce key, empty if none
+        ProviderQueue* queue = nullptr;        // owning queue (map nodes are stable)
+        uint64_t ticket = 0;                   // enqueue order within queue
+        Work work;
+        CancellationToken cancel;
+        // Guarded by mutex_
+        bool started = false;
+        std::vector<std::shared_ptr<Request>> subscribers;
+    };
+
     struct Request {
         std::string id;
-        std::string status;  // "queued", "processing", "complete", "error", "cancelled"
-        json result;
-        std::atomic<bool> cancelFlag{false};
-        std::function<json()> work;
+        std::string provider;
+        std::shared_ptr<Flight> flight;        // set once at Submit
+        std::string session;                   // latest-wins key, empty if none
+        std::string supersededBy;              // written before the move to Cancelled
+        std::atomic<uint64_t> stateWord{0};
+        std::shared_ptr<const json> result;    // published via std::atomic_store
+        std::mutex waitMutex;                  // only for long-poll waits
+        std::condition_variable changed;
+        // Scheduler-owned, guarded by mutex_
         std::chrono::steady_clock::time_point completedAt;
+        size_t resultBytes = 0;                         // serialized size of result
+        bool retained = false;                          // in retained_ (finished)
+        std::list<std::shared_ptr<Request>>::iterator lruPos;
+        std::atomic<bool> referenced{false};            // polled since last eviction sweep
     };
 
+    struct Expiry {
+        std::chrono::steady_clock::time_point at;
+        std::string id;
+        bool operator>(const Expiry& other) const { return at > other.at; }
+    };
+
+    struct ProviderQueue {
+        // Flights whose subscribers all cancelled stay queued and are
+        // dropped when they reach the front, so tickets leave in order and
+        // a request's position is ticket - dequeued without walking the deque
+        std::deque<std::shared_ptr<Flight>> pending;
+        uint64_t enqueued = 0;
+        std::atomic<uint64_t> dequeued{0};
+        size_t active = 0;
+        size_t limit = 1;
+    };
+
+    struct Shard {
+        std::shared_mutex mutex;
+        std::unordered_map<std::string, std::shared_ptr<Request>> requests;
+    };
+    static constexpr size_t kShardCount = 16;
+
+    // Scheduler lock: queues, retention and expiry. Lock order is
+    // mutex_ before any shard mutex.
     std::mutex mutex_;
     std::condition_variable cv_;
-    std::map<std::string, std::shared_ptr<Request>> requests_;
-    std::queue<std::shared_ptr<Request>> workQueue_;
-    std::thread workerThread_;
+    std::array<Shard, kShardCount> shards_;
+    std::map<std::string, ProviderQueue> queues_;
+    std::unordered_map<std::string, std::shared_ptr<Flight>> inflight_;  // by coalesce key
+    std::unordered_map<std::string, std::shared_ptr<Request>> sessions_; // latest unfinished request
+    std::string lastServed_;  // provider served most recently, for round-robin
+    std::vector<std::thread> workers_;
+    size_t workerCount_;
+    std::atomic<size_t> busyWorkers_{0};
+    std::atomic<int> pollWaiters_{0};
     std::atomic<bool> running_{true};
 
+    // Finished requests, newest first. Eviction takes from the back but
+    // gives polled entries a second chance (CLOCK), so polls only set a
+    // flag instead of reordering the list under mutex_.
+    std::list<std::shared_ptr<Request>> retained_;
+    size_t retainedBytes_ = 0;
+
+    // Expiry deadlines of finished requests, earliest on top. Entries for
+    // requests already evicted by the LRU bound are skipped lazily.
+    std::priority_queue<Expiry, std::vector<Expiry>, std::greater<Expiry>> expiries_;
+    std::thread janitorThread_;
+    std::condition_variable janitorCv_;
+
     void WorkerLoop();
-    void CleanupStale();
+    void JanitorLoop();
+
+    // Called under lock. Next runnable flight, rotating across providers
+    // and skipping any at their concurrency cap. Drops abandoned flights
+    // and moves the subscribers of the one it returns to Processing.
+    // Null if none is runnable.
+    std::shared_ptr<Flight> NextRunnable();
+
+    // Called under lock. Stop new submitters attaching to flight.
+    void Forget(const std::shared_ptr<Flight>& flight);
+
+    // Called under lock. Cancel an unfinished request and detach it from
+    // its flight. Returns the flight if req was its last subscriber and it
+    // is already running; the caller cancels its token after unlocking.
+    std::shared_ptr<Flight> CancelLocked(const std::shared_ptr<Request>& req, const std::string& supersededBy = "");
+
+    // Called under lock once req is final
+    void Settle(const std::shared_ptr<Request>& req);
+
+    // Called under lock once a request reaches a final status: start its
+    // retention clock and evict LRU entries beyond the count/byte bounds.
+    // The caller sets req->resultBytes first.
+    void Retain(const std::shared_ptr<Request>& req);
+    void Evict(const std::shared_ptr<Request>& req);
+
+    Shard& ShardFor(const std::string& id);
+    std::shared_ptr<Request> Find(const std::string& id);
+
+    // Move req from one state to another, bumping its version and waking
+    // long-polls. Returns false (and changes nothing) if req is no longer
+    // in state from.
+    bool Transition(Request& req, State from, State to);
     std::string GenerateId();
 };
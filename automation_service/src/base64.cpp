@@ -0,0 +1,289 @@
+#include "base64.h"
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BASE64_SSE2 1
+#include <emmintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define BASE64_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace {
+
+const char kAlphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// Marks bytes outside the alphabet (padding included) in Tables::values
+constexpr uint8_t kInvalid = 0xFF;
+
+struct Tables {
+    char pairs[4096][2];        // the two characters of every 12-bit value
+    uint8_t values[256];        // character to 6-bit value
+
+    Tables() {
+        for (int i = 0; i < 4096; ++i) {
+            pairs[i][0] = kAlphabet[i >> 6];
+            pairs[i][1] = kAlphabet[i & 63];
+        }
+        std::memset(values, kInvalid, sizeof(values));
+        for (int i = 0; i < 64; ++i) {
+            values[static_cast<uint8_t>(kAlphabet[i])] = static_cast<uint8_t>(i);
+        }
+    }
+};
+
+const Tables& GetTables() {
+    static const Tables tables;
+    return tables;
+}
+
+#if BASE64_SSE2
+
+// 6-bit values to characters without a table: each value gets the
+// offset of the alphabet range it falls in
+inline __m128i ToAscii(__m128i v) {
+    __m128i offset = _mm_set1_epi8(65);     // 'A'..'Z'
+    offset = _mm_add_epi8(offset, _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(25)), _mm_set1_epi8(6)));
+    offset = _mm_sub_epi8(offset, _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(51)), _mm_set1_epi8(75)));
+    offset = _mm_sub_epi8(offset, _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(61)), _mm_set1_epi8(15)));
+    offset = _mm_add_epi8(offset, _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(62)), _mm_set1_epi8(3)));
+    return _mm_add_epi8(v, offset);
+}
+
+// The reverse: characters to 6-bit values. Sets valid to all ones in
+// the bytes that are in the alphabet.
+inline __m128i FromAscii(__m128i c, __m128i& valid) {
+    auto between = [c](char low, char high) {
+        return _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8(low - 1)),
+                             _mm_cmplt_epi8(c, _mm_set1_epi8(high + 1)));
+    };
+    __m128i upper = between('A', 'Z');
+    __m128i lower = between('a', 'z');
+    __m128i digit = between('0', '9');
+    __m128i plus = _mm_cmpeq_epi8(c, _mm_set1_epi8('+'));
+    __m128i slash = _mm_cmpeq_epi8(c, _mm_set1_epi8('/'));
+    valid = _mm_or_si128(_mm_or_si128(upper, lower), _mm_or_si128(digit, _mm_or_si128(plus, slash)));
+    __m128i offset = _mm_or_si128(
+        _mm_or_si128(_mm_and_si128(upper, _mm_set1_epi8(-65)), _mm_and_si128(lower, _mm_set1_epi8(-71))),
+        _mm_or_si128(_mm_and_si128(digit, _mm_set1_epi8(4)),
+                     _mm_or_si128(_mm_and_si128(plus, _mm_set1_epi8(19)), _mm_and_si128(slash, _mm_set1_epi8(16)))));
+    return _mm_add_epi8(c, offset);
+}
+
+#endif
+
+}  // namespace
+
+size_t Base64::Encode(const uint8_t* data, size_t size, char* out) {
+    const Tables& tables = GetTables();
+    size_t i = 0;
+    char* p = out;
+
+#if BASE64_SSE2
+    // 12 bytes per step, loaded as 16. Each 3-byte group is shifted into
+    // its own 32-bit lane as a | b << 8 | c << 16, split into four 6-bit
+    // values (one per byte, in output order) and mapped to characters.
+    const __m128i lane0 = _mm_setr_epi32(0xFFFFFF, 0, 0, 0);
+    const __m128i lane1 = _mm_setr_epi32(0, 0xFFFFFF, 0, 0);
+    const __m128i lane2 = _mm_setr_epi32(0, 0, 0xFFFFFF, 0);
+    const __m128i lane3 = _mm_setr_epi32(0, 0, 0, 0xFFFFFF);
+    for (; i + 16 <= size; i += 12, p += 16) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        __m128i v = _mm_or_si128(
+            _mm_or_si128(_mm_and_si128(x, lane0), _mm_and_si128(_mm_slli_si128(x, 1), lane1)),
+            _mm_or_si128(_mm_and_si128(_mm_slli_si128(x, 2), lane2), _mm_and_si128(_mm_slli_si128(x, 3), lane3)));
+        __m128i first = _mm_and_si128(_mm_srli_epi32(v, 2), _mm_set1_epi32(0x3F));
+        __m128i second = _mm_or_si128(_mm_and_si128(_mm_slli_epi32(v, 12), _mm_set1_epi32(0x3000)),
+                                      _mm_and_si128(_mm_srli_epi32(v, 4), _mm_set1_epi32(0x0F00)));
+        __m128i third = _mm_or_si128(_mm_and_si128(_mm_slli_epi32(v, 10), _mm_set1_epi32(0x3C0000)),
+                                     _mm_and_si128(_mm_srli_epi32(v, 6), _mm_set1_epi32(0x30000)));
+        __m128i fourth = _mm_and_si128(_mm_slli_epi32(v, 8), _mm_set1_epi32(0x3F000000));
+        __m128i values = _mm_or_si128(_mm_or_si128(first, second), _mm_or_si128(third, fourth));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(p), ToAscii(values));
+    }
+#elif BASE64_NEON
+    // 48 bytes per step: the load splits them into the first, second and
+    // third byte of each group, the store interleaves the four characters
+    uint8x16x4_t alphabet;
+    for (int k = 0; k < 4; ++k) {
+        alphabet.val[k] = vld1q_u8(reinterpret_cast<const uint8_t*>(kAlphabet) + k * 16);
+    }
+    for (; i + 48 <= size; i += 48, p += 64) {
+        uint8x16x3_t in = vld3q_u8(data + i);
+        uint8x16x4_t chars;
+        chars.val[0] = vshrq_n_u8(in.val[0], 2);
+        chars.val[1] = vorrq_u8(vshlq_n_u8(vandq_u8(in.val[0], vdupq_n_u8(0x03)), 4), vshrq_n_u8(in.val[1], 4));
+        chars.val[2] = vorrq_u8(vshlq_n_u8(vandq_u8(in.val[1], vdupq_n_u8(0x0F)), 2), vshrq_n_u8(in.val[2], 6));
+        chars.val[3] = vandq_u8(in.val[2], vdupq_n_u8(0x3F));
+        for (int k = 0; k < 4; ++k) {
+            chars.val[k] = vqtbl4q_u8(alphabet, chars.val[k]);
+        }
+        vst4q_u8(reinterpret_cast<uint8_t*>(p), chars);
+    }
+#endif
+
+    // Remaining whole groups, two characters per lookup
+    for (; i + 3 <= size; i += 3, p += 4) {
+        uint32_t n = (static_cast<uint32_t>(data[i]) << 16) | (data[i + 1] << 8) | data[i + 2];
+        std::memcpy(p, tables.pairs[n >> 12], 2);
+        std::memcpy(p + 2, tables.pairs[n & 0xFFF], 2);
+    }
+
+    // One or two bytes left: padded
+    size_t left = size - i;
+    if (left > 0) {
+        uint32_t n = (static_cast<uint32_t>(data[i]) << 16) | (left == 2 ? data[i + 1] << 8 : 0);
+        std::memcpy(p, tables.pairs[n >> 12], 2);
+        p[2] = left == 2 ? kAlphabet[(n >> 6) & 63] : '=';
+        p[3] = '=';
+        p += 4;
+    }
+    return static_cast<size_t>(p - out);
+}
+
+std::string Base64::Encode(const uint8_t* data, size_t size) {
+    std::string text;
+    Append(data, size, text);
+    return text;
+}
+
+void Base64::Append(const uint8_t* data, size_t size, std::string& out) {
+    size_t start = out.size();
+    out.resize(start + EncodedSize(size));
+    Encode(data, size, &out[start]);
+}
+
+bool Base64::Decode(const char* text, size_t size, uint8_t* out, size_t& written) {
+    written = 0;
+    if (size % 4 != 0) {
+        return false;
+    }
+    const Tables& tables = GetTables();
+    const uint8_t* in = reinterpret_cast<const uint8_t*>(text);
+    size_t i = 0;
+    uint8_t* p = out;
+
+#if BASE64_SSE2
+    // 16 characters per step. Each 32-bit lane holds four values
+    // (a | b << 8 | c << 16 | d << 24) and is packed into its first three
+    // bytes, which are stored with a 4-byte write. The fourth byte
+    // spills into the next quad's room, so the last quad (which may be
+    // padded) is always left to the scalar loop, as is any step holding
+    // a character outside the alphabet.
+    for (; i + 16 < size; i += 16, p += 12) {
+        __m128i valid;
+        __m128i v = FromAscii(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i)), valid);
+        if (_mm_movemask_epi8(valid) != 0xFFFF) {
+            break;
+        }
+        __m128i first = _mm_or_si128(_mm_and_si128(_mm_slli_epi32(v, 2), _mm_set1_epi32(0xFC)),
+                                     _mm_and_si128(_mm_srli_epi32(v, 12), _mm_set1_epi32(0x03)));
+        __m128i second = _mm_or_si128(_mm_and_si128(_mm_slli_epi32(v, 4), _mm_set1_epi32(0xF000)),
+                                      _mm_and_si128(_mm_srli_epi32(v, 10), _mm_set1_epi32(0x0F00)));
+        __m128i third = _mm_or_si128(_mm_and_si128(_mm_slli_epi32(v, 6), _mm_set1_epi32(0xC00000)),
+                                     _mm_and_si128(_mm_srli_epi32(v, 8), _mm_set1_epi32(0x3F0000)));
+        __m128i bytes = _mm_or_si128(_mm_or_si128(first, second), third);
+        for (int k = 0; k < 4; ++k) {
+            int32_t group = _mm_cvtsi128_si32(bytes);
+            std::memcpy(p + k * 3, &group, 4);
+            bytes = _mm_srli_si128(bytes, 4);
+        }
+    }
+#elif BASE64_NEON
+    // 64 characters per step, split by the load into the first to fourth
+    // character of each quad. Characters are looked up in two halves of
+    // the value table; anything invalid sets a byte's top bit.
+    uint8x16x4_t low, high;
+    for (int k = 0; k < 4; ++k) {
+        low.val[k] = vld1q_u8(tables.values + k * 16);
+        high.val[k] = vld1q_u8(tables.values + 64 + k * 16);
+    }
+    for (; i + 64 <= size; i += 64, p += 48) {
+        uint8x16x4_t c = vld4q_u8(in + i);
+        uint8x16_t bad = vdupq_n_u8(0);
+        for (int k = 0; k < 4; ++k) {
+            uint8x16_t v = vqtbx4q_u8(vqtbl4q_u8(low, c.val[k]), high, vsubq_u8(c.val[k], vdupq_n_u8(64)));
+            bad = vorrq_u8(bad, vorrq_u8(v, c.val[k]));
+            c.val[k] = v;
+        }
+        if (vmaxvq_u8(bad) & 0x80) {
+            break;
+        }
+        uint8x16x3_t bytes;
+        bytes.val[0] = vorrq_u8(vshlq_n_u8(c.val[0], 2), vshrq_n_u8(c.val[1], 4));
+        bytes.val[1] = vorrq_u8(vshlq_n_u8(c.val[1], 4), vshrq_n_u8(c.val[2], 2));
+        bytes.val[2] = vorrq_u8(vshlq_n_u8(c.val[2], 6), c.val[3]);
+        vst3q_u8(p, bytes);
+    }
+#endif
+
+    for (; i < size; i += 4) {
+        uint8_t a = tables.values[in[i]];
+        uint8_t b = tables.values[in[i + 1]];
+        uint8_t c = tables.values[in[i + 2]];
+        uint8_t d = tables.values[in[i + 3]];
+        if ((a | b | c | d) & 0x80) {
+            // Only the last quad may be padded: "xx==" or "xxx="
+            if (i + 4 != size || ((a | b) & 0x80) || in[i + 3] != '=') {
+                return false;
+            }
+            if (in[i + 2] == '=') {
+                *p++ = static_cast<uint8_t>((a << 2) | (b >> 4));
+            } else if (!(c & 0x80)) {
+                *p++ = static_cast<uint8_t>((a << 2) | (b >> 4));
+                *p++ = static_cast<uint8_t>((b << 4) | (c >> 2));
+            } else {
+                return false;
+            }
+            break;
+        }
+        uint32_t n = (a << 18) | (b << 12) | (c << 6) | d;
+        p[0] = static_cast<uint8_t>(n >> 16);
+        p[1] = static_cast<uint8_t>(n >> 8);
+        p[2] = static_cast<uint8_t>(n);
+        p += 3;
+    }
+    written = static_cast<size_t>(p - out);
+    return true;
+}
+
+bool Base64::Decode(const std::string& text, std::vector<uint8_t>& out) {
+    out.resize(MaxDecodedSize(text.size()));
+    size_t written = 0;
+    if (!Decode(text.data(), text.size(), out.data(), written)) {
+        out.clear();
+        return false;
+    }
+    out.resize(written);
+    return true;
+}
+
+void Base64Encoder::Update(const uint8_t* data, size_t size) {
+    // Complete the group the previous piece left open
+    if (carried_ > 0) {
+        size_t take = std::min(3 - carried_, size);
+        uint8_t group[3];
+        std::memcpy(group, carry_, carried_);
+        std::memcpy(group + carried_, data, take);
+        data += take;
+        size -= take;
+        if (carried_ + take < 3) {
+            std::memcpy(carry_, group, carried_ + take);
+            carried_ += take;
+            return;
+        }
+        Base64::Append(group, 3, out_);
+        carried_ = 0;
+    }
+
+    size_t whole = size / 3 * 3;
+    Base64::Append(data, whole, out_);
+    carried_ = size - whole;
+    std::memcpy(carry_, data + whole, carried_);
+}
+
+void Base64Encoder::Finish() {
+    Base64::Append(carry_, carried_, out_);
+    carried_ = 0;
+}
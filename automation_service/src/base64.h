@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * Base64
+ *
+ * RFC 4648 base64 (standard alphabet, '=' padding) for screenshots and
+ * other binary payloads. Encoding writes straight into a buffer sized
+ * up front, 12 input bytes at a time with SSE2 or 48 with NEON, and
+ * through a table of character pairs elsewhere and for the tail; every
+ * path produces the same text. Decoding is vectorized the same way and
+ * rejects anything outside the alphabet, misplaced padding and lengths
+ * that are not a multiple of 4.
+ *
+ * Platform-neutral and stateless.
+ */
+class Base64 {
+public:
+    // Characters Encode writes for size bytes
+    static size_t EncodedSize(size_t size) { return (size + 2) / 3 * 4; }
+
+    // Room Decode needs for size characters
+    static size_t MaxDecodedSize(size_t size) { return size / 4 * 3; }
+
+    // Encode into out, which has room for EncodedSize(size) characters
+    // (no terminator is written). Returns the characters written.
+    static size_t Encode(const uint8_t* data, size_t size, char* out);
+
+    static std::string Encode(const uint8_t* data, size_t size);
+    static std::string Encode(const std::vector<uint8_t>& data) { return Encode(data.data(), data.size()); }
+
+    // Append the encoding to out, growing it once
+    static void Append(const uint8_t* data, size_t size, std::string& out);
+
+    // Decode into out, which has room for MaxDecodedSize(size) bytes, and
+    // set written. False if the text is not valid base64.
+    static bool Decode(const char* text, size_t size, uint8_t* out, size_t& written);
+
+    // Decode into out, replacing its contents. False (out cleared) if the
+    // text is not valid base64.
+    static bool Decode(const std::string& text, std::vector<uint8_t>& out);
+};
+
+/**
+ * Base64 Encoder
+ *
+ * Streaming form of Base64::Encode: input arrives in pieces of any size
+ * (e.g. PNG chunks as the encoder emits them) and the text is appended
+ * to a string as it goes. Whole 3-byte groups are encoded at once; at
+ * most two bytes wait for the next piece. The result equals encoding
+ * the concatenated input in one call.
+ */
+class Base64Encoder {
+public:
+    explicit Base64Encoder(std::string& out) : out_(out) {}
+
+    // Encode the next piece of input
+    void Update(const uint8_t* data, size_t size);
+
+    // Encode the bytes still waiting, with padding. Call once, after the
+    // last Update.
+    void Finish();
+
+private:
+    std::string& out_;
+    uint8_t carry_[2] = {0, 0};
+    size_t carried_ = 0;
+};
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <functional>
+#include <map>
+#include <mutex>
+#include <atomic>
+
+/**
+ * Cancellation Token
+ *
+ * Shared between whoever may cancel a piece of work and the code doing it.
+ * Long-running steps poll IsCancelled() between units of work; blocking
+ * calls (WinHTTP) register a callback that aborts them from the
+ * cancelling thread.
+ */
+class CancellationToken {
+public:
+    CancellationToken() = default;
+    CancellationToken(const CancellationToken&) = delete;
+    CancellationToken& operator=(const CancellationToken&) = delete;
+
+    bool IsCancelled() const { return cancelled_; }
+
+    // Mark cancelled and run every registered callback once.
+    void Cancel() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (cancelled_.exchange(true)) return;
+        for (auto& [id, callback] : callbacks_) {
+            callback();
+        }
+        callbacks_.clear();
+    }
+
+    // Run callback on cancellation (immediately if already cancelled).
+    // Returns an id for Unregister.
+    size_t Register(std::function<void()> callback) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (cancelled_) {
+            callback();
+            return 0;
+        }
+        size_t id = ++nextId_;
+        callbacks_[id] = std::move(callback);
+        return id;
+    }
+
+    // Remove a callback. Once this returns the callback is not running
+    // and never will, so resources it touches may be released.
+    void Unregister(size_t id) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        callbacks_.erase(id);
+    }
+
+private:
+    std::mutex mutex_;
+    std::atomic<bool> cancelled_{false};
+    std::map<size_t, std::function<void()>> callbacks_;
+    size_t nextId_ = 0;
+};
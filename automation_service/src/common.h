@@ -6,23 +6,17 @@
 #include <vector>
 #include <memory>
 #include <cstdint>
+#include <cstring>
 #include <iostream>
 #include <stdexcept>
 #include <algorithm>
 #include <windows.h>
+#include "geometry.h"
 
 // Common types
 using byte = uint8_t;
 using ImageData = std::vector<byte>;
 
-// Rectangle structure
-struct Rect {
-    int x;
-    int y;
-    int width;
-    int height;
-};
-
 // UI Element information
 struct UIElement {
     std::wstring id;
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "common.h"
+#include <chrono>
+#include <climits>
+#include <cmath>
+
+/**
+ * Deadline
+ *
+ * Absolute point in time by which a caller needs an answer. It is passed
+ * down a pipeline (capture, UI tree, HTTP) so each stage caps its own
+ * timeout at whatever time is left instead of using a fixed one, and
+ * hands back a partial result rather than overrunning.
+ * A default-constructed Deadline never expires.
+ */
+class Deadline {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    Deadline() : at_(Clock::time_point::max()) {}
+
+    static Deadline After(int ms) {
+        Deadline deadline;
+        deadline.at_ = Clock::now() + std::chrono::milliseconds(std::max(ms, 0));
+        return deadline;
+    }
+
+    // Longest budget a request may ask for; larger ones are clamped to it
+    static constexpr int kMaxBudgetMs = 24 * 60 * 60 * 1000;
+    static constexpr const char* kInvalidBudget = "deadline_ms must be a non-negative number of milliseconds";
+
+    // Deadline from an optional "deadline_ms" budget in a request. Any
+    // JSON number is accepted: fractions round up, and budgets beyond
+    // kMaxBudgetMs are clamped. False (and no deadline) if it is present
+    // but negative or not a number.
+    template <typename Json>
+    static bool FromParams(const Json& params, Deadline& deadline) {
+        deadline = Deadline();
+        if (!params.is_object() || !params.contains("deadline_ms")) {
+            return true;
+        }
+        const auto& budget = params["deadline_ms"];
+        if (!budget.is_number()) {
+            return false;
+        }
+        double ms = budget.template get<double>();
+        if (!(ms >= 0)) {
+            return false;
+        }
+        deadline = After(static_cast<int>(std::min(std::ceil(ms), static_cast<double>(kMaxBudgetMs))));
+        return true;
+    }
+
+    bool IsSet() const { return at_ != Clock::time_point::max(); }
+    bool Expired() const { return IsSet() && Clock::now() >= at_; }
+
+    // Milliseconds left: 0 once expired, INT_MAX if unset
+    int RemainingMs() const {
+        if (!IsSet()) return INT_MAX;
+        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(at_ - Clock::now()).count();
+        return static_cast<int>(std::clamp<long long>(left, 0, INT_MAX));
+    }
+
+    // A stage's own timeout, shrunk to what is left
+    int Clamp(int timeoutMs) const { return std::min(timeoutMs, RemainingMs()); }
+
+private:
+    Clock::time_point at_;
+};
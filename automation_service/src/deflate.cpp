@@ -0,0 +1,565 @@
+#include "deflate.h"
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace {
+
+constexpr size_t kMinMatch = 4;       // hash width; 3-byte matches rarely pay off
+constexpr size_t kMaxMatch = 258;
+constexpr size_t kWindow = 32768;
+
+const uint16_t kLengthBase[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+const uint8_t kLengthExtra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+const uint16_t kDistanceBase[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+const uint8_t kDistanceExtra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+// Order code length code lengths are sent in
+const uint8_t kCodeLengthOrder[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+const uint8_t kCodeLengthExtra[19] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 3, 7};
+
+// Length code (0-28) per match length - 3, and distance code per
+// distance - 1 split like zlib's: low distances directly, the rest by
+// their top bits (codes there span multiples of 128)
+struct CodeTables {
+    uint8_t length[256];
+    uint8_t distanceLow[256];
+    uint8_t distanceHigh[256];
+
+    CodeTables() {
+        for (int code = 0; code < 28; ++code) {
+            for (int k = 0; k < (1 << kLengthExtra[code]); ++k) {
+                length[kLengthBase[code] - 3 + k] = static_cast<uint8_t>(code);
+            }
+        }
+        length[255] = 28;
+        for (int code = 0; code < 30; ++code) {
+            for (int k = 0; k < (1 << kDistanceExtra[code]); ++k) {
+                int d = kDistanceBase[code] - 1 + k;
+                if (d < 256) {
+                    distanceLow[d] = static_cast<uint8_t>(code);
+                } else {
+                    distanceHigh[d >> 7] = static_cast<uint8_t>(code);
+                }
+            }
+        }
+    }
+
+    int Distance(uint32_t d) const { return d < 256 ? distanceLow[d] : distanceHigh[d >> 7]; }
+};
+
+const CodeTables& Tables() {
+    static const CodeTables tables;
+    return tables;
+}
+
+inline uint32_t Load32(const uint8_t* p) {
+    uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline uint32_t Hash(const uint8_t* p, int bits) {
+    return (Load32(p) * 0x9E3779B1u) >> (32 - bits);
+}
+
+inline int TrailingZeros(uint64_t v) {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward64(&index, v);
+    return static_cast<int>(index);
+#else
+    return __builtin_ctzll(v);
+#endif
+}
+
+// Bytes equal at a and b, up to limit, eight at a time (little-endian:
+// the first differing byte is the lowest set byte of the XOR)
+inline size_t MatchLength(const uint8_t* a, const uint8_t* b, size_t limit) {
+    size_t n = 0;
+    while (n + 8 <= limit) {
+        uint64_t x, y;
+        std::memcpy(&x, a + n, 8);
+        std::memcpy(&y, b + n, 8);
+        if (uint64_t diff = x ^ y) {
+            return n + TrailingZeros(diff) / 8;
+        }
+        n += 8;
+    }
+    while (n < limit && a[n] == b[n]) {
+        ++n;
+    }
+    return n;
+}
+
+// Huffman code lengths limited to maxBits, 0 for unused symbols. A lone
+// used symbol gets a partner so every code is complete, which inflaters
+// require of all but the distance code.
+void BuildLengths(const uint32_t* freq, int count, int maxBits, uint8_t* lengths) {
+    std::fill(lengths, lengths + count, 0);
+
+    std::pair<uint32_t, uint16_t> symbols[286];
+    int used = 0;
+    for (int s = 0; s < count; ++s) {
+        if (freq[s]) {
+            symbols[used++] = {freq[s], static_cast<uint16_t>(s)};
+        }
+    }
+    if (used == 0) {
+        return;
+    }
+    if (used == 1) {
+        lengths[symbols[0].second] = 1;
+        lengths[symbols[0].second == 0 ? 1 : 0] = 1;
+        return;
+    }
+    std::sort(symbols, symbols + used);
+
+    // In-place minimum-redundancy lengths (Moffat & Katajainen); a[i]
+    // ends up as the depth of symbols[i]
+    uint32_t a[286];
+    for (int i = 0; i < used; ++i) {
+        a[i] = symbols[i].first;
+    }
+    int n = used;
+    a[0] += a[1];
+    int root = 0, leaf = 2;
+    for (int next = 1; next < n - 1; ++next) {
+        if (leaf >= n || a[root] < a[leaf]) {
+            a[next] = a[root];
+            a[root++] = next;
+        } else {
+            a[next] = a[leaf++];
+        }
+        if (leaf >= n || (root < next && a[root] < a[leaf])) {
+            a[next] += a[root];
+            a[root++] = next;
+        } else {
+            a[next] += a[leaf++];
+        }
+    }
+    a[n - 2] = 0;
+    for (int next = n - 3; next >= 0; --next) {
+        a[next] = a[a[next]] + 1;
+    }
+    int available = 1, usedNodes = 0, depth = 0;
+    root = n - 2;
+    int next = n - 1;
+    while (available > 0) {
+        while (root >= 0 && static_cast<int>(a[root]) == depth) {
+            ++usedNodes;
+            --root;
+        }
+        while (available > usedNodes) {
+            a[next--] = depth;
+            --available;
+        }
+        available = 2 * usedNodes;
+        ++depth;
+        usedNodes = 0;
+    }
+
+    // Clamp to maxBits, then lengthen shorter codes until the Kraft sum
+    // fits again
+    int numCodes[16] = {};
+    for (int i = 0; i < used; ++i) {
+        ++numCodes[std::min(static_cast<int>(a[i]), maxBits)];
+    }
+    uint32_t total = 0;
+    for (int bits = 1; bits <= maxBits; ++bits) {
+        total += static_cast<uint32_t>(numCodes[bits]) << (maxBits - bits);
+    }
+    while (total > (1u << maxBits)) {
+        --numCodes[maxBits];
+        for (int bits = maxBits - 1; bits > 0; --bits) {
+            if (numCodes[bits]) {
+                --numCodes[bits];
+                numCodes[bits + 1] += 2;
+                break;
+            }
+        }
+        --total;
+    }
+
+    // Longest codes to the least frequent symbols
+    int i = 0;
+    for (int bits = maxBits; bits >= 1; --bits) {
+        for (int k = numCodes[bits]; k > 0; --k) {
+            lengths[symbols[i++].second] = static_cast<uint8_t>(bits);
+        }
+    }
+}
+
+// Canonical codes, bit-reversed since deflate sends Huffman codes
+// most-significant bit first into an LSB-first stream
+void BuildCodes(const uint8_t* lengths, int count, uint16_t* codes) {
+    int numCodes[16] = {};
+    for (int s = 0; s < count; ++s) {
+        ++numCodes[lengths[s]];
+    }
+    numCodes[0] = 0;
+    uint16_t nextCode[16] = {};
+    int code = 0;
+    for (int bits = 1; bits < 16; ++bits) {
+        code = (code + numCodes[bits - 1]) << 1;
+        nextCode[bits] = static_cast<uint16_t>(code);
+    }
+    for (int s = 0; s < count; ++s) {
+        int length = lengths[s];
+        if (!length) {
+            codes[s] = 0;
+            continue;
+        }
+        uint16_t c = nextCode[length]++;
+        uint16_t reversed = 0;
+        for (int b = 0; b < length; ++b) {
+            reversed = static_cast<uint16_t>((reversed << 1) | ((c >> b) & 1));
+        }
+        codes[s] = reversed;
+    }
+}
+
+}  // namespace
+
+DeflateEncoder::DeflateEncoder()
+    : hash_(size_t(1) << kHashBits, 0) {
+    tokens_.reserve(kBlockTokens + 1);
+    std::fill(std::begin(litFreq_), std::end(litFreq_), 0);
+    std::fill(std::begin(distFreq_), std::end(distFreq_), 0);
+}
+
+void DeflateEncoder::SetProbes(size_t pixelBytes, size_t rowBytes) {
+    pixelProbe_ = pixelBytes <= kWindow ? pixelBytes : 0;
+    rowProbe_ = rowBytes <= kWindow ? rowBytes : 0;
+}
+
+void DeflateEncoder::Compress(const uint8_t* data, size_t size, bool final, std::vector<uint8_t>& out) {
+    out_ = &out;
+    pos_ = out.size();
+    bits_ = 0;
+    bitCount_ = 0;
+    std::fill(hash_.begin(), hash_.end(), 0);
+
+    size_t blockStart = 0;
+    size_t i = 0;
+    while (i < size) {
+        size_t bestLength = 0;
+        size_t bestDistance = 0;
+        size_t remaining = size - i;
+        if (remaining >= kMinMatch) {
+            size_t limit = std::min(remaining, kMaxMatch);
+            auto probe = [&](size_t distance) {
+                if (distance == 0 || distance > i || distance > kWindow || bestLength == limit) {
+                    return;
+                }
+                size_t length = MatchLength(data + i, data + i - distance, limit);
+                if (length > bestLength) {
+                    bestLength = length;
+                    bestDistance = distance;
+                }
+            };
+            probe(pixelProbe_);
+            probe(rowProbe_);
+
+            uint32_t& slot = hash_[Hash(data + i, kHashBits)];
+            size_t candidate = slot;
+            slot = static_cast<uint32_t>(i + 1);
+            if (candidate) {
+                probe(i + 1 - candidate);
+            }
+        }
+
+        if (bestLength >= kMinMatch) {
+            AddMatch(bestLength, bestDistance);
+            // Index inside short matches only; long ones are runs, which
+            // the probes find without help
+            size_t end = i + bestLength;
+            size_t from = bestLength <= 16 ? i + 1 : end - 1;
+            for (size_t p = from; p < end && p + kMinMatch <= size; ++p) {
+                hash_[Hash(data + p, kHashBits)] = static_cast<uint32_t>(p + 1);
+            }
+            i = end;
+        } else {
+            AddLiteral(data[i]);
+            ++i;
+        }
+
+        if (tokens_.size() >= kBlockTokens) {
+            FlushBlock(data + blockStart, i - blockStart, false);
+            blockStart = i;
+        }
+    }
+    if (final || blockStart < size) {
+        FlushBlock(data + blockStart, size - blockStart, final);
+    }
+
+    if (!final) {
+        // Empty stored block: byte-aligns the end of the segment
+        PutBits(0, 3);
+        AlignToByte();
+        Reserve(4);
+        uint8_t* p = out.data() + pos_;
+        p[0] = 0x00;
+        p[1] = 0x00;
+        p[2] = 0xFF;
+        p[3] = 0xFF;
+        pos_ += 4;
+    } else {
+        AlignToByte();
+    }
+    out.resize(pos_);
+    out_ = nullptr;
+}
+
+void DeflateEncoder::AddLiteral(uint8_t value) {
+    tokens_.push_back(value);
+    ++litFreq_[value];
+}
+
+void DeflateEncoder::AddMatch(size_t length, size_t distance) {
+    const CodeTables& tables = Tables();
+    uint32_t l = static_cast<uint32_t>(length - 3);
+    uint32_t d = static_cast<uint32_t>(distance - 1);
+    tokens_.push_back(0x80000000u | (l << 16) | d);
+    int lengthCode = tables.length[l];
+    int distanceCode = tables.Distance(d);
+    ++litFreq_[257 + lengthCode];
+    ++distFreq_[distanceCode];
+    extraBits_ += kLengthExtra[lengthCode] + kDistanceExtra[distanceCode];
+}
+
+void DeflateEncoder::FlushBlock(const uint8_t* data, size_t size, bool final) {
+    ++litFreq_[256];
+
+    uint8_t litLengths[286];
+    uint8_t distLengths[30];
+    BuildLengths(litFreq_, 286, 15, litLengths);
+    BuildLengths(distFreq_, 30, 15, distLengths);
+    int litCount = 286;
+    while (litCount > 257 && !litLengths[litCount - 1]) --litCount;
+    int distCount = 30;
+    while (distCount > 1 && !distLengths[distCount - 1]) --distCount;
+
+    // Both length lists as one run-length coded sequence: 16 repeats the
+    // previous length 3-6 times, 17 and 18 are runs of 3-10 and 11-138
+    // zeros. Items are symbol | extra << 5.
+    uint8_t all[286 + 30];
+    std::copy(litLengths, litLengths + litCount, all);
+    std::copy(distLengths, distLengths + distCount, all + litCount);
+    int allCount = litCount + distCount;
+
+    std::vector<uint16_t> clItems;
+    clItems.reserve(allCount);
+    uint32_t clFreq[19] = {};
+    auto emit = [&](int symbol, int extra) {
+        clItems.push_back(static_cast<uint16_t>(symbol | (extra << 5)));
+        ++clFreq[symbol];
+    };
+    for (int i = 0; i < allCount;) {
+        int length = all[i];
+        int run = 1;
+        while (i + run < allCount && all[i + run] == length) ++run;
+        i += run;
+        if (length == 0) {
+            while (run >= 3) {
+                int n = std::min(run, 138);
+                if (n >= 11) {
+                    emit(18, n - 11);
+                } else {
+                    emit(17, n - 3);
+                }
+                run -= n;
+            }
+        } else {
+            emit(length, 0);
+            --run;
+            while (run >= 3) {
+                int n = std::min(run, 6);
+                emit(16, n - 3);
+                run -= n;
+            }
+        }
+        while (run-- > 0) {
+            emit(length, 0);
+        }
+    }
+
+    uint8_t clLengths[19];
+    BuildLengths(clFreq, 19, 7, clLengths);
+    int clCount = 19;
+    while (clCount > 4 && !clLengths[kCodeLengthOrder[clCount - 1]]) --clCount;
+
+    // Exact size of the dynamic block against storing it
+    uint64_t dynamicBits = 3 + 5 + 5 + 4 + 3 * clCount + extraBits_;
+    for (int s = 0; s < 19; ++s) {
+        dynamicBits += static_cast<uint64_t>(clFreq[s]) * (clLengths[s] + kCodeLengthExtra[s]);
+    }
+    for (int s = 0; s < litCount; ++s) {
+        dynamicBits += static_cast<uint64_t>(litFreq_[s]) * litLengths[s];
+    }
+    for (int s = 0; s < distCount; ++s) {
+        dynamicBits += static_cast<uint64_t>(distFreq_[s]) * distLengths[s];
+    }
+    size_t storedBlocks = size / 65535 + 1;
+    uint64_t storedBits = storedBlocks * (3 + 7 + 32) + static_cast<uint64_t>(size) * 8;
+
+    if (storedBits < dynamicBits) {
+        Reserve(size + storedBlocks * 6 + 8);
+        WriteStored(data, size, final);
+    } else {
+        Reserve(tokens_.size() * 6 + 640);
+        WriteDynamic(litLengths, litCount, distLengths, distCount, clLengths, clCount, clItems, final);
+    }
+
+    tokens_.clear();
+    std::fill(std::begin(litFreq_), std::end(litFreq_), 0);
+    std::fill(std::begin(distFreq_), std::end(distFreq_), 0);
+    extraBits_ = 0;
+}
+
+void DeflateEncoder::WriteDynamic(const uint8_t* litLengths, int litCount,
+                                  const uint8_t* distLengths, int distCount,
+                                  const uint8_t* clLengths, int clCount,
+                                  const std::vector<uint16_t>& clItems, bool final) {
+    uint16_t litCodes[286];
+    uint16_t distCodes[30];
+    uint16_t clCodes[19];
+    BuildCodes(litLengths, 286, litCodes);
+    BuildCodes(distLengths, 30, distCodes);
+    BuildCodes(clLengths, 19, clCodes);
+
+    PutBits(final ? 1 : 0, 1);
+    PutBits(2, 2);
+    PutBits(litCount - 257, 5);
+    PutBits(distCount - 1, 5);
+    PutBits(clCount - 4, 4);
+    for (int i = 0; i < clCount; ++i) {
+        PutBits(clLengths[kCodeLengthOrder[i]], 3);
+    }
+    for (uint16_t item : clItems) {
+        int symbol = item & 31;
+        PutBits(clCodes[symbol], clLengths[symbol]);
+        if (kCodeLengthExtra[symbol]) {
+            PutBits(item >> 5, kCodeLengthExtra[symbol]);
+        }
+    }
+
+    const CodeTables& tables = Tables();
+    for (uint32_t token : tokens_) {
+        if (!(token & 0x80000000u)) {
+            PutBits(litCodes[token], litLengths[token]);
+            continue;
+        }
+        uint32_t l = (token >> 16) & 0xFF;
+        uint32_t d = token & 0x7FFF;
+        int lengthCode = tables.length[l];
+        PutBits(litCodes[257 + lengthCode], litLengths[257 + lengthCode]);
+        if (kLengthExtra[lengthCode]) {
+            PutBits(l + 3 - kLengthBase[lengthCode], kLengthExtra[lengthCode]);
+        }
+        int distanceCode = tables.Distance(d);
+        PutBits(distCodes[distanceCode], distLengths[distanceCode]);
+        if (kDistanceExtra[distanceCode]) {
+            PutBits(d + 1 - kDistanceBase[distanceCode], kDistanceExtra[distanceCode]);
+        }
+    }
+    PutBits(litCodes[256], litLengths[256]);
+}
+
+void DeflateEncoder::WriteStored(const uint8_t* data, size_t size, bool final) {
+    do {
+        size_t n = std::min<size_t>(size, 65535);
+        bool last = n == size;
+        PutBits(final && last ? 1 : 0, 1);
+        PutBits(0, 2);
+        AlignToByte();
+        uint8_t* p = out_->data() + pos_;
+        p[0] = static_cast<uint8_t>(n);
+        p[1] = static_cast<uint8_t>(n >> 8);
+        p[2] = static_cast<uint8_t>(~n);
+        p[3] = static_cast<uint8_t>(~n >> 8);
+        if (n) {
+            std::memcpy(p + 4, data, n);
+        }
+        pos_ += 4 + n;
+        data += n;
+        size -= n;
+    } while (size > 0);
+}
+
+void DeflateEncoder::Reserve(size_t bytes) {
+    size_t needed = pos_ + bytes + 8;
+    if (out_->size() < needed) {
+        out_->resize(std::max(needed, out_->size() + out_->size() / 2));
+    }
+}
+
+void DeflateEncoder::PutBits(uint32_t value, int count) {
+    bits_ |= static_cast<uint64_t>(value) << bitCount_;
+    bitCount_ += count;
+    if (bitCount_ >= 32) {
+        uint8_t* p = out_->data() + pos_;
+        p[0] = static_cast<uint8_t>(bits_);
+        p[1] = static_cast<uint8_t>(bits_ >> 8);
+        p[2] = static_cast<uint8_t>(bits_ >> 16);
+        p[3] = static_cast<uint8_t>(bits_ >> 24);
+        pos_ += 4;
+        bits_ >>= 32;
+        bitCount_ -= 32;
+    }
+}
+
+void DeflateEncoder::AlignToByte() {
+    uint8_t* p = out_->data() + pos_;
+    int bytes = (bitCount_ + 7) / 8;
+    for (int b = 0; b < bytes; ++b) {
+        p[b] = static_cast<uint8_t>(bits_ >> (8 * b));
+    }
+    pos_ += bytes;
+    bits_ = 0;
+    bitCount_ = 0;
+}
+
+uint32_t Adler32(const uint8_t* data, size_t size, uint32_t adler) {
+    const uint32_t kBase = 65521;
+    uint32_t a = adler & 0xFFFF;
+    uint32_t b = adler >> 16;
+    while (size > 0) {
+        // Largest run before b can overflow 32 bits
+        size_t n = std::min<size_t>(size, 5552);
+        size -= n;
+        for (; n > 0; --n) {
+            a += *data++;
+            b += a;
+        }
+        a %= kBase;
+        b %= kBase;
+    }
+    return (b << 16) | a;
+}
+
+uint32_t Adler32Combine(uint32_t first, uint32_t second, size_t secondSize) {
+    const uint32_t kBase = 65521;
+    uint32_t rem = static_cast<uint32_t>(secondSize % kBase);
+    uint32_t sum1 = first & 0xFFFF;
+    uint32_t sum2 = (rem * sum1) % kBase;
+    sum1 += (second & 0xFFFF) + kBase - 1;
+    sum2 += (first >> 16) + (second >> 16) + kBase - rem;
+    if (sum1 >= kBase) sum1 -= kBase;
+    if (sum1 >= kBase) sum1 -= kBase;
+    if (sum2 >= (kBase << 1)) sum2 -= (kBase << 1);
+    if (sum2 >= kBase) sum2 -= kBase;
+    return sum1 | (sum2 << 16);
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * Deflate Encoder
+ *
+ * Fast raw deflate (RFC 1951) compressor tuned for screenshots rather
+ * than general data. UI images are mostly flat fills, repeated rows and
+ * repeated glyphs, so at each position it tries the byte one pixel back
+ * and one row back before a single-slot hash of the next four bytes, and
+ * takes the longest match greedily. Each block gets its own dynamic
+ * Huffman codes, or is stored when that is smaller (photos, noise).
+ *
+ * Each Compress call is an independent segment: matches never reach
+ * into earlier calls, so segments can be compressed on separate threads
+ * and concatenated. A non-final segment ends with an empty stored block
+ * (as zlib's Z_SYNC_FLUSH does), leaving the stream byte-aligned for the
+ * next one.
+ *
+ * Not thread-safe; use one encoder per thread. Its scratch memory is
+ * kept between calls.
+ */
+class DeflateEncoder {
+public:
+    DeflateEncoder();
+
+    // Distances tried before the hash: one pixel and one row back in the
+    // data about to be compressed. 0 (or beyond the 32 KB window) skips
+    // that probe.
+    void SetProbes(size_t pixelBytes, size_t rowBytes);
+
+    // Compress data and append it to out as one segment. final marks its
+    // last block as the end of the stream.
+    void Compress(const uint8_t* data, size_t size, bool final, std::vector<uint8_t>& out);
+
+private:
+    static constexpr int kHashBits = 15;
+    static constexpr size_t kBlockTokens = 32768;
+
+    size_t pixelProbe_ = 0;
+    size_t rowProbe_ = 0;
+
+    std::vector<uint32_t> hash_;      // last position + 1 per hash, 0 = none
+    std::vector<uint32_t> tokens_;    // literals and matches of the current block
+    uint32_t litFreq_[286];
+    uint32_t distFreq_[30];
+    uint64_t extraBits_ = 0;          // length/distance extra bits in the block
+
+    // Output position and pending bits
+    std::vector<uint8_t>* out_ = nullptr;
+    size_t pos_ = 0;
+    uint64_t bits_ = 0;
+    int bitCount_ = 0;
+
+    void AddLiteral(uint8_t value);
+    void AddMatch(size_t length, size_t distance);
+    void FlushBlock(const uint8_t* data, size_t size, bool final);
+    void WriteDynamic(const uint8_t* litLengths, int litCount,
+                      const uint8_t* distLengths, int distCount,
+                      const uint8_t* clLengths, int clCount,
+                      const std::vector<uint16_t>& clItems, bool final);
+    void WriteStored(const uint8_t* data, size_t size, bool final);
+
+    void Reserve(size_t bytes);
+    void PutBits(uint32_t value, int count);
+    void AlignToByte();
+};
+
+// zlib's checksum of the uncompressed data (RFC 1950)
+uint32_t Adler32(const uint8_t* data, size_t size, uint32_t adler = 1);
+
+// Checksum of two pieces back to back, from each piece's checksum
+uint32_t Adler32Combine(uint32_t first, uint32_t second, size_t secondSize);
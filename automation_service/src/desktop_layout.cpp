@@ -0,0 +1,69 @@
+#include "desktop_layout.h"
+#include <algorithm>
+
+DesktopLayout::DesktopLayout(std::vector<OutputInfo> outputs)
+    : outputs_(std::move(outputs)) {
+    if (outputs_.empty()) {
+        return;
+    }
+
+    int left = outputs_[0].bounds.x;
+    int top = outputs_[0].bounds.y;
+    int right = left + outputs_[0].bounds.width;
+    int bottom = top + outputs_[0].bounds.height;
+    for (const auto& output : outputs_) {
+        left = std::min(left, output.bounds.x);
+        top = std::min(top, output.bounds.y);
+        right = std::max(right, output.bounds.x + output.bounds.width);
+        bottom = std::max(bottom, output.bounds.y + output.bounds.height);
+    }
+    bounds_ = {left, top, right - left, bottom - top};
+}
+
+int DesktopLayout::Find(int index) const {
+    for (int i = 0; i < Count(); ++i) {
+        if (outputs_[i].index == index) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+Rect DesktopLayout::Placement(int position) const {
+    if (position < 0 || position >= Count()) {
+        return {0, 0, 0, 0};
+    }
+    const Rect& b = outputs_[position].bounds;
+    return {b.x - bounds_.x, b.y - bounds_.y, b.width, b.height};
+}
+
+int DesktopLayout::OutputAt(int x, int y) const {
+    for (int i = 0; i < Count(); ++i) {
+        Rect r = Placement(i);
+        if (x >= r.x && y >= r.y && x < r.x + r.width && y < r.y + r.height) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+bool DesktopLayout::ToOutput(int x, int y, int& position, int& outputX, int& outputY) const {
+    position = OutputAt(x, y);
+    if (position < 0) {
+        return false;
+    }
+    Rect r = Placement(position);
+    outputX = x - r.x;
+    outputY = y - r.y;
+    return true;
+}
+
+bool DesktopLayout::FromOutput(int position, int outputX, int outputY, int& x, int& y) const {
+    Rect r = Placement(position);
+    if (outputX < 0 || outputY < 0 || outputX >= r.width || outputY >= r.height) {
+        return false;
+    }
+    x = r.x + outputX;
+    y = r.y + outputY;
+    return true;
+}
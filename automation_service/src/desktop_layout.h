@@ -0,0 +1,65 @@
+#pragma once
+
+#include "geometry.h"
+#include <string>
+#include <vector>
+
+// One monitor (DXGI output, X screen) of the desktop
+struct OutputInfo {
+    int index = 0;          // enumeration order; stable for a session
+    std::string name;
+    Rect bounds = {0, 0, 0, 0};   // desktop coordinates; negative left of/above the primary
+    bool primary = false;
+};
+
+/**
+ * Desktop Layout
+ *
+ * Where each output sits on the virtual desktop, and the mapping between
+ * desktop coordinates, composite-image pixels and per-output pixels.
+ *
+ * The composite image covers the bounding box of all outputs, with its
+ * pixel (0, 0) at the box's top-left corner, so composite coordinates
+ * are never negative. Gaps between differently sized outputs belong to
+ * no output. Action coordinates (clicks, scrolls) are composite
+ * coordinates, which equal desktop coordinates when the primary output
+ * is the top-left one.
+ *
+ * Platform-neutral.
+ */
+class DesktopLayout {
+public:
+    DesktopLayout() = default;
+    explicit DesktopLayout(std::vector<OutputInfo> outputs);
+
+    const std::vector<OutputInfo>& Outputs() const { return outputs_; }
+    int Count() const { return static_cast<int>(outputs_.size()); }
+    bool Empty() const { return outputs_.empty(); }
+
+    // Bounding box of all outputs, in desktop coordinates
+    Rect Bounds() const { return bounds_; }
+    int Width() const { return bounds_.width; }
+    int Height() const { return bounds_.height; }
+
+    // Position in Outputs() of the output with this index, -1 if none
+    int Find(int index) const;
+
+    // Where an output (by position in Outputs()) sits in the composite
+    Rect Placement(int position) const;
+
+    // Output position under a composite pixel; -1 in a gap or outside
+    int OutputAt(int x, int y) const;
+
+    // Composite pixel <-> desktop coordinates
+    void CompositeToDesktop(int& x, int& y) const { x += bounds_.x; y += bounds_.y; }
+    void DesktopToComposite(int& x, int& y) const { x -= bounds_.x; y -= bounds_.y; }
+
+    // Composite pixel <-> pixel of one output (by position). False if the
+    // point is not on that output (ToOutput: not on any output).
+    bool ToOutput(int x, int y, int& position, int& outputX, int& outputY) const;
+    bool FromOutput(int position, int outputX, int outputY, int& x, int& y) const;
+
+private:
+    std::vector<OutputInfo> outputs_;
+    Rect bounds_ = {0, 0, 0, 0};
+};
@@ -0,0 +1,393 @@
+#include "dxgi_frame_source.h"
+#include <d3d10.h>
+
+DxgiFrameSource::DxgiFrameSource(int adapterIndex, int outputIndex)
+    : adapterIndex_(adapterIndex)
+    , outputIndex_(outputIndex)
+    , device_(nullptr)
+    , context_(nullptr)
+    , duplication_(nullptr)
+    , stagingTexture_(nullptr)
+    , desktopTexture_(nullptr)
+    , desktopValid_(false)
+    , stagingPool_([this](int width, int height) { return CreateTexture(width, height, true); },
+                   [](ID3D11Texture2D* texture) { texture->Release(); })
+    , width_(0)
+    , height_(0)
+    , frameHeld_(false)
+    , mapped_(false)
+    , primed_(false) {
+}
+
+DxgiFrameSource::~DxgiFrameSource() {
+    std::lock_guard<std::mutex> lock(deviceMutex_);
+    ReleaseDevice();
+}
+
+void DxgiFrameSource::ReleaseDevice() {
+    if (duplication_) ReleaseFrame();
+    stagingPool_.Clear();
+    desktopValid_ = false;
+    primed_ = false;
+    if (desktopTexture_) desktopTexture_->Release();
+    if (stagingTexture_) stagingTexture_->Release();
+    if (duplication_) duplication_->Release();
+    if (context_) context_->Release();
+    if (device_) device_->Release();
+    desktopTexture_ = nullptr;
+    stagingTexture_ = nullptr;
+    duplication_ = nullptr;
+    context_ = nullptr;
+    device_ = nullptr;
+}
+
+std::vector<DxgiOutput> DxgiFrameSource::EnumerateOutputs() {
+    std::vector<DxgiOutput> outputs;
+    
+    IDXGIFactory1* factory = nullptr;
+    if (FAILED(CreateDXGIFactory1(__uuidof(IDXGIFactory1), reinterpret_cast<void**>(&factory)))) {
+        LOG_ERROR(L"Failed to create DXGI factory");
+        return outputs;
+    }
+    
+    IDXGIAdapter1* adapter = nullptr;
+    for (UINT a = 0; factory->EnumAdapters1(a, &adapter) != DXGI_ERROR_NOT_FOUND; ++a) {
+        IDXGIOutput* output = nullptr;
+        for (UINT o = 0; adapter->EnumOutputs(o, &output) != DXGI_ERROR_NOT_FOUND; ++o) {
+            DXGI_OUTPUT_DESC desc;
+            if (SUCCEEDED(output->GetDesc(&desc)) && desc.AttachedToDesktop) {
+                const RECT& r = desc.DesktopCoordinates;
+                DxgiOutput entry;
+                entry.adapter = static_cast<int>(a);
+                entry.output = static_cast<int>(o);
+                entry.info.index = static_cast<int>(outputs.size());
+                entry.info.name = WStringToString(desc.DeviceName);
+                entry.info.bounds = {r.left, r.top, r.right - r.left, r.bottom - r.top};
+                // The primary monitor is the one at the desktop origin
+                entry.info.primary = r.left == 0 && r.top == 0;
+                outputs.push_back(entry);
+            }
+            output->Release();
+        }
+        adapter->Release();
+    }
+    factory->Release();
+    return outputs;
+}
+
+bool DxgiFrameSource::Initialize() {
+    std::lock_guard<std::mutex> lock(deviceMutex_);
+    if (duplication_) {
+        return true;
+    }
+    if (!CreateDevice()) {
+        // Start from scratch on the next attempt
+        ReleaseDevice();
+        return false;
+    }
+    return true;
+}
+
+bool DxgiFrameSource::CreateDevice() {
+    IDXGIFactory1* factory = nullptr;
+    HRESULT hr = CreateDXGIFactory1(__uuidof(IDXGIFactory1), reinterpret_cast<void**>(&factory));
+    if (FAILED(hr)) {
+        LOG_ERROR(L"Failed to create DXGI factory");
+        return false;
+    }
+    
+    // Get DXGI adapter
+    IDXGIAdapter1* dxgiAdapter = nullptr;
+    hr = factory->EnumAdapters1(adapterIndex_, &dxgiAdapter);
+    factory->Release();
+    
+    if (FAILED(hr)) {
+        LOG_ERROR(L"Failed to get DXGI adapter");
+        return false;
+    }
+    
+    // Create D3D11 device on the output's adapter; duplication must run
+    // on the adapter the output is attached to
+    D3D_FEATURE_LEVEL featureLevel;
+    hr = D3D11CreateDevice(
+        dxgiAdapter,
+        D3D_DRIVER_TYPE_UNKNOWN,
+        nullptr,
+        0,
+        nullptr,
+        0,
+        D3D11_SDK_VERSION,
+        &device_,
+        &featureLevel,
+        &context_
+    );
+    
+    if (FAILED(hr)) {
+        dxgiAdapter->Release();
+        LOG_ERROR(L"Failed to create D3D11 device");
+        return false;
+    }
+    
+    // Region reads use the immediate context from callers' threads while
+    // the capture thread owns the frame loop; let D3D serialize them
+    ID3D10Multithread* multithread = nullptr;
+    if (SUCCEEDED(context_->QueryInterface(__uuidof(ID3D10Multithread), reinterpret_cast<void**>(&multithread)))) {
+        multithread->SetMultithreadProtected(TRUE);
+        multithread->Release();
+    }
+    
+    // Get output (monitor)
+    IDXGIOutput* dxgiOutput = nullptr;
+    hr = dxgiAdapter->EnumOutputs(outputIndex_, &dxgiOutput);
+    dxgiAdapter->Release();
+    
+    if (FAILED(hr)) {
+        LOG_ERROR(L"Failed to enumerate outputs");
+        return false;
+    }
+    
+    // Get output1 interface for desktop duplication
+    IDXGIOutput1* dxgiOutput1 = nullptr;
+    hr = dxgiOutput->QueryInterface(__uuidof(IDXGIOutput1), reinterpret_cast<void**>(&dxgiOutput1));
+    dxgiOutput->Release();
+    
+    if (FAILED(hr)) {
+        LOG_ERROR(L"Failed to get IDXGIOutput1");
+        return false;
+    }
+    
+    // Get screen dimensions
+    DXGI_OUTPUT_DESC outputDesc;
+    dxgiOutput1->GetDesc(&outputDesc);
+    width_ = outputDesc.DesktopCoordinates.right - outputDesc.DesktopCoordinates.left;
+    height_ = outputDesc.DesktopCoordinates.bottom - outputDesc.DesktopCoordinates.top;
+    
+    // Create desktop duplication
+    hr = dxgiOutput1->DuplicateOutput(device_, &duplication_);
+    dxgiOutput1->Release();
+    
+    if (FAILED(hr)) {
+        LOG_ERROR(L"Failed to create desktop duplication");
+        return false;
+    }
+    
+    // Create staging texture
+    stagingTexture_ = CreateTexture(width_, height_, true);
+    if (!stagingTexture_) {
+        return false;
+    }
+    
+    // GPU copy of the desktop for region reads
+    desktopTexture_ = CreateTexture(width_, height_, false);
+    if (!desktopTexture_) {
+        return false;
+    }
+    
+    return true;
+}
+
+ID3D11Texture2D* DxgiFrameSource::CreateTexture(int width, int height, bool staging) {
+    D3D11_TEXTURE2D_DESC desc = {};
+    desc.Width = width;
+    desc.Height = height;
+    desc.MipLevels = 1;
+    desc.ArraySize = 1;
+    desc.Format = DXGI_FORMAT_B8G8R8A8_UNORM;
+    desc.SampleDesc.Count = 1;
+    desc.Usage = staging ? D3D11_USAGE_STAGING : D3D11_USAGE_DEFAULT;
+    desc.CPUAccessFlags = staging ? D3D11_CPU_ACCESS_READ : 0;
+    
+    ID3D11Texture2D* texture = nullptr;
+    HRESULT hr = device_->CreateTexture2D(&desc, nullptr, &texture);
+    
+    if (FAILED(hr)) {
+        LOG_ERROR(staging ? L"Failed to create staging texture" : L"Failed to create desktop texture");
+        return nullptr;
+    }
+    
+    return texture;
+}
+
+FrameStatus DxgiFrameSource::AcquireFrame(int timeoutMs, FrameUpdate& update) {
+    if (frameHeld_) {
+        ReleaseFrame();
+    }
+
+    update = FrameUpdate();
+    if (!duplication_) {
+        // Lost, and not duplicated again yet
+        return FrameStatus::Error;
+    }
+    update.width = width_;
+    update.height = height_;
+
+    IDXGIResource* desktopResource = nullptr;
+    DXGI_OUTDUPL_FRAME_INFO frameInfo;
+    HRESULT hr = duplication_->AcquireNextFrame(static_cast<UINT>(std::max(timeoutMs, 0)),
+                                                &frameInfo, &desktopResource);
+
+    if (hr == DXGI_ERROR_WAIT_TIMEOUT) {
+        return FrameStatus::Timeout;
+    }
+
+    if (FAILED(hr)) {
+        // DXGI_ERROR_ACCESS_LOST and the like: this duplication will never
+        // deliver again. Let it go so Initialize can make a new one.
+        LOG_ERROR(L"Failed to acquire frame");
+        std::lock_guard<std::mutex> lock(deviceMutex_);
+        ReleaseDevice();
+        return FrameStatus::Error;
+    }
+    frameHeld_ = true;
+
+    // Mouse-only updates carry no new desktop image
+    if (frameInfo.LastPresentTime.QuadPart == 0) {
+        desktopResource->Release();
+        return FrameStatus::Ok;
+    }
+
+    ID3D11Texture2D* texture = nullptr;
+    hr = desktopResource->QueryInterface(__uuidof(ID3D11Texture2D), reinterpret_cast<void**>(&texture));
+    desktopResource->Release();
+
+    if (FAILED(hr)) {
+        LOG_ERROR(L"Failed to get texture from resource");
+        ReleaseFrame();
+        return FrameStatus::Error;
+    }
+
+    // Copy only what changed into the staging texture. Moved regions are
+    // replayed on the CPU copy, so they need no GPU readback at all.
+    if (primed_ && ReadMetadata(frameInfo, update)) {
+        for (const auto& rect : update.dirty) {
+            D3D11_BOX box = {
+                static_cast<UINT>(rect.x), static_cast<UINT>(rect.y), 0,
+                static_cast<UINT>(rect.x + rect.width), static_cast<UINT>(rect.y + rect.height), 1
+            };
+            context_->CopySubresourceRegion(stagingTexture_, 0, rect.x, rect.y, 0, texture, 0, &box);
+        }
+    } else {
+        context_->CopyResource(stagingTexture_, texture);
+        update.full = true;
+        update.moves.clear();
+        update.dirty.clear();
+        primed_ = true;
+    }
+    
+    // Keep the whole image on the GPU for region reads; a copy within
+    // video memory, nothing is read back
+    context_->CopyResource(desktopTexture_, texture);
+    desktopValid_ = true;
+    texture->Release();
+
+    if (update.full || !update.dirty.empty()) {
+        D3D11_MAPPED_SUBRESOURCE mapped;
+        hr = context_->Map(stagingTexture_, 0, D3D11_MAP_READ, 0, &mapped);
+
+        if (FAILED(hr)) {
+            LOG_ERROR(L"Failed to map staging texture");
+            ReleaseFrame();
+            return FrameStatus::Error;
+        }
+        mapped_ = true;
+        update.pixels = static_cast<const uint8_t*>(mapped.pData);
+        update.pitch = mapped.RowPitch;
+    }
+
+    return FrameStatus::Ok;
+}
+
+void DxgiFrameSource::ReleaseFrame() {
+    if (mapped_) {
+        context_->Unmap(stagingTexture_, 0);
+        mapped_ = false;
+    }
+    if (frameHeld_) {
+        duplication_->ReleaseFrame();
+        frameHeld_ = false;
+    }
+}
+
+bool DxgiFrameSource::ReadRegion(Rect& region, std::vector<uint8_t>& pixels) {
+    std::lock_guard<std::mutex> lock(deviceMutex_);
+    int left = std::max(region.x, 0);
+    int top = std::max(region.y, 0);
+    int right = std::min(region.x + region.width, width_);
+    int bottom = std::min(region.y + region.height, height_);
+    if (right <= left || bottom <= top || !desktopValid_) {
+        return false;
+    }
+    region = {left, top, right - left, bottom - top};
+    
+    int poolWidth = (region.width + kStagingGranularity - 1) / kStagingGranularity * kStagingGranularity;
+    int poolHeight = (region.height + kStagingGranularity - 1) / kStagingGranularity * kStagingGranularity;
+    ID3D11Texture2D* staging = stagingPool_.Acquire(poolWidth, poolHeight);
+    if (!staging) {
+        return false;
+    }
+    
+    D3D11_BOX box = {
+        static_cast<UINT>(left), static_cast<UINT>(top), 0,
+        static_cast<UINT>(right), static_cast<UINT>(bottom), 1
+    };
+    context_->CopySubresourceRegion(staging, 0, 0, 0, 0, desktopTexture_, 0, &box);
+    
+    D3D11_MAPPED_SUBRESOURCE mapped;
+    HRESULT hr = context_->Map(staging, 0, D3D11_MAP_READ, 0, &mapped);
+    if (FAILED(hr)) {
+        LOG_ERROR(L"Failed to map region staging texture");
+        stagingPool_.Release(poolWidth, poolHeight, staging);
+        return false;
+    }
+    
+    size_t rowBytes = static_cast<size_t>(region.width) * 4;
+    pixels.resize(rowBytes * region.height);
+    const uint8_t* src = static_cast<const uint8_t*>(mapped.pData);
+    for (int row = 0; row < region.height; ++row) {
+        memcpy(pixels.data() + rowBytes * row, src + static_cast<size_t>(row) * mapped.RowPitch, rowBytes);
+    }
+    
+    context_->Unmap(staging, 0);
+    stagingPool_.Release(poolWidth, poolHeight, staging);
+    return true;
+}
+
+bool DxgiFrameSource::ReadMetadata(const DXGI_OUTDUPL_FRAME_INFO& frameInfo, FrameUpdate& update) {
+    if (frameInfo.TotalMetadataBufferSize == 0) {
+        return false;
+    }
+
+    // Move rects first, dirty rects after them in the same buffer
+    UINT bufferSize = frameInfo.TotalMetadataBufferSize;
+    if (metadata_.size() < bufferSize) {
+        metadata_.resize(bufferSize);
+    }
+
+    UINT moveBytes = 0;
+    auto* moves = reinterpret_cast<DXGI_OUTDUPL_MOVE_RECT*>(metadata_.data());
+    if (FAILED(duplication_->GetFrameMoveRects(bufferSize, moves, &moveBytes))) {
+        return false;
+    }
+
+    UINT dirtyBytes = 0;
+    auto* dirty = reinterpret_cast<RECT*>(metadata_.data() + moveBytes);
+    if (FAILED(duplication_->GetFrameDirtyRects(bufferSize - moveBytes, dirty, &dirtyBytes))) {
+        return false;
+    }
+
+    size_t moveCount = moveBytes / sizeof(DXGI_OUTDUPL_MOVE_RECT);
+    update.moves.reserve(moveCount);
+    for (size_t i = 0; i < moveCount; ++i) {
+        const RECT& d = moves[i].DestinationRect;
+        update.moves.push_back({moves[i].SourcePoint.x, moves[i].SourcePoint.y,
+                                {d.left, d.top, d.right - d.left, d.bottom - d.top}});
+    }
+
+    size_t dirtyCount = dirtyBytes / sizeof(RECT);
+    update.dirty.reserve(dirtyCount);
+    for (size_t i = 0; i < dirtyCount; ++i) {
+        const RECT& d = dirty[i];
+        update.dirty.push_back({d.left, d.top, d.right - d.left, d.bottom - d.top});
+    }
+    return true;
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include "common.h"
+#include "desktop_layout.h"
+#include "frame_source.h"
+#include "size_pool.h"
+#include <atomic>
+#include <mutex>
+#include <d3d11.h>
+#include <dxgi1_2.h>
+
+// An output that can be duplicated: its adapter/output indices for
+// DxgiFrameSource and where it sits on the desktop
+struct DxgiOutput {
+    int adapter;
+    int output;
+    OutputInfo info;
+};
+
+/**
+ * DXGI Frame Source
+ *
+ * Desktop Duplication API capture of one output, on its own D3D device
+ * so several outputs can be captured in parallel. Each frame's
+ * dirty and move rects come from DXGI_OUTDUPL_FRAME_INFO metadata; only
+ * dirty rects are copied from the GPU into the persistent staging
+ * texture and read back, and moves are replayed on the CPU copy.
+ *
+ * Region reads copy a box out of a GPU-side copy of the last frame into
+ * a staging texture sized to the region (pooled by size), so only the
+ * region crosses the bus. The device is multithread-protected for them.
+ *
+ * A duplication dies on a desktop switch (UAC prompt, lock screen) or a
+ * mode change: AcquireFrame then releases the device and returns Error,
+ * and Initialize duplicates the output afresh, at its new size if the
+ * mode changed.
+ */
+class DxgiFrameSource : public FrameSource {
+public:
+    DxgiFrameSource(int adapterIndex = 0, int outputIndex = 0);
+    ~DxgiFrameSource() override;
+    
+    // Every output attached to the desktop, across all adapters
+    static std::vector<DxgiOutput> EnumerateOutputs();
+
+    bool Initialize() override;
+    int Width() const override { return width_; }
+    int Height() const override { return height_; }
+    FrameStatus AcquireFrame(int timeoutMs, FrameUpdate& update) override;
+    void ReleaseFrame() override;
+    bool ReadRegion(Rect& region, std::vector<uint8_t>& pixels) override;
+
+private:
+    int adapterIndex_;
+    int outputIndex_;
+    
+    // Held while the device is created or released, and by region reads
+    // from other threads, which must not see it half torn down
+    std::mutex deviceMutex_;
+
+    ID3D11Device* device_;
+    ID3D11DeviceContext* context_;
+    IDXGIOutputDuplication* duplication_;
+
+    // Mirrors the desktop in the dirty rects of every frame read so far
+    ID3D11Texture2D* stagingTexture_;
+    
+    // GPU-side copy of the last desktop image, the source of region reads.
+    // The duplication's own surface is only valid while a frame is held.
+    ID3D11Texture2D* desktopTexture_;
+    std::atomic<bool> desktopValid_;
+    
+    // Region-sized staging textures. Sizes are rounded up to this many
+    // pixels so nearby region sizes share a texture.
+    static constexpr int kStagingGranularity = 64;
+    SizePool<ID3D11Texture2D*> stagingPool_;
+
+    int width_;
+    int height_;
+
+    bool frameHeld_;    // AcquireNextFrame succeeded, ReleaseFrame pending
+    bool mapped_;       // staging texture mapped for the held frame
+    bool primed_;       // staging holds a full frame; later frames may be partial
+
+    // Reused buffer for move/dirty rect metadata
+    std::vector<byte> metadata_;
+
+    // Create the device, duplication and textures; false (with whatever
+    // was created left for ReleaseDevice) on failure. Under deviceMutex_.
+    bool CreateDevice();
+
+    // Release everything Initialize created. Under deviceMutex_.
+    void ReleaseDevice();
+
+    // BGRA texture; staging ones are CPU-readable. Null on failure.
+    ID3D11Texture2D* CreateTexture(int width, int height, bool staging);
+
+    // Fill update.moves/update.dirty from the held frame. False if the
+    // metadata is unavailable and the whole frame must be read.
+    bool ReadMetadata(const DXGI_OUTDUPL_FRAME_INFO& frameInfo, FrameUpdate& update);
+};
@@ -0,0 +1,140 @@
+#include "encode_cache.h"
+#include "hash.h"
+#include <cstring>
+#include <utility>
+
+namespace {
+
+// 64-bit hash of a view's rows (not the padding between them). Four
+// independent lanes of 8-byte words keep the multiplies from waiting on
+// each other, so a desktop hashes at several GB/s.
+uint64_t HashRows(const FrameView& view) {
+    uint64_t lanes[4] = {kHashSeed, 0x84222325cbf29ce4ULL,
+                         0x9E3779B97F4A7C15ULL, 0xFF51AFD7ED558CCDULL};
+    size_t rowBytes = view.RowBytes();
+    for (int y = 0; y < view.Height(); ++y) {
+        const uint8_t* p = view.Row(y);
+        size_t i = 0;
+        for (; i + 32 <= rowBytes; i += 32) {
+            uint64_t words[4];
+            std::memcpy(words, p + i, 32);
+            for (int k = 0; k < 4; ++k) {
+                lanes[k] = HashMix(lanes[k], words[k]);
+            }
+        }
+        // Rows are whole pixels, so what is left comes in 4-byte steps
+        for (; i < rowBytes; i += 4) {
+            uint32_t pixel;
+            std::memcpy(&pixel, p + i, 4);
+            lanes[0] = HashMix(lanes[0], pixel);
+        }
+    }
+
+    uint64_t h = (static_cast<uint64_t>(view.Width()) << 32) | static_cast<uint32_t>(view.Height());
+    for (uint64_t lane : lanes) {
+        h = HashMix(h, lane);
+    }
+    return HashFinish(h);
+}
+
+size_t EntryBytes(const CachedEncoding& encoding) {
+    return encoding.image.bytes.size() + encoding.base64.size();
+}
+
+}  // namespace
+
+bool EncodeCache::Key::operator==(const Key& other) const {
+    return content == other.content && width == other.width && height == other.height &&
+           policy.format == other.policy.format && policy.quality == other.policy.quality &&
+           policy.maxBytes == other.policy.maxBytes && policy.maxPixels == other.policy.maxPixels &&
+           policy.maxEdge == other.policy.maxEdge && base64 == other.base64;
+}
+
+EncodeCache::EncodeCache(size_t maxEntries, size_t maxBytes)
+    : maxEntries_(maxEntries), maxBytes_(maxBytes) {
+}
+
+uint64_t EncodeCache::ContentHash(const FrameView& view, uint64_t generation) {
+    if (generation != 0) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const auto& hashed : hashed_) {
+            if (hashed.generation == generation && hashed.data == view.Data() &&
+                hashed.width == view.Width() && hashed.height == view.Height() &&
+                hashed.stride == view.Stride()) {
+                ++stats_.hashesSkipped;
+                return hashed.hash;
+            }
+        }
+    }
+
+    uint64_t hash = HashRows(view);
+    if (generation != 0) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        hashed_[nextHashed_] = {generation, view.Data(), view.Width(), view.Height(), view.Stride(), hash};
+        nextHashed_ = (nextHashed_ + 1) % hashed_.size();
+    }
+    return hash;
+}
+
+std::shared_ptr<const CachedEncoding> EncodeCache::Find(const Key& key) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++stats_.lookups;
+    for (auto it = slots_.begin(); it != slots_.end(); ++it) {
+        if (it->key == key) {
+            slots_.splice(slots_.begin(), slots_, it);
+            const CachedEncoding& encoding = *it->encoding;
+            ++stats_.hits;
+            stats_.bytesSaved += EntryBytes(encoding);
+            stats_.msSaved += encoding.image.scaleMs + encoding.image.encodeMs;
+            return it->encoding;
+        }
+    }
+    return nullptr;
+}
+
+void EncodeCache::Insert(const Key& key, std::shared_ptr<const CachedEncoding> encoding) {
+    if (!encoding) {
+        return;
+    }
+    size_t bytes = EntryBytes(*encoding);
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto it = slots_.begin(); it != slots_.end(); ++it) {
+        if (it->key == key) {
+            bytes_ -= it->bytes;
+            slots_.erase(it);
+            break;
+        }
+    }
+    slots_.push_front({key, std::move(encoding), bytes});
+    bytes_ += bytes;
+    EvictLocked();
+}
+
+void EncodeCache::ChargeCopy(double ms) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.msSaved -= ms;
+}
+
+void EncodeCache::Clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    slots_.clear();
+    bytes_ = 0;
+    hashed_ = {};
+}
+
+EncodeCache::Stats EncodeCache::GetStats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Stats stats = stats_;
+    stats.entries = slots_.size();
+    stats.bytes = bytes_;
+    return stats;
+}
+
+void EncodeCache::EvictLocked() {
+    // The newest entry stays even if it alone is over the byte limit
+    while (slots_.size() > 1 && (slots_.size() > maxEntries_ || bytes_ > maxBytes_)) {
+        bytes_ -= slots_.back().bytes;
+        slots_.pop_back();
+        ++stats_.evictions;
+    }
+}
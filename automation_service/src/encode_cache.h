@@ -0,0 +1,118 @@
+#pragma once
+
+#include "frame_view.h"
+#include "image_encoder.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+
+// An encoding shared by every caller that asks for the same pixels under
+// the same policy
+struct CachedEncoding {
+    EncodedImage image;
+    std::string base64;     // of image.bytes; empty unless it was asked for
+};
+
+/**
+ * Encode Cache
+ *
+ * The last few screenshot encodings, so asking again for a desktop that
+ * has not changed costs a lookup instead of a downscale, an encode and
+ * a base64 pass. Entries are keyed by what the encoding depends on: the
+ * pixels (a hash of the view's rows), their size, the EncodePolicy and
+ * whether base64 text is kept with the bytes.
+ *
+ * Hashing a whole desktop takes about a millisecond, and even that is
+ * skipped when the same region of the same frame generation was hashed
+ * before: a published frame never changes, so its generation and the
+ * view's place in it stand for its pixels.
+ *
+ * Least recently used entries are dropped beyond maxEntries or maxBytes.
+ * Two callers missing on the same key at once both encode; the request
+ * layer already coalesces identical requests.
+ *
+ * Platform-neutral and thread-safe.
+ */
+class EncodeCache {
+public:
+    // What an encoding depends on
+    struct Key {
+        uint64_t content = 0;   // see ContentHash
+        int width = 0;
+        int height = 0;
+        EncodePolicy policy;
+        bool base64 = false;
+
+        bool operator==(const Key& other) const;
+    };
+
+    explicit EncodeCache(size_t maxEntries = 8, size_t maxBytes = 64 * 1024 * 1024);
+
+    EncodeCache(const EncodeCache&) = delete;
+    EncodeCache& operator=(const EncodeCache&) = delete;
+
+    // Hash of a view's pixels. generation is that of the frame the view
+    // belongs to (0 if it is not a published frame); a view of the same
+    // generation and position as a recent one reuses its hash.
+    uint64_t ContentHash(const FrameView& view, uint64_t generation);
+
+    // Cached encoding for key, or null. Counts the lookup.
+    std::shared_ptr<const CachedEncoding> Find(const Key& key);
+
+    // Cache an encoding, replacing any under the same key
+    void Insert(const Key& key, std::shared_ptr<const CachedEncoding> encoding);
+
+    // Time a caller spent copying a hit's bytes out (into a response that
+    // must own them); it comes off msSaved
+    void ChargeCopy(double ms);
+
+    // Drop every entry (the counters are kept)
+    void Clear();
+
+    struct Stats {
+        uint64_t lookups;       // Find calls
+        uint64_t hits;          // ... answered from the cache
+        uint64_t hashesSkipped; // ContentHash calls answered by generation
+        uint64_t evictions;     // entries dropped to stay within the limits
+        uint64_t bytesSaved;    // encoded bytes (and base64 text) served from the cache
+        double msSaved;         // scale and encode time those hits would have cost,
+                                // less the time spent copying them out
+        size_t entries;
+        size_t bytes;           // held by the entries
+    };
+    Stats GetStats() const;
+
+private:
+    struct Slot {
+        Key key;
+        std::shared_ptr<const CachedEncoding> encoding;
+        size_t bytes = 0;
+    };
+
+    // A hashed view: its frame generation and where its pixels are
+    struct Hashed {
+        uint64_t generation = 0;
+        const uint8_t* data = nullptr;
+        int width = 0;
+        int height = 0;
+        size_t stride = 0;
+        uint64_t hash = 0;
+    };
+
+    size_t maxEntries_;
+    size_t maxBytes_;
+
+    mutable std::mutex mutex_;
+    std::list<Slot> slots_;     // most recently used first
+    size_t bytes_ = 0;
+    std::array<Hashed, 8> hashed_;
+    size_t nextHashed_ = 0;
+    Stats stats_ = {};
+
+    // Called under mutex_
+    void EvictLocked();
+};
@@ -0,0 +1,200 @@
+#include "frame_buffer.h"
+#include <algorithm>
+#include <cstring>
+
+FrameBuffer::FrameBuffer(int tileSize)
+    : tileSize_(std::max(tileSize, 8)) {
+}
+
+void FrameBuffer::Resize(int width, int height) {
+    width_ = width;
+    height_ = height;
+    pixels_.assign(static_cast<size_t>(width) * height * 4, 0);
+    tilesX_ = (width + tileSize_ - 1) / tileSize_;
+    tilesY_ = (height + tileSize_ - 1) / tileSize_;
+    tileGeneration_.assign(static_cast<size_t>(tilesX_) * tilesY_, 0);
+}
+
+bool FrameBuffer::Clip(Rect& rect) const {
+    return Clip(rect, {0, 0, width_, height_});
+}
+
+bool FrameBuffer::Clip(Rect& rect, const Rect& bounds) {
+    int left = std::max(rect.x, bounds.x);
+    int top = std::max(rect.y, bounds.y);
+    int right = std::min(rect.x + rect.width, bounds.x + bounds.width);
+    int bottom = std::min(rect.y + rect.height, bounds.y + bounds.height);
+    if (right <= left || bottom <= top) {
+        return false;
+    }
+    rect = {left, top, right - left, bottom - top};
+    return true;
+}
+
+bool FrameBuffer::Apply(const FrameUpdate& update) {
+    if (update.width <= 0 || update.height <= 0) {
+        return false;
+    }
+
+    bool full = update.full;
+    if (update.width != width_ || update.height != height_) {
+        Resize(update.width, update.height);
+        full = true;
+    }
+    return ApplyIn(update, {0, 0, width_, height_}, full);
+}
+
+void FrameBuffer::Reset(int width, int height) {
+    Resize(width, height);
+    ++generation_;
+    std::fill(tileGeneration_.begin(), tileGeneration_.end(), generation_);
+}
+
+bool FrameBuffer::ApplyAt(const FrameUpdate& update, int x, int y) {
+    if (update.width <= 0 || update.height <= 0) {
+        return false;
+    }
+    return ApplyIn(update, {x, y, update.width, update.height}, update.full);
+}
+
+bool FrameBuffer::ApplyIn(const FrameUpdate& update, const Rect& area, bool full) {
+    // Marks the tiles under a source rect once it is placed in the area
+    auto mark = [&](const Rect& rect) {
+        Rect placed = {rect.x + area.x, rect.y + area.y, rect.width, rect.height};
+        if (Clip(placed, area)) MarkTiles(placed);
+    };
+
+    if (full) {
+        if (!update.pixels) return false;
+        ++generation_;
+        CopyRect(update, {0, 0, update.width, update.height}, area);
+        mark({0, 0, update.width, update.height});
+        return true;
+    }
+
+    if (update.moves.empty() && update.dirty.empty()) {
+        return false;
+    }
+
+    ++generation_;
+
+    // Moves shift pixels already in the buffer; they must land before
+    // dirty rects, which may overwrite parts of their destinations
+    for (const auto& move : update.moves) {
+        MoveRegion(move, area);
+        mark(move.dest);
+    }
+
+    if (update.pixels) {
+        for (const auto& rect : update.dirty) {
+            CopyRect(update, rect, area);
+            mark(rect);
+        }
+    }
+    return true;
+}
+
+void FrameBuffer::CopyRect(const FrameUpdate& update, const Rect& rect, const Rect& area) {
+    // Destination in buffer coordinates, kept inside the source's area
+    Rect dest = {rect.x + area.x, rect.y + area.y, rect.width, rect.height};
+    if (!Clip(dest, area) || !Clip(dest)) return;
+    int srcX = dest.x - area.x;
+    int srcY = dest.y - area.y;
+
+    size_t rowBytes = static_cast<size_t>(dest.width) * 4;
+    const uint8_t* src = update.pixels + static_cast<size_t>(srcY) * update.pitch + static_cast<size_t>(srcX) * 4;
+    uint8_t* dst = pixels_.data() + static_cast<size_t>(dest.y) * Stride() + static_cast<size_t>(dest.x) * 4;
+
+    // A full-width rect with matching pitch is one contiguous block
+    if (srcX == 0 && dest.x == 0 && dest.width == width_ && update.pitch == Stride()) {
+        std::memcpy(dst, src, rowBytes * dest.height);
+        return;
+    }
+    for (int row = 0; row < dest.height; ++row) {
+        std::memcpy(dst, src, rowBytes);
+        src += update.pitch;
+        dst += Stride();
+    }
+}
+
+void FrameBuffer::MoveRegion(const MoveRect& move, const Rect& area) {
+    // Clip the destination, then shift the source by the same amount
+    Rect target = {move.dest.x + area.x, move.dest.y + area.y, move.dest.width, move.dest.height};
+    Rect dest = target;
+    if (!Clip(dest, area) || !Clip(dest)) return;
+    int srcX = move.sourceX + area.x + (dest.x - target.x);
+    int srcY = move.sourceY + area.y + (dest.y - target.y);
+
+    // Keep only the part whose source also lies inside the area
+    Rect src = {srcX, srcY, dest.width, dest.height};
+    if (!Clip(src, area) || !Clip(src)) return;
+    dest = {dest.x + (src.x - srcX), dest.y + (src.y - srcY), src.width, src.height};
+
+    size_t rowBytes = static_cast<size_t>(src.width) * 4;
+    size_t stride = Stride();
+    auto rowAt = [&](int x, int y) { return pixels_.data() + static_cast<size_t>(y) * stride + static_cast<size_t>(x) * 4; };
+
+    // Walk rows away from the overlap so no source row is overwritten
+    // before it is read; memmove covers horizontal overlap within a row
+    if (dest.y > src.y) {
+        for (int row = src.height - 1; row >= 0; --row) {
+            std::memmove(rowAt(dest.x, dest.y + row), rowAt(src.x, src.y + row), rowBytes);
+        }
+    } else {
+        for (int row = 0; row < src.height; ++row) {
+            std::memmove(rowAt(dest.x, dest.y + row), rowAt(src.x, src.y + row), rowBytes);
+        }
+    }
+}
+
+void FrameBuffer::MarkTiles(const Rect& rect) {
+    Rect r = rect;
+    if (!Clip(r)) return;
+
+    int tx0 = r.x / tileSize_;
+    int ty0 = r.y / tileSize_;
+    int tx1 = (r.x + r.width - 1) / tileSize_;
+    int ty1 = (r.y + r.height - 1) / tileSize_;
+    for (int ty = ty0; ty <= ty1; ++ty) {
+        for (int tx = tx0; tx <= tx1; ++tx) {
+            tileGeneration_[static_cast<size_t>(ty) * tilesX_ + tx] = generation_;
+        }
+    }
+}
+
+Rect FrameBuffer::TileRect(int index) const {
+    int tx = index % tilesX_;
+    int ty = index / tilesX_;
+    Rect r = {tx * tileSize_, ty * tileSize_, tileSize_, tileSize_};
+    Clip(r);
+    return r;
+}
+
+std::vector<int> FrameBuffer::ChangedTiles(uint64_t sinceGeneration) const {
+    std::vector<int> changed;
+    for (int i = 0; i < TileCount(); ++i) {
+        if (tileGeneration_[i] > sinceGeneration) {
+            changed.push_back(i);
+        }
+    }
+    return changed;
+}
+
+std::vector<Rect> FrameBuffer::ChangedRegions(uint64_t sinceGeneration) const {
+    std::vector<Rect> regions;
+    for (int ty = 0; ty < tilesY_; ++ty) {
+        int runStart = -1;
+        for (int tx = 0; tx <= tilesX_; ++tx) {
+            bool changed = tx < tilesX_ && tileGeneration_[static_cast<size_t>(ty) * tilesX_ + tx] > sinceGeneration;
+            if (changed && runStart < 0) {
+                runStart = tx;
+            } else if (!changed && runStart >= 0) {
+                Rect r = {runStart * tileSize_, ty * tileSize_, (tx - runStart) * tileSize_, tileSize_};
+                Clip(r);
+                regions.push_back(r);
+                runStart = -1;
+            }
+        }
+    }
+    return regions;
+}
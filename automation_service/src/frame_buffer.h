@@ -0,0 +1,106 @@
+#pragma once
+
+#include "geometry.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// A region that moved on screen: the pixels now at dest were at
+// (sourceX, sourceY) in the previous frame
+struct MoveRect {
+    int sourceX;
+    int sourceY;
+    Rect dest;
+};
+
+// What changed between two frames, as reported by a FrameSource.
+// pixels points at the whole current frame (BGRA, pitch bytes per row),
+// but only the dirty rects (or everything, if full) are read from it.
+struct FrameUpdate {
+    int width = 0;
+    int height = 0;
+    const uint8_t* pixels = nullptr;
+    size_t pitch = 0;
+    bool full = false;              // no usable change info: take the whole frame
+    std::vector<MoveRect> moves;    // applied before dirty rects, in order
+    std::vector<Rect> dirty;
+};
+
+/**
+ * Frame Buffer
+ *
+ * CPU copy of the desktop, kept current by folding in only the parts of
+ * each frame that changed. The buffer is split into square tiles, each
+ * stamped with the generation of the last frame that touched it, so
+ * consumers can ask what changed since a generation they already have
+ * instead of diffing whole frames.
+ *
+ * A buffer can also be a composite of several sources (one per monitor):
+ * size it with Reset, then fold each source's frames in at its placement
+ * with ApplyAt.
+ *
+ * Platform-neutral: a FrameSource (DXGI on Windows) produces the updates.
+ * Not thread-safe; the owner serializes access.
+ */
+class FrameBuffer {
+public:
+    static constexpr int kDefaultTileSize = 64;
+
+    explicit FrameBuffer(int tileSize = kDefaultTileSize);
+
+    // Fold one frame's changes in. A size change or update.full takes the
+    // whole frame. Returns true (and bumps the generation) if anything
+    // changed.
+    bool Apply(const FrameUpdate& update);
+
+    // Size the buffer for a composite and clear it (bumps the generation)
+    void Reset(int width, int height);
+
+    // Fold one source's frame in with its top-left at (x, y). The buffer
+    // keeps its size; whatever falls outside it is dropped, and moves
+    // never read from outside the source's own area.
+    bool ApplyAt(const FrameUpdate& update, int x, int y);
+
+    // Bumped by every Apply that changes pixels; 0 until the first frame
+    uint64_t Generation() const { return generation_; }
+
+    bool Empty() const { return pixels_.empty(); }
+    int Width() const { return width_; }
+    int Height() const { return height_; }
+    size_t Stride() const { return static_cast<size_t>(width_) * 4; }
+    const uint8_t* Data() const { return pixels_.data(); }
+    const std::vector<uint8_t>& Pixels() const { return pixels_; }
+
+    // Tile grid
+    int TileSize() const { return tileSize_; }
+    int TilesX() const { return tilesX_; }
+    int TilesY() const { return tilesY_; }
+    int TileCount() const { return tilesX_ * tilesY_; }
+    uint64_t TileGeneration(int index) const { return tileGeneration_[index]; }
+    Rect TileRect(int index) const;   // clipped to the frame
+
+    // Indices of tiles changed after sinceGeneration
+    std::vector<int> ChangedTiles(uint64_t sinceGeneration) const;
+
+    // Same, as rectangles: runs of adjacent changed tiles in a tile row
+    // are merged. Everything if sinceGeneration predates a resize.
+    std::vector<Rect> ChangedRegions(uint64_t sinceGeneration) const;
+
+private:
+    int tileSize_;
+    int width_ = 0;
+    int height_ = 0;
+    int tilesX_ = 0;
+    int tilesY_ = 0;
+    uint64_t generation_ = 0;
+    std::vector<uint8_t> pixels_;
+    std::vector<uint64_t> tileGeneration_;
+
+    void Resize(int width, int height);
+    bool Clip(Rect& rect) const;
+    static bool Clip(Rect& rect, const Rect& bounds);
+    bool ApplyIn(const FrameUpdate& update, const Rect& area, bool full);
+    void CopyRect(const FrameUpdate& update, const Rect& rect, const Rect& area);
+    void MoveRegion(const MoveRect& move, const Rect& area);
+    void MarkTiles(const Rect& rect);
+};
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "frame_buffer.h"
+
+enum class FrameStatus {
+    Ok,        // update describes the new frame
+    Timeout,   // nothing changed within the wait
+    Error      // capture failed; Initialize again to recover a lost source
+};
+
+/**
+ * Frame Source
+ *
+ * Producer of desktop frames as incremental updates for a FrameBuffer.
+ * DxgiFrameSource is the Windows implementation and X11FrameSource the
+ * Linux one; the interface itself is platform-neutral so the buffer can
+ * be driven by a synthetic source.
+ */
+class FrameSource {
+public:
+    virtual ~FrameSource() = default;
+
+    // Start capturing. A no-op while capture works; after an Error that
+    // lost the capture it starts over, picking up a new desktop size.
+    virtual bool Initialize() = 0;
+
+    // Desktop size in pixels
+    virtual int Width() const = 0;
+    virtual int Height() const = 0;
+
+    // Wait up to timeoutMs for the next frame. On Ok, update's pixels stay
+    // valid until ReleaseFrame, which must follow every Ok.
+    virtual FrameStatus AcquireFrame(int timeoutMs, FrameUpdate& update) = 0;
+    virtual void ReleaseFrame() = 0;
+
+    // Read just one region of the current desktop, straight from the
+    // source and independent of AcquireFrame: only region's pixels are
+    // transferred. region is clipped to the desktop; pixels receives it
+    // packed (width * 4 bytes per row). Safe to call from any thread
+    // while another one waits in AcquireFrame.
+    virtual bool ReadRegion(Rect& region, std::vector<uint8_t>& pixels) = 0;
+};
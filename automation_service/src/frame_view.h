@@ -0,0 +1,80 @@
+#pragma once
+
+#include "geometry.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+/**
+ * Frame View
+ *
+ * Read-only window onto BGRA pixels owned by someone else: a base
+ * pointer, a size and the owner's row stride. Cropping only moves the
+ * base pointer, so a region of a cached frame costs nothing until its
+ * rows are actually read. The view can hold a reference to the owner
+ * (e.g. a published CapturedFrame) to keep the pixels alive.
+ */
+class FrameView {
+public:
+    FrameView() = default;
+
+    FrameView(std::shared_ptr<const void> owner, const uint8_t* data,
+              int width, int height, size_t stride)
+        : owner_(std::move(owner)), data_(data), width_(width), height_(height), stride_(stride) {}
+
+    bool Empty() const { return !data_ || width_ <= 0 || height_ <= 0; }
+    int Width() const { return width_; }
+    int Height() const { return height_; }
+    size_t Stride() const { return stride_; }
+    size_t RowBytes() const { return static_cast<size_t>(width_) * 4; }
+    const uint8_t* Data() const { return data_; }
+    const uint8_t* Row(int y) const { return data_ + static_cast<size_t>(y) * stride_; }
+
+    // Rows are back to back, so the pixels are one block of
+    // RowBytes() * Height() bytes
+    bool Contiguous() const { return stride_ == RowBytes(); }
+
+    // Bytes a consumer walking Height() rows of Stride() may touch; the
+    // last row ends at its own width, not at the stride
+    size_t SpanBytes() const {
+        return Empty() ? 0 : stride_ * (height_ - 1) + RowBytes();
+    }
+
+    // Sub-rectangle in this view's coordinates, clipped to it. Shares the
+    // pixels and the owner; empty if nothing is left after clipping.
+    FrameView Crop(const Rect& region) const {
+        int left = std::max(region.x, 0);
+        int top = std::max(region.y, 0);
+        int right = std::min(region.x + region.width, width_);
+        int bottom = std::min(region.y + region.height, height_);
+        if (Empty() || right <= left || bottom <= top) {
+            return FrameView();
+        }
+        return FrameView(owner_, Row(top) + static_cast<size_t>(left) * 4,
+                         right - left, bottom - top, stride_);
+    }
+
+    // Packed copy (stride == width * 4) of just these pixels
+    std::vector<uint8_t> CopyPixels() const {
+        std::vector<uint8_t> pixels(RowBytes() * std::max(height_, 0));
+        if (Empty()) return pixels;
+        if (Contiguous()) {
+            std::memcpy(pixels.data(), data_, pixels.size());
+            return pixels;
+        }
+        for (int y = 0; y < height_; ++y) {
+            std::memcpy(pixels.data() + RowBytes() * y, Row(y), RowBytes());
+        }
+        return pixels;
+    }
+
+private:
+    std::shared_ptr<const void> owner_;
+    const uint8_t* data_ = nullptr;
+    int width_ = 0;
+    int height_ = 0;
+    size_t stride_ = 0;
+};
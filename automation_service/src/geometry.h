@@ -0,0 +1,12 @@
+#pragma once
+
+// Platform-neutral geometry shared by the capture pipeline, which keeps
+// its pixel bookkeeping free of Windows headers.
+
+// Rectangle structure
+struct Rect {
+    int x;
+    int y;
+    int width;
+    int height;
+};
@@ -0,0 +1,24 @@
+#pragma once
+
+// Platform-neutral 64-bit hashing of pixel words, shared by the encode
+// cache (whole views) and the tile delta tracker (tiles). Fast rather than
+// strong: the keys are screen contents, not anything adversarial.
+
+#include <cstdint>
+
+constexpr uint64_t kHashSeed = 0xcbf29ce484222325ULL;
+constexpr uint64_t kHashMultiplier = 0x9E3779B97F4A7C15ULL;
+
+// Fold one word into a running hash
+inline uint64_t HashMix(uint64_t h, uint64_t word) {
+    h = (h ^ word) * kHashMultiplier;
+    return h ^ (h >> 29);
+}
+
+// Spread a finished hash's bits so every input bit reaches the low ones
+inline uint64_t HashFinish(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+    return h;
+}
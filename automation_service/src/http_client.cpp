@@ -5,11 +5,40 @@
 
 #pragma comment(lib, "Winhttp.lib")
 
-std::string HttpClient::ReadResponseBody(void* hRequest) {
+void HttpClient::ApplyTimeouts(void* hRequest, int timeoutMs, const Deadline& deadline) {
+    // 0 means "no timeout" to WinHTTP, so never go below 1ms
+    DWORD timeout = static_cast<DWORD>(std::max(deadline.Clamp(timeoutMs), 1));
+    HINTERNET handle = static_cast<HINTERNET>(hRequest);
+    WinHttpSetOption(handle, WINHTTP_OPTION_CONNECT_TIMEOUT, &timeout, sizeof(timeout));
+    WinHttpSetOption(handle, WINHTTP_OPTION_SEND_TIMEOUT, &timeout, sizeof(timeout));
+    WinHttpSetOption(handle, WINHTTP_OPTION_RECEIVE_RESPONSE_TIMEOUT, &timeout, sizeof(timeout));
+    WinHttpSetOption(handle, WINHTTP_OPTION_RECEIVE_TIMEOUT, &timeout, sizeof(timeout));
+}
+
+std::string HttpClient::ReadResponseBody(void* hRequest, const CancellationToken* cancel,
+                                         const Deadline& deadline, bool* cutShort) {
     std::string body;
     DWORD bytesAvailable = 0;
-    while (WinHttpQueryDataAvailable(static_cast<HINTERNET>(hRequest), &bytesAvailable)
-           && bytesAvailable > 0) {
+    if (cutShort) *cutShort = false;
+    while (true) {
+        // A cancel may have closed the handle; never touch it after that
+        if (cancel && cancel->IsCancelled()) {
+            if (cutShort) *cutShort = true;
+            break;
+        }
+        bool queried = WinHttpQueryDataAvailable(static_cast<HINTERNET>(hRequest), &bytesAvailable) != FALSE;
+        // End of body first: a body read to the end is complete, even if
+        // the deadline passed during its last read
+        if (queried && bytesAvailable == 0) {
+            break;
+        }
+        if ((cancel && cancel->IsCancelled()) || deadline.Expired()) {
+            if (cutShort) *cutShort = true;
+            break;
+        }
+        if (!queried) {
+            break;
+        }
         std::vector<char> buf(bytesAvailable);
         DWORD bytesRead = 0;
         WinHttpReadData(static_cast<HINTERNET>(hRequest),
@@ -22,9 +51,15 @@ std::string HttpClient::ReadResponseBody(void* hRequest) {
 HttpResponse HttpClient::Post(const std::wstring& host, int port, const std::wstring& path,
                                const std::string& body,
                                const std::map<std::string, std::string>& headers,
-                               bool useHttps, int timeoutMs) {
+                               bool useHttps, int timeoutMs,
+                               CancellationToken* cancel, const Deadline& deadline) {
     HttpResponse resp = {0, "", "", false};
 
+    if (deadline.Expired()) {
+        resp.error = "Deadline exceeded";
+        return resp;
+    }
+
     HINTERNET hSession = WinHttpOpen(L"BrowserAI/1.0",
         WINHTTP_ACCESS_TYPE_NO_PROXY,
         WINHTTP_NO_PROXY_NAME, WINHTTP_NO_PROXY_BYPASS, 0);
@@ -51,11 +86,35 @@ HttpResponse HttpClient::Post(const std::wstring& host, int port, const std::wst
         return resp;
     }
 
-    // Set timeouts
-    DWORD timeout = static_cast<DWORD>(timeoutMs);
-    WinHttpSetOption(hRequest, WINHTTP_OPTION_CONNECT_TIMEOUT, &timeout, sizeof(timeout));
-    WinHttpSetOption(hRequest, WINHTTP_OPTION_SEND_TIMEOUT, &timeout, sizeof(timeout));
-    WinHttpSetOption(hRequest, WINHTTP_OPTION_RECEIVE_TIMEOUT, &timeout, sizeof(timeout));
+    ApplyTimeouts(hRequest, timeoutMs, deadline);
+
+    // Closing the request handle from the cancelling thread makes a blocked
+    // send/receive/read fail with ERROR_WINHTTP_OPERATION_CANCELLED.
+    // closedByCancel is written under the token's lock and only read after
+    // Unregister, which takes the same lock. The token reads as cancelled
+    // before the handle is closed, so every step below checks it first and
+    // bails out instead of passing on a handle a cancel has closed
+    // (Register closes it at once if the token was already cancelled).
+    bool closedByCancel = false;
+    size_t cancelId = 0;
+    if (cancel) {
+        cancelId = cancel->Register([&] {
+            WinHttpCloseHandle(hRequest);
+            closedByCancel = true;
+        });
+    }
+    auto cancelled = [&] { return cancel && cancel->IsCancelled(); };
+    auto closeAll = [&] {
+        if (cancel) cancel->Unregister(cancelId);
+        if (!closedByCancel) WinHttpCloseHandle(hRequest);
+        WinHttpCloseHandle(hConnect);
+        WinHttpCloseHandle(hSession);
+    };
+    auto cancelledResponse = [&] {
+        closeAll();
+        resp.error = "Request cancelled";
+        return resp;
+    };
 
     // Build header string
     std::wstring headerStr;
@@ -64,21 +123,38 @@ HttpResponse HttpClient::Post(const std::wstring& host, int port, const std::wst
     }
     headerStr += L"Content-Type: application/json\r\n";
 
+    if (cancelled()) {
+        return cancelledResponse();
+    }
     BOOL sent = WinHttpSendRequest(hRequest,
         headerStr.c_str(), static_cast<DWORD>(headerStr.length()),
         const_cast<char*>(body.c_str()), static_cast<DWORD>(body.size()),
         static_cast<DWORD>(body.size()), 0);
 
-    if (!sent || !WinHttpReceiveResponse(hRequest, nullptr)) {
+    // The send used part of the budget; wait for headers only as long as is left
+    BOOL received = FALSE;
+    if (sent && !deadline.Expired() && !cancelled()) {
+        ApplyTimeouts(hRequest, timeoutMs, deadline);
+        received = WinHttpReceiveResponse(hRequest, nullptr);
+    }
+
+    if (!received) {
         DWORD err = GetLastError();
-        WinHttpCloseHandle(hRequest);
-        WinHttpCloseHandle(hConnect);
-        WinHttpCloseHandle(hSession);
-        resp.error = "HTTP request failed (error " + std::to_string(err) + ")";
+        closeAll();
+        if (cancelled()) {
+            resp.error = "Request cancelled";
+        } else if (deadline.Expired()) {
+            resp.error = "Deadline exceeded";
+        } else {
+            resp.error = "HTTP request failed (error " + std::to_string(err) + ")";
+        }
         return resp;
     }
 
     // Get status code
+    if (cancelled()) {
+        return cancelledResponse();
+    }
     DWORD statusCode = 0;
     DWORD statusSize = sizeof(statusCode);
     WinHttpQueryHeaders(hRequest,
@@ -88,11 +164,24 @@ HttpResponse HttpClient::Post(const std::wstring& host, int port, const std::wst
     resp.statusCode = static_cast<int>(statusCode);
 
     // Read body
-    resp.body = ReadResponseBody(hRequest);
+    if (cancelled()) {
+        return cancelledResponse();
+    }
+    ApplyTimeouts(hRequest, timeoutMs, deadline);
+    bool cutShort = false;
+    resp.body = ReadResponseBody(hRequest, cancel, deadline, &cutShort);
 
-    WinHttpCloseHandle(hRequest);
-    WinHttpCloseHandle(hConnect);
-    WinHttpCloseHandle(hSession);
+    closeAll();
+
+    if (cancelled()) {
+        resp.error = "Request cancelled";
+        return resp;
+    }
+    if (cutShort) {
+        // Whatever arrived is incomplete
+        resp.error = "Deadline exceeded";
+        return resp;
+    }
 
     resp.success = (resp.statusCode >= 200 && resp.statusCode < 300);
     if (!resp.success && resp.error.empty()) {
@@ -1,6 +1,8 @@
 #pragma once
 
 #include "common.h"
+#include "cancellation.h"
+#include "deadline.h"
 #include <string>
 #include <map>
 
@@ -24,11 +26,18 @@ public:
     ~HttpClient() = default;
 
     // POST with JSON body and custom headers. Set useHttps=true for cloud APIs.
+    // Cancelling the token closes the request handle, aborting the call
+    // from whatever thread cancels it. timeoutMs bounds each phase
+    // (connect, send, headers, body) and is shrunk to what is left of the
+    // deadline before each one; past the deadline the call fails with
+    // "Deadline exceeded".
     HttpResponse Post(const std::wstring& host, int port, const std::wstring& path,
                       const std::string& body,
                       const std::map<std::string, std::string>& headers,
                       bool useHttps = false,
-                      int timeoutMs = 60000);
+                      int timeoutMs = 60000,
+                      CancellationToken* cancel = nullptr,
+                      const Deadline& deadline = Deadline());
 
     // GET with optional headers.
     HttpResponse Get(const std::wstring& host, int port, const std::wstring& path,
@@ -36,6 +45,12 @@ public:
                      int timeoutMs = 5000);
 
 private:
-    // Read full response body from an open request handle
-    std::string ReadResponseBody(void* hRequest);
+    // Read full response body from an open request handle. Stops early
+    // (setting *cutShort) if cancelled or past the deadline.
+    std::string ReadResponseBody(void* hRequest, const CancellationToken* cancel = nullptr,
+                                 const Deadline& deadline = Deadline(),
+                                 bool* cutShort = nullptr);
+
+    // Set the per-phase WinHTTP timeouts to timeoutMs, capped by the deadline
+    static void ApplyTimeouts(void* hRequest, int timeoutMs, const Deadline& deadline);
 };
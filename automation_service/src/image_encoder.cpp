@@ -0,0 +1,115 @@
+#include "image_encoder.h"
+#include "image_scaler.h"
+#include <algorithm>
+#include <chrono>
+
+namespace {
+
+PngEncoder::Options PngOptions(PngEncoder::Palette palette) {
+    PngEncoder::Options options;
+    options.palette = palette;
+    return options;
+}
+
+}  // namespace
+
+bool ParseImageFormat(const std::string& name, ImageFormat& format) {
+    if (name == "auto") {
+        format = ImageFormat::Auto;
+    } else if (name == "png") {
+        format = ImageFormat::Png;
+    } else if (name == "png8") {
+        format = ImageFormat::Png8;
+    } else if (name == "jpeg" || name == "jpg") {
+        format = ImageFormat::Jpeg;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+const char* ImageFormatName(ImageFormat format) {
+    switch (format) {
+        case ImageFormat::Auto: return "auto";
+        case ImageFormat::Png8: return "png8";
+        case ImageFormat::Jpeg: return "jpeg";
+        default: return "png";
+    }
+}
+
+const char* ImageMediaType(ImageFormat format) {
+    return format == ImageFormat::Jpeg ? "image/jpeg" : "image/png";
+}
+
+ImageEncoder::ImageEncoder()
+    : png_(PngOptions(PngEncoder::Palette::Exact))
+    , png8_(PngOptions(PngEncoder::Palette::Quantize)) {
+}
+
+bool ImageEncoder::Encode(const FrameView& view, const EncodePolicy& policy, EncodedImage& out) {
+    out.bytes.clear();
+    out.attempts = 0;
+    out.encodeMs = 0;
+    out.overTarget = false;
+    out.scaleMs = 0;
+    if (view.Empty()) {
+        return false;
+    }
+    out.sourceWidth = view.Width();
+    out.sourceHeight = view.Height();
+
+    // Downscale first if the policy limits the resolution
+    ImageScaler::FitWithin(view.Width(), view.Height(), policy.maxPixels, policy.maxEdge,
+                           out.width, out.height);
+    FrameView source = view;
+    PixelLease scaled;
+    if (out.width != view.Width() || out.height != view.Height()) {
+        auto scaleStart = std::chrono::steady_clock::now();
+        size_t stride = static_cast<size_t>(out.width) * 4;
+        scaled = scaled_.Acquire(stride * out.height);
+        ImageScaler::Downscale(view, out.width, out.height, scaled.Data(), stride);
+        source = FrameView(nullptr, scaled.Data(), out.width, out.height, stride);
+        out.scaleMs = std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - scaleStart).count();
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    auto fits = [&]() {
+        return policy.maxBytes == 0 || out.bytes.size() <= policy.maxBytes;
+    };
+
+    bool done = false;
+    if (policy.format == ImageFormat::Png8) {
+        png8_.Encode(source, out.bytes);
+        out.format = ImageFormat::Png8;
+        out.quality = 0;
+        ++out.attempts;
+        done = true;
+    } else if (policy.format != ImageFormat::Jpeg) {
+        png_.Encode(source, out.bytes);
+        out.format = ImageFormat::Png;
+        out.quality = 0;
+        ++out.attempts;
+        done = policy.format == ImageFormat::Png || fits();
+    }
+
+    // JPEG from the policy's quality down, until it fits
+    int quality = std::max(1, std::min(policy.quality, 100));
+    while (!done) {
+        jpeg_.Encode(source, quality, out.bytes);
+        out.format = ImageFormat::Jpeg;
+        out.quality = quality;
+        ++out.attempts;
+        if (fits() || quality <= kMinQuality) {
+            break;
+        }
+        // Far over: small steps would not get there, so go to the floor
+        quality = out.bytes.size() > 2 * policy.maxBytes ? kMinQuality
+                                                         : std::max(quality - kQualityStep, kMinQuality);
+    }
+
+    out.overTarget = !fits();
+    out.encodeMs = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start).count();
+    return !out.bytes.empty();
+}
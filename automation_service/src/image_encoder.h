@@ -0,0 +1,101 @@
+#pragma once
+
+#include "frame_view.h"
+#include "jpeg_encoder.h"
+#include "pixel_pool.h"
+#include "png_encoder.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+enum class ImageFormat {
+    Auto,       // lossless PNG unless it misses the size target, then JPEG
+    Png,        // lossless; indexed when the image has at most 256 colors
+    Png8,       // indexed PNG, median-cut to 256 colors when there are more
+    Jpeg
+};
+
+// "auto", "png", "png8" or "jpeg" (also "jpg"). False if the name is unknown.
+bool ParseImageFormat(const std::string& name, ImageFormat& format);
+const char* ImageFormatName(ImageFormat format);
+
+// MIME type for a data URL or a provider's media_type field
+const char* ImageMediaType(ImageFormat format);
+
+// How screenshots are encoded for one consumer (an AI provider)
+struct EncodePolicy {
+    ImageFormat format = ImageFormat::Png;
+    int quality = 80;           // JPEG quality to start from, 1-100
+    size_t maxBytes = 0;        // encoded size target; 0 = none
+    int64_t maxPixels = 0;      // downscale to at most this many pixels; 0 = none
+    int maxEdge = 0;            // and at most this long on the longer side; 0 = none
+};
+
+// Result of ImageEncoder::Encode
+struct EncodedImage {
+    std::vector<uint8_t> bytes;
+    ImageFormat format = ImageFormat::Png;  // what was written: Png, Png8 or Jpeg
+    int quality = 0;            // JPEG quality used; 0 for PNG
+    int attempts = 0;           // encodes run to meet the size target
+    double encodeMs = 0;        // time spent on all of them
+    bool overTarget = false;    // even the last attempt exceeds maxBytes
+    int width = 0;              // size encoded
+    int height = 0;
+    int sourceWidth = 0;        // size of the view it was scaled from
+    int sourceHeight = 0;
+    double scaleMs = 0;         // time spent downscaling, if it was
+
+    const char* MediaType() const { return ImageMediaType(format); }
+};
+
+/**
+ * Image Encoder
+ *
+ * Applies an EncodePolicy: downscales the image to the policy's
+ * resolution limits (see ImageScaler), picks between the built-in PNG
+ * and JPEG encoders and steps JPEG quality down until the image fits
+ * the policy's size target.
+ *
+ * PNG is written indexed whenever the image has at most 256 colors,
+ * which is lossless. Png8 goes further and quantizes busier images to
+ * a 256-color palette: flat UI colors and text edges stay close, while
+ * photos band. Neither steps down to JPEG.
+ *
+ * Auto sends lossless PNG when it fits, since UI text survives PNG
+ * intact and desktops with large flat areas often compress well.
+ * Otherwise JPEG is tried from the policy's quality down to
+ * kMinQuality in kQualityStep steps (straight to kMinQuality when an
+ * attempt is more than twice the target). If nothing fits, the last,
+ * smallest attempt is returned and marked overTarget rather than
+ * failing the request.
+ *
+ * Platform-neutral and thread-safe.
+ */
+class ImageEncoder {
+public:
+    ImageEncoder();
+
+    ImageEncoder(const ImageEncoder&) = delete;
+    ImageEncoder& operator=(const ImageEncoder&) = delete;
+
+    // Encode into out (its buffer is reused). False if the view is empty.
+    bool Encode(const FrameView& view, const EncodePolicy& policy, EncodedImage& out);
+
+    // The underlying encoders, for callers that always want one format
+    PngEncoder& Png() { return png_; }
+    PngEncoder& Png8() { return png8_; }
+    JpegEncoder& Jpeg() { return jpeg_; }
+
+private:
+    PngEncoder png_;            // Palette::Exact
+    PngEncoder png8_;           // Palette::Quantize
+    JpegEncoder jpeg_;
+
+    // Downscaled images, reused across calls
+    PixelPool scaled_{2};
+
+    // Quality ladder for fitting a size target
+    static constexpr int kMinQuality = 30;
+    static constexpr int kQualityStep = 15;
+};
@@ -0,0 +1,250 @@
+#include "image_scaler.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#if defined(__AVX2__)
+#define IMAGE_SCALER_AVX2 1
+#include <immintrin.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define IMAGE_SCALER_SSE2 1
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#define IMAGE_SCALER_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace {
+
+// Weights are fractions of kOne. Intermediate rows keep kRowShift
+// fractional bits (255 << 7 still fits an int16), and output pixels
+// drop the rest.
+constexpr int kWeightBits = 14;
+constexpr int kOne = 1 << kWeightBits;
+constexpr int kRowShift = 7;
+constexpr int kOutShift = 2 * kWeightBits - kRowShift;
+
+// Source pixels covered by each output pixel along one axis
+struct Taps {
+    int count = 0;                  // per output, even so taps go in pairs
+    std::vector<int> first;         // first source index of each output
+    std::vector<int16_t> weights;   // count per output, summing to kOne
+};
+
+Taps MakeTaps(int source, int target) {
+    Taps taps;
+    double scale = static_cast<double>(source) / target;
+    taps.count = static_cast<int>(std::ceil(scale)) + 1;
+    taps.count += taps.count & 1;
+    taps.first.resize(target);
+    taps.weights.assign(static_cast<size_t>(target) * taps.count, 0);
+
+    for (int i = 0; i < target; ++i) {
+        double start = i * scale;
+        double end = std::min((i + 1) * scale, static_cast<double>(source));
+        int first = static_cast<int>(start);
+        int16_t* weights = &taps.weights[static_cast<size_t>(i) * taps.count];
+        int sum = 0;
+        int largest = 0;
+        for (int t = 0; t < taps.count && first + t < source; ++t) {
+            double covered = std::min(end, first + t + 1.0) - std::max(start, first + t + 0.0);
+            if (covered <= 0) {
+                break;
+            }
+            weights[t] = static_cast<int16_t>(std::lround(covered / scale * kOne));
+            sum += weights[t];
+            if (weights[t] > weights[largest]) {
+                largest = t;
+            }
+        }
+        // Rounding must not brighten or darken the pixel
+        weights[largest] = static_cast<int16_t>(weights[largest] + kOne - sum);
+        taps.first[i] = first;
+    }
+    return taps;
+}
+
+// Blend count source rows of n bytes into one intermediate row:
+// out[i] = sum of weights[r] * rows[r][i], kRowShift fractional bits
+void BlendRows(const uint8_t* const* rows, const int* weights, int count, size_t n,
+               int32_t* acc, int16_t* out) {
+    std::fill(acc, acc + n, 0);
+    for (int r = 0; r < count; r += 2) {
+        const uint8_t* a = rows[r];
+        const uint8_t* b = r + 1 < count ? rows[r + 1] : rows[r];
+        int wa = weights[r];
+        int wb = r + 1 < count ? weights[r + 1] : 0;
+        size_t i = 0;
+#if IMAGE_SCALER_AVX2
+        // Interleaved (a, b) pairs times (wa, wb): two rows per multiply
+        const __m256i w = _mm256_set1_epi32((wb << 16) | wa);
+        for (; i + 16 <= n; i += 16) {
+            __m256i va = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i)));
+            __m256i vb = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i)));
+            // The unpacks work within 128-bit lanes: lo has bytes 0-3 and
+            // 8-11, hi has 4-7 and 12-15
+            __m256i lo = _mm256_madd_epi16(_mm256_unpacklo_epi16(va, vb), w);
+            __m256i hi = _mm256_madd_epi16(_mm256_unpackhi_epi16(va, vb), w);
+            __m256i* p = reinterpret_cast<__m256i*>(acc + i);
+            _mm256_storeu_si256(p, _mm256_add_epi32(_mm256_loadu_si256(p),
+                                                    _mm256_permute2x128_si256(lo, hi, 0x20)));
+            _mm256_storeu_si256(p + 1, _mm256_add_epi32(_mm256_loadu_si256(p + 1),
+                                                        _mm256_permute2x128_si256(lo, hi, 0x31)));
+        }
+#elif IMAGE_SCALER_SSE2
+        // Interleaved (a, b) pairs times (wa, wb): two rows per multiply
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i w = _mm_set1_epi32((wb << 16) | wa);
+        for (; i + 16 <= n; i += 16) {
+            __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+            __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+            __m128i alo = _mm_unpacklo_epi8(va, zero);
+            __m128i ahi = _mm_unpackhi_epi8(va, zero);
+            __m128i blo = _mm_unpacklo_epi8(vb, zero);
+            __m128i bhi = _mm_unpackhi_epi8(vb, zero);
+            __m128i* p = reinterpret_cast<__m128i*>(acc + i);
+            _mm_storeu_si128(p, _mm_add_epi32(_mm_loadu_si128(p), _mm_madd_epi16(_mm_unpacklo_epi16(alo, blo), w)));
+            _mm_storeu_si128(p + 1, _mm_add_epi32(_mm_loadu_si128(p + 1), _mm_madd_epi16(_mm_unpackhi_epi16(alo, blo), w)));
+            _mm_storeu_si128(p + 2, _mm_add_epi32(_mm_loadu_si128(p + 2), _mm_madd_epi16(_mm_unpacklo_epi16(ahi, bhi), w)));
+            _mm_storeu_si128(p + 3, _mm_add_epi32(_mm_loadu_si128(p + 3), _mm_madd_epi16(_mm_unpackhi_epi16(ahi, bhi), w)));
+        }
+#elif IMAGE_SCALER_NEON
+        for (; i + 8 <= n; i += 8) {
+            int16x8_t va = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(a + i)));
+            int16x8_t vb = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(b + i)));
+            int32x4_t lo = vld1q_s32(acc + i);
+            int32x4_t hi = vld1q_s32(acc + i + 4);
+            lo = vmlal_n_s16(lo, vget_low_s16(va), static_cast<int16_t>(wa));
+            lo = vmlal_n_s16(lo, vget_low_s16(vb), static_cast<int16_t>(wb));
+            hi = vmlal_n_s16(hi, vget_high_s16(va), static_cast<int16_t>(wa));
+            hi = vmlal_n_s16(hi, vget_high_s16(vb), static_cast<int16_t>(wb));
+            vst1q_s32(acc + i, lo);
+            vst1q_s32(acc + i + 4, hi);
+        }
+#endif
+        for (; i < n; ++i) {
+            acc[i] += wa * a[i] + wb * b[i];
+        }
+    }
+
+    size_t i = 0;
+#if IMAGE_SCALER_SSE2
+    const __m128i round = _mm_set1_epi32(1 << (kRowShift - 1));
+    for (; i + 8 <= n; i += 8) {
+        __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(acc + i));
+        __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(acc + i + 4));
+        lo = _mm_srai_epi32(_mm_add_epi32(lo, round), kRowShift);
+        hi = _mm_srai_epi32(_mm_add_epi32(hi, round), kRowShift);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_packs_epi32(lo, hi));
+    }
+#elif IMAGE_SCALER_NEON
+    for (; i + 8 <= n; i += 8) {
+        int16x4_t lo = vmovn_s32(vrshrq_n_s32(vld1q_s32(acc + i), kRowShift));
+        int16x4_t hi = vmovn_s32(vrshrq_n_s32(vld1q_s32(acc + i + 4), kRowShift));
+        vst1q_s16(out + i, vcombine_s16(lo, hi));
+    }
+#endif
+    for (; i < n; ++i) {
+        out[i] = static_cast<int16_t>((acc[i] + (1 << (kRowShift - 1))) >> kRowShift);
+    }
+}
+
+// Blend an intermediate row horizontally into width BGRA pixels. The row
+// is padded with taps.count zero pixels, so a pixel's taps can always be
+// read as whole pairs.
+void BlendColumns(const int16_t* row, const Taps& taps, int width, uint8_t* out) {
+    for (int x = 0; x < width; ++x) {
+        const int16_t* src = row + static_cast<size_t>(taps.first[x]) * 4;
+        const int16_t* w = &taps.weights[static_cast<size_t>(x) * taps.count];
+#if IMAGE_SCALER_SSE2
+        // Pixels t and t+1 share a load; their channels interleaved give
+        // (c[t], c[t+1]) pairs for one multiply-add with (w[t], w[t+1])
+        __m128i sum = _mm_setzero_si128();
+        for (int t = 0; t < taps.count; t += 2) {
+            __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + t * 4));
+            __m128i pairs = _mm_unpacklo_epi16(pixels, _mm_srli_si128(pixels, 8));
+            __m128i weights = _mm_set1_epi32((w[t + 1] << 16) | w[t]);
+            sum = _mm_add_epi32(sum, _mm_madd_epi16(pairs, weights));
+        }
+        sum = _mm_srai_epi32(_mm_add_epi32(sum, _mm_set1_epi32(1 << (kOutShift - 1))), kOutShift);
+        sum = _mm_packs_epi32(sum, sum);
+        int32_t pixel = _mm_cvtsi128_si32(_mm_packus_epi16(sum, sum));
+        std::memcpy(out + x * 4, &pixel, 4);
+#elif IMAGE_SCALER_NEON
+        int32x4_t sum = vdupq_n_s32(0);
+        for (int t = 0; t < taps.count; ++t) {
+            sum = vmlal_n_s16(sum, vld1_s16(src + t * 4), w[t]);
+        }
+        uint16x4_t narrow = vqmovun_s32(vrshrq_n_s32(sum, kOutShift));
+        uint32_t pixel = vget_lane_u32(vreinterpret_u32_u8(vqmovn_u16(vcombine_u16(narrow, narrow))), 0);
+        std::memcpy(out + x * 4, &pixel, 4);
+#else
+        for (int c = 0; c < 4; ++c) {
+            int32_t sum = 0;
+            for (int t = 0; t < taps.count; ++t) {
+                sum += w[t] * src[t * 4 + c];
+            }
+            sum = (sum + (1 << (kOutShift - 1))) >> kOutShift;
+            out[x * 4 + c] = static_cast<uint8_t>(std::min(std::max(sum, 0), 255));
+        }
+#endif
+    }
+}
+
+}  // namespace
+
+void ImageScaler::FitWithin(int width, int height, int64_t maxPixels, int maxEdge,
+                            int& outWidth, int& outHeight) {
+    outWidth = width;
+    outHeight = height;
+    if (width <= 0 || height <= 0) {
+        return;
+    }
+    double scale = 1.0;
+    double pixels = static_cast<double>(width) * height;
+    if (maxPixels > 0 && pixels > maxPixels) {
+        scale = std::sqrt(maxPixels / pixels);
+    }
+    int longer = std::max(width, height);
+    if (maxEdge > 0 && longer * scale > maxEdge) {
+        scale = static_cast<double>(maxEdge) / longer;
+    }
+    if (scale < 1.0) {
+        // Rounded down, so the limits hold; the epsilon keeps exact fits
+        outWidth = std::max(1, static_cast<int>(width * scale + 1e-9));
+        outHeight = std::max(1, static_cast<int>(height * scale + 1e-9));
+    }
+}
+
+bool ImageScaler::Downscale(const FrameView& view, int width, int height,
+                            uint8_t* out, size_t stride) {
+    if (view.Empty() || width < 1 || height < 1 || width > view.Width() || height > view.Height()) {
+        return false;
+    }
+
+    Taps columns = MakeTaps(view.Width(), width);
+    Taps rows = MakeTaps(view.Height(), height);
+    size_t n = view.RowBytes();
+    std::vector<int32_t> acc(n);
+    std::vector<int16_t> row(n + static_cast<size_t>(columns.count) * 4, 0);
+    std::vector<const uint8_t*> sources(rows.count);
+    std::vector<int> weights(rows.count);
+
+    for (int y = 0; y < height; ++y) {
+        // Rows outside the image only ever get zero weight
+        const int16_t* w = &rows.weights[static_cast<size_t>(y) * rows.count];
+        int count = 0;
+        for (int t = 0; t < rows.count; ++t) {
+            if (w[t] != 0) {
+                sources[count] = view.Row(rows.first[y] + t);
+                weights[count++] = w[t];
+            }
+        }
+        BlendRows(sources.data(), weights.data(), count, n, acc.data(), row.data());
+        BlendColumns(row.data(), columns, width, out + static_cast<size_t>(y) * stride);
+    }
+    return true;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "frame_view.h"
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Image Scaler
+ *
+ * Area-average (box filter) downscaling of BGRA frames. Each output
+ * pixel is the mean of the source pixels it covers, with the partly
+ * covered ones at its edges weighted by how much of them it covers, so
+ * thin lines and text fade rather than alias or vanish.
+ *
+ * Every output row first blends its source rows into one intermediate
+ * row, which is then blended horizontally. The arithmetic is 14-bit
+ * fixed point throughout, so the SSE2, AVX2, NEON and scalar paths
+ * produce identical pixels. AVX2 is used when the build targets it
+ * (/arch:AVX2, -mavx2); SSE2 is the x86 baseline.
+ *
+ * Platform-neutral and stateless.
+ */
+class ImageScaler {
+public:
+    // Largest size with at most maxPixels pixels and at most maxEdge on
+    // its longer side (0 = no limit), keeping the aspect ratio. Never
+    // larger than the source, never smaller than 1x1.
+    static void FitWithin(int width, int height, int64_t maxPixels, int maxEdge,
+                          int& outWidth, int& outHeight);
+
+    // Downscale view to width x height into out, which has room for
+    // height rows of stride bytes. The size must be at least 1x1 and no
+    // larger than the view. False if the view is empty or the size is
+    // out of range.
+    static bool Downscale(const FrameView& view, int width, int height,
+                          uint8_t* out, size_t stride);
+};
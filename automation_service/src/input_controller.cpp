@@ -3,24 +3,41 @@
 #include <chrono>
 
 InputController::InputController() {
-    screenWidth_ = GetSystemMetrics(SM_CXSCREEN);
-    screenHeight_ = GetSystemMetrics(SM_CYSCREEN);
+    desktop_ = Rect{
+        GetSystemMetrics(SM_XVIRTUALSCREEN),
+        GetSystemMetrics(SM_YVIRTUALSCREEN),
+        GetSystemMetrics(SM_CXVIRTUALSCREEN),
+        GetSystemMetrics(SM_CYVIRTUALSCREEN)
+    };
 }
 
 InputController::~InputController() {
 }
 
 bool InputController::ValidateCoordinates(int x, int y) const {
-    return x >= 0 && y >= 0 && x < screenWidth_ && y < screenHeight_;
+    Rect desktop = desktop_;
+    return x >= 0 && y >= 0 && x < desktop.width && y < desktop.height;
 }
 
 void InputController::ScreenToAbsolute(int& x, int& y) {
-    // Convert screen coordinates to absolute (0-65535 range)
-    x = (x * 65535) / screenWidth_;
-    y = (y * 65535) / screenHeight_;
+    // Convert to absolute (0-65535 range) across the virtual screen,
+    // which MOUSEEVENTF_VIRTUALDESK normalizes against
+    int left = GetSystemMetrics(SM_XVIRTUALSCREEN);
+    int top = GetSystemMetrics(SM_YVIRTUALSCREEN);
+    int width = std::max(GetSystemMetrics(SM_CXVIRTUALSCREEN) - 1, 1);
+    int height = std::max(GetSystemMetrics(SM_CYVIRTUALSCREEN) - 1, 1);
+    Rect desktop = desktop_;
+    x = ((x + desktop.x - left) * 65535) / width;
+    y = ((y + desktop.y - top) * 65535) / height;
 }
 
 void InputController::SendMouseEvent(DWORD flags, int x, int y, DWORD data) {
+    // Absolute positions address the whole virtual desktop, not just
+    // the primary monitor
+    if (flags & MOUSEEVENTF_ABSOLUTE) {
+        flags |= MOUSEEVENTF_VIRTUALDESK;
+    }
+    
     INPUT input = {};
     input.type = INPUT_MOUSE;
     input.mi.dwFlags = flags;
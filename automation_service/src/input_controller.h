@@ -1,12 +1,15 @@
 #pragma once
 
 #include "common.h"
+#include <atomic>
 #include <vector>
 
 /**
  * Input Controller using SendInput API
  * 
  * Provides mouse and keyboard input injection.
+ * Mouse coordinates span the whole virtual desktop (every monitor),
+ * relative to the top-left corner of the desktop bounds.
  */
 class InputController {
 public:
@@ -29,6 +32,11 @@ public:
     // Utility
     void Wait(int milliseconds);
     
+    // Desktop area that mouse coordinates cover, in desktop coordinates;
+    // (0, 0) maps to its top-left corner. Defaults to the virtual screen.
+    // May change (display mode change) while input is being sent.
+    void SetDesktopBounds(const Rect& bounds) { desktop_ = bounds; }
+    
 private:
     bool ValidateCoordinates(int x, int y) const;
 
@@ -41,8 +49,7 @@ private:
     // Send keyboard event
     void SendKeyEvent(WORD virtualKey, bool keyDown);
     
-    // Screen dimensions
-    int screenWidth_;
-    int screenHeight_;
+    // Area mouse coordinates cover
+    std::atomic<Rect> desktop_;
 };
 
@@ -0,0 +1,445 @@
+#include "jpeg_encoder.h"
+#include "worker_pool.h"
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+namespace {
+
+// Strips smaller than this many pixels are not worth a thread
+constexpr size_t kMinStripPixels = 256 * 1024;
+
+// Natural-order index of each zigzag position
+const uint8_t kZigzag[64] = {
+    0, 1, 8, 16, 9, 2, 3, 10, 17, 24, 32, 25, 18, 11, 4, 5,
+    12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13, 6, 7, 14, 21, 28,
+    35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+    58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63};
+
+// Annex K quantization tables, natural order
+const uint8_t kLumaQuant[64] = {
+    16, 11, 10, 16, 24, 40, 51, 61, 12, 12, 14, 19, 26, 58, 60, 55,
+    14, 13, 16, 24, 40, 57, 69, 56, 14, 17, 22, 29, 51, 87, 80, 62,
+    18, 22, 37, 56, 68, 109, 103, 77, 24, 35, 55, 64, 81, 104, 113, 92,
+    49, 64, 78, 87, 103, 121, 120, 101, 72, 92, 95, 98, 112, 100, 103, 99};
+const uint8_t kChromaQuant[64] = {
+    17, 18, 24, 47, 99, 99, 99, 99, 18, 21, 26, 66, 99, 99, 99, 99,
+    24, 26, 56, 99, 99, 99, 99, 99, 47, 66, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99};
+
+// Annex K Huffman tables: code counts per length 1-16, then the values
+const uint8_t kDcLumaBits[16] = {0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0};
+const uint8_t kDcChromaBits[16] = {0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0};
+const uint8_t kDcValues[12] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
+const uint8_t kAcLumaBits[16] = {0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d};
+const uint8_t kAcLumaValues[162] = {
+    0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+    0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08, 0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0,
+    0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28,
+    0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+    0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+    0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+    0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
+    0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5,
+    0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+    0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+    0xf9, 0xfa};
+const uint8_t kAcChromaBits[16] = {0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77};
+const uint8_t kAcChromaValues[162] = {
+    0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71,
+    0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91, 0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0,
+    0x15, 0x62, 0x72, 0xd1, 0x0a, 0x16, 0x24, 0x34, 0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26,
+    0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
+    0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+    0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+    0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5,
+    0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3,
+    0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda,
+    0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+    0xf9, 0xfa};
+
+// Canonical codes from a DHT-style table, indexed by value
+struct HuffmanCode {
+    uint16_t code[256] = {};
+    uint8_t size[256] = {};
+
+    HuffmanCode(const uint8_t* bits, const uint8_t* values) {
+        int code = 0;
+        int k = 0;
+        for (int length = 1; length <= 16; ++length) {
+            for (int i = 0; i < bits[length - 1]; ++i, ++k) {
+                this->code[values[k]] = static_cast<uint16_t>(code++);
+                size[values[k]] = static_cast<uint8_t>(length);
+            }
+            code <<= 1;
+        }
+    }
+};
+
+struct HuffmanCodes {
+    HuffmanCode dcLuma{kDcLumaBits, kDcValues};
+    HuffmanCode acLuma{kAcLumaBits, kAcLumaValues};
+    HuffmanCode dcChroma{kDcChromaBits, kDcValues};
+    HuffmanCode acChroma{kAcChromaBits, kAcChromaValues};
+};
+
+const HuffmanCodes& Codes() {
+    static const HuffmanCodes codes;
+    return codes;
+}
+
+// MSB-first bit packer with 0xFF byte stuffing
+class BitWriter {
+public:
+    explicit BitWriter(std::vector<uint8_t>& out) : out_(out) {}
+
+    // size is at most 16 bits. Bytes are emitted 32 bits at a time.
+    void Put(uint32_t value, int size) {
+        bits_ = (bits_ << size) | (value & ((1u << size) - 1));
+        count_ += size;
+        if (count_ >= 32) {
+            Flush(32);
+        }
+    }
+
+    // Fill the last byte with 1 bits, as restart markers and EOI require
+    void Pad() {
+        int spare = (8 - count_ % 8) % 8;
+        bits_ = (bits_ << spare) | ((1u << spare) - 1);
+        count_ += spare;
+        Flush(count_);
+    }
+
+private:
+    std::vector<uint8_t>& out_;
+    uint64_t bits_ = 0;     // pending bits are the low count_
+    int count_ = 0;
+
+    // Emit the oldest n pending bits (a multiple of 8)
+    void Flush(int n) {
+        for (; n > 0; n -= 8) {
+            count_ -= 8;
+            uint8_t byte = static_cast<uint8_t>(bits_ >> count_);
+            out_.push_back(byte);
+            if (byte == 0xFF) {
+                out_.push_back(0x00);
+            }
+        }
+        bits_ &= (uint64_t(1) << count_) - 1;
+    }
+};
+
+// Float AAN forward DCT (as IJG's jfdctflt) on a natural-order block,
+// in place. Outputs carry the AAN scale factors, folded into the
+// quantization divisors.
+void ForwardDct(float* block) {
+    for (int pass = 0; pass < 2; ++pass) {
+        int step = pass == 0 ? 1 : 8;       // rows, then columns
+        int stride = pass == 0 ? 8 : 1;
+        for (int line = 0; line < 8; ++line) {
+            float* d = block + line * stride;
+            float tmp0 = d[0] + d[7 * step];
+            float tmp7 = d[0] - d[7 * step];
+            float tmp1 = d[1 * step] + d[6 * step];
+            float tmp6 = d[1 * step] - d[6 * step];
+            float tmp2 = d[2 * step] + d[5 * step];
+            float tmp5 = d[2 * step] - d[5 * step];
+            float tmp3 = d[3 * step] + d[4 * step];
+            float tmp4 = d[3 * step] - d[4 * step];
+
+            float tmp10 = tmp0 + tmp3;
+            float tmp13 = tmp0 - tmp3;
+            float tmp11 = tmp1 + tmp2;
+            float tmp12 = tmp1 - tmp2;
+            d[0] = tmp10 + tmp11;
+            d[4 * step] = tmp10 - tmp11;
+            float z1 = (tmp12 + tmp13) * 0.707106781f;
+            d[2 * step] = tmp13 + z1;
+            d[6 * step] = tmp13 - z1;
+
+            tmp10 = tmp4 + tmp5;
+            tmp11 = tmp5 + tmp6;
+            tmp12 = tmp6 + tmp7;
+            float z5 = (tmp10 - tmp12) * 0.382683433f;
+            float z2 = 0.541196100f * tmp10 + z5;
+            float z4 = 1.306562965f * tmp12 + z5;
+            float z3 = tmp11 * 0.707106781f;
+            float z11 = tmp7 + z3;
+            float z13 = tmp7 - z3;
+            d[5 * step] = z13 + z2;
+            d[3 * step] = z13 - z2;
+            d[1 * step] = z11 + z4;
+            d[7 * step] = z11 - z4;
+        }
+    }
+}
+
+inline int Category(int value) {
+    int magnitude = value < 0 ? -value : value;
+    int bits = 0;
+    while (magnitude) {
+        ++bits;
+        magnitude >>= 1;
+    }
+    return bits;
+}
+
+}  // namespace
+
+struct JpegEncoder::Tables {
+    uint8_t quant[2][64];       // natural order; luma, chroma
+    float scale[2][64];         // zigzag order; multiplier from DCT output to quantized value
+
+    explicit Tables(int quality) {
+        static const float kAan[8] = {1.0f, 1.387039845f, 1.306562965f, 1.175875602f,
+                                      1.0f, 0.785694958f, 0.541196100f, 0.275899379f};
+        quality = std::min(std::max(quality, 1), 100);
+        int factor = quality < 50 ? 5000 / quality : 200 - quality * 2;
+        const uint8_t* bases[2] = {kLumaQuant, kChromaQuant};
+        for (int t = 0; t < 2; ++t) {
+            for (int i = 0; i < 64; ++i) {
+                int q = (bases[t][i] * factor + 50) / 100;
+                quant[t][i] = static_cast<uint8_t>(std::min(std::max(q, 1), 255));
+            }
+            for (int k = 0; k < 64; ++k) {
+                int i = kZigzag[k];
+                scale[t][k] = 1.0f / (quant[t][i] * kAan[i / 8] * kAan[i % 8] * 8.0f);
+            }
+        }
+    }
+};
+
+namespace {
+
+void EncodeBlock(float* block, const float* scale, int& previousDc,
+                 const HuffmanCode& dc, const HuffmanCode& ac, BitWriter& writer) {
+    ForwardDct(block);
+    // Round to nearest by offsetting into positive range first (as IJG
+    // does): truncation of a positive value is floor
+    int coefficients[64];
+    for (int k = 0; k < 64; ++k) {
+        coefficients[k] = static_cast<int>(block[kZigzag[k]] * scale[k] + 16384.5f) - 16384;
+    }
+
+    int diff = coefficients[0] - previousDc;
+    previousDc = coefficients[0];
+    int category = Category(diff);
+    writer.Put(dc.code[category], dc.size[category]);
+    if (category) {
+        writer.Put(diff < 0 ? diff - 1 : diff, category);
+    }
+
+    int run = 0;
+    for (int k = 1; k < 64; ++k) {
+        int v = coefficients[k];
+        if (v == 0) {
+            ++run;
+            continue;
+        }
+        while (run > 15) {
+            writer.Put(ac.code[0xF0], ac.size[0xF0]);
+            run -= 16;
+        }
+        category = Category(v);
+        int symbol = (run << 4) | category;
+        writer.Put(ac.code[symbol], ac.size[symbol]);
+        writer.Put(v < 0 ? v - 1 : v, category);
+        run = 0;
+    }
+    if (run > 0) {
+        writer.Put(ac.code[0x00], ac.size[0x00]);
+    }
+}
+
+void PutMarker(std::vector<uint8_t>& out, uint8_t marker, size_t length) {
+    out.push_back(0xFF);
+    out.push_back(marker);
+    if (length) {
+        out.push_back(static_cast<uint8_t>(length >> 8));
+        out.push_back(static_cast<uint8_t>(length));
+    }
+}
+
+void PutHuffmanTable(std::vector<uint8_t>& out, uint8_t classAndId, const uint8_t* bits, const uint8_t* values) {
+    int count = 0;
+    for (int i = 0; i < 16; ++i) {
+        count += bits[i];
+    }
+    PutMarker(out, 0xC4, 2 + 1 + 16 + count);
+    out.push_back(classAndId);
+    out.insert(out.end(), bits, bits + 16);
+    out.insert(out.end(), values, values + count);
+}
+
+}  // namespace
+
+JpegEncoder::JpegEncoder(const Options& options)
+    : threads_(options.threads > 0 ? options.threads
+                                   : std::max(1, static_cast<int>(std::thread::hardware_concurrency()))) {
+}
+
+JpegEncoder::~JpegEncoder() = default;
+
+bool JpegEncoder::Encode(const FrameView& view, int quality, std::vector<uint8_t>& out) {
+    out.clear();
+    if (view.Empty() || view.Width() > 65535 || view.Height() > 65535) {
+        return false;
+    }
+    Tables tables(quality);
+
+    int mcusPerRow = (view.Width() + 15) / 16;
+    int mcuRows = (view.Height() + 15) / 16;
+    size_t pixels = static_cast<size_t>(view.Width()) * view.Height();
+    int count = static_cast<int>(std::min<size_t>(pixels / kMinStripPixels, threads_));
+    count = std::max(std::min(count, mcuRows), 1);
+    // The restart interval counts MCUs in 16 bits
+    int rowsPerStrip = std::min((mcuRows + count - 1) / count, std::max(65535 / mcusPerRow, 1));
+    count = (mcuRows + rowsPerStrip - 1) / rowsPerStrip;
+
+    WriteHeaders(view, tables, count > 1 ? mcusPerRow * rowsPerStrip : 0, out);
+
+    // Strip 0 goes straight after the headers; the rest into pooled
+    // buffers, appended in order. The group is declared after the buffers
+    // so that, on an early exit, it waits for its strips before they go.
+    std::vector<std::unique_ptr<std::vector<uint8_t>>> buffers;
+    for (int s = 1; s < count; ++s) {
+        buffers.push_back(AcquireBuffer());
+    }
+    TaskGroup group(WorkerPool::Strips());
+    for (int s = 1; s < count; ++s) {
+        std::vector<uint8_t>* buffer = buffers[s - 1].get();
+        group.Run([&view, &tables, s, rowsPerStrip, mcuRows, count, buffer] {
+            EncodeStrip(view, tables, s * rowsPerStrip, std::min((s + 1) * rowsPerStrip, mcuRows),
+                        s % 8, s + 1 == count, *buffer);
+        });
+    }
+    EncodeStrip(view, tables, 0, std::min(rowsPerStrip, mcuRows), 0, count == 1, out);
+    group.WaitAll();
+    for (auto& buffer : buffers) {
+        out.insert(out.end(), buffer->begin(), buffer->end());
+        ReleaseBuffer(std::move(buffer));
+    }
+    PutMarker(out, 0xD9, 0);        // EOI
+    return true;
+}
+
+void JpegEncoder::WriteHeaders(const FrameView& view, const Tables& tables,
+                               int restartInterval, std::vector<uint8_t>& out) {
+    PutMarker(out, 0xD8, 0);        // SOI
+
+    // JFIF 1.01, no density, no thumbnail
+    static const uint8_t kJfif[14] = {'J', 'F', 'I', 'F', 0, 1, 1, 0, 0, 1, 0, 1, 0, 0};
+    PutMarker(out, 0xE0, 2 + sizeof(kJfif));
+    out.insert(out.end(), kJfif, kJfif + sizeof(kJfif));
+
+    PutMarker(out, 0xDB, 2 + 2 * 65);
+    for (int t = 0; t < 2; ++t) {
+        out.push_back(static_cast<uint8_t>(t));
+        for (int k = 0; k < 64; ++k) {
+            out.push_back(tables.quant[t][kZigzag[k]]);
+        }
+    }
+
+    // Baseline frame: Y sampled 2x2, Cb and Cr 1x1
+    PutMarker(out, 0xC0, 2 + 6 + 3 * 3);
+    out.push_back(8);
+    out.push_back(static_cast<uint8_t>(view.Height() >> 8));
+    out.push_back(static_cast<uint8_t>(view.Height()));
+    out.push_back(static_cast<uint8_t>(view.Width() >> 8));
+    out.push_back(static_cast<uint8_t>(view.Width()));
+    out.push_back(3);
+    const uint8_t components[9] = {1, 0x22, 0, 2, 0x11, 1, 3, 0x11, 1};
+    out.insert(out.end(), components, components + 9);
+
+    PutHuffmanTable(out, 0x00, kDcLumaBits, kDcValues);
+    PutHuffmanTable(out, 0x10, kAcLumaBits, kAcLumaValues);
+    PutHuffmanTable(out, 0x01, kDcChromaBits, kDcValues);
+    PutHuffmanTable(out, 0x11, kAcChromaBits, kAcChromaValues);
+
+    if (restartInterval) {
+        PutMarker(out, 0xDD, 4);
+        out.push_back(static_cast<uint8_t>(restartInterval >> 8));
+        out.push_back(static_cast<uint8_t>(restartInterval));
+    }
+
+    PutMarker(out, 0xDA, 2 + 1 + 3 * 2 + 3);
+    const uint8_t scan[10] = {3, 1, 0x00, 2, 0x11, 3, 0x11, 0, 63, 0};
+    out.insert(out.end(), scan, scan + 10);
+}
+
+void JpegEncoder::EncodeStrip(const FrameView& view, const Tables& tables,
+                              int firstRow, int lastRow, int restart, bool last,
+                              std::vector<uint8_t>& out) {
+    const HuffmanCodes& codes = Codes();
+    BitWriter writer(out);
+    int width = view.Width();
+    int height = view.Height();
+    int mcusPerRow = (width + 15) / 16;
+    int dcY = 0, dcCb = 0, dcCr = 0;
+
+    float y[4][64];
+    float cb[64];
+    float cr[64];
+    for (int row = firstRow; row < lastRow; ++row) {
+        for (int column = 0; column < mcusPerRow; ++column) {
+            // 16x16 pixels, edges replicated past the image
+            int x0 = column * 16;
+            int xs[16];
+            for (int dx = 0; dx < 16; ++dx) {
+                xs[dx] = std::min(x0 + dx, width - 1) * 4;
+            }
+            for (int dy = 0; dy < 16; ++dy) {
+                const uint8_t* line = view.Row(std::min(row * 16 + dy, height - 1));
+                float* luma = y[(dy / 8) * 2] + (dy % 8) * 8;
+                for (int dx = 0; dx < 16; ++dx) {
+                    const uint8_t* p = line + xs[dx];
+                    luma[(dx / 8) * 64 + dx % 8] = 0.299f * p[2] + 0.587f * p[1] + 0.114f * p[0] - 128.0f;
+                }
+            }
+            // Chroma from 2x2 averages
+            for (int cy = 0; cy < 8; ++cy) {
+                const uint8_t* line0 = view.Row(std::min(row * 16 + cy * 2, height - 1));
+                const uint8_t* line1 = view.Row(std::min(row * 16 + cy * 2 + 1, height - 1));
+                for (int cx = 0; cx < 8; ++cx) {
+                    const uint8_t* a = line0 + xs[cx * 2];
+                    const uint8_t* b = line0 + xs[cx * 2 + 1];
+                    const uint8_t* c = line1 + xs[cx * 2];
+                    const uint8_t* d = line1 + xs[cx * 2 + 1];
+                    float blue = (a[0] + b[0] + c[0] + d[0]) * 0.25f;
+                    float green = (a[1] + b[1] + c[1] + d[1]) * 0.25f;
+                    float red = (a[2] + b[2] + c[2] + d[2]) * 0.25f;
+                    cb[cy * 8 + cx] = -0.168736f * red - 0.331264f * green + 0.5f * blue;
+                    cr[cy * 8 + cx] = 0.5f * red - 0.418688f * green - 0.081312f * blue;
+                }
+            }
+            for (auto& block : y) {
+                EncodeBlock(block, tables.scale[0], dcY, codes.dcLuma, codes.acLuma, writer);
+            }
+            EncodeBlock(cb, tables.scale[1], dcCb, codes.dcChroma, codes.acChroma, writer);
+            EncodeBlock(cr, tables.scale[1], dcCr, codes.dcChroma, codes.acChroma, writer);
+        }
+    }
+    writer.Pad();
+    if (!last) {
+        PutMarker(out, static_cast<uint8_t>(0xD0 + restart), 0);
+    }
+}
+
+std::unique_ptr<std::vector<uint8_t>> JpegEncoder::AcquireBuffer() {
+    std::lock_guard<std::mutex> lock(idleMutex_);
+    if (idle_.empty()) {
+        return std::make_unique<std::vector<uint8_t>>();
+    }
+    auto buffer = std::move(idle_.back());
+    idle_.pop_back();
+    buffer->clear();
+    return buffer;
+}
+
+void JpegEncoder::ReleaseBuffer(std::unique_ptr<std::vector<uint8_t>> buffer) {
+    std::lock_guard<std::mutex> lock(idleMutex_);
+    if (idle_.size() < static_cast<size_t>(threads_) * 2) {
+        idle_.push_back(std::move(buffer));
+    }
+}
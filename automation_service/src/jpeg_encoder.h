@@ -0,0 +1,59 @@
+#pragma once
+
+#include "frame_view.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/**
+ * JPEG Encoder
+ *
+ * Built-in baseline JPEG writer for BGRA frames: YCbCr with 4:2:0 chroma,
+ * quantization tables scaled by an IJG-style quality (1-100), a float
+ * AAN DCT and the standard Huffman tables, so there is no second pass
+ * to gather statistics.
+ *
+ * Like PngEncoder it splits the image into horizontal strips (rows of
+ * 16-pixel MCUs) encoded in parallel. The strips are joined by restart
+ * markers, which reset the DC predictors, so each strip's entropy-coded
+ * data is independent.
+ *
+ * Platform-neutral and thread-safe.
+ */
+class JpegEncoder {
+public:
+    struct Options {
+        int threads = 0;        // strips encoded at once; 0 = hardware threads
+    };
+
+    JpegEncoder() : JpegEncoder(Options()) {}
+    explicit JpegEncoder(const Options& options);
+    ~JpegEncoder();
+
+    JpegEncoder(const JpegEncoder&) = delete;
+    JpegEncoder& operator=(const JpegEncoder&) = delete;
+
+    // Encode into out, replacing its contents but keeping its capacity.
+    // quality is clamped to 1-100. False if the view is empty.
+    bool Encode(const FrameView& view, int quality, std::vector<uint8_t>& out);
+
+private:
+    struct Tables;
+
+    int threads_;
+
+    // Strip output buffers, reused across calls
+    std::mutex idleMutex_;
+    std::vector<std::unique_ptr<std::vector<uint8_t>>> idle_;
+
+    static void EncodeStrip(const FrameView& view, const Tables& tables,
+                            int firstRow, int lastRow, int restart, bool last,
+                            std::vector<uint8_t>& out);
+    static void WriteHeaders(const FrameView& view, const Tables& tables,
+                             int restartInterval, std::vector<uint8_t>& out);
+
+    std::unique_ptr<std::vector<uint8_t>> AcquireBuffer();
+    void ReleaseBuffer(std::unique_ptr<std::vector<uint8_t>> buffer);
+};
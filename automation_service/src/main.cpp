@@ -27,18 +27,22 @@ int main(int argc, char* argv[]) {
     // Create Native Messaging handler
     NativeMessaging messaging;
     
-    // Register handlers
+    // Register handlers. Control-lane handlers must stay cheap; anything
+    // that captures, walks the UI tree or runs actions goes on Heavy.
     messaging.RegisterHandler("get_capabilities", [&](const json& msg) -> json {
         return executor->GetCapabilities();
     });
     
     messaging.RegisterHandler("capture_screen", [&](const json& msg) -> json {
-        return executor->CaptureScreen();
-    });
+        // JSON connections carry the image as base64 text, which the
+        // encode cache can keep alongside the bytes
+        return executor->CaptureScreen(msg.value("params", json::object()),
+                                       NativeMessaging::ReplyEncoding() == MessageEncoding::Json);
+    }, DispatchLane::Heavy);
     
     messaging.RegisterHandler("inspect_ui", [&](const json& msg) -> json {
         return executor->GetUITree();
-    });
+    }, DispatchLane::Heavy);
     
     messaging.RegisterHandler("execute_action", [&](const json& msg) -> json {
         if (!msg.contains("params")) {
@@ -51,24 +55,38 @@ int main(int argc, char* argv[]) {
         if (!msg.contains("params") || !msg["params"].contains("actions")) {
             return {{"success", false}, {"error", "Missing actions array"}};
         }
-        return executor->ExecuteActions(msg["params"]["actions"]);
-    });
+        Deadline deadline;
+        if (!Deadline::FromParams(msg["params"], deadline)) {
+            return {{"success", false}, {"error", Deadline::kInvalidBudget}};
+        }
+        return executor->ExecuteActions(msg["params"]["actions"], deadline);
+    }, DispatchLane::Heavy);
     
     messaging.RegisterHandler("check_local_llm", [&](const json& msg) -> json {
-        return executor->CheckLocalLLM();
+        Deadline deadline;
+        if (!Deadline::FromParams(msg.value("params", json::object()), deadline)) {
+            return {{"success", false}, {"error", Deadline::kInvalidBudget}};
+        }
+        return executor->CheckLocalLLM(deadline);
     });
     
     messaging.RegisterHandler("get_actions", [&](const json& msg) -> json {
         return executor->RequestActions(msg);
-    });
+    }, DispatchLane::Heavy);
 
+    // A poll that may wait goes on its own lane; a plain status check
+    // stays on Control
     messaging.RegisterHandler("poll", [&](const json& msg) -> json {
         return executor->PollRequest(msg);
+    }, [](const json& msg) {
+        auto it = msg.find("wait_ms");
+        bool waits = it != msg.end() && it->is_number() && it->get<double>() > 0;
+        return waits ? DispatchLane::Wait : DispatchLane::Control;
     });
 
     messaging.RegisterHandler("cancel", [&](const json& msg) -> json {
         return executor->CancelRequest(msg);
-    });
+    }, DispatchLane::Control);
 
     messaging.RegisterHandler("store_api_key", [&](const json& msg) -> json {
         return executor->StoreApiKey(msg);
@@ -80,7 +98,7 @@ int main(int argc, char* argv[]) {
 
     messaging.RegisterHandler("get_provider_status", [&](const json& msg) -> json {
         return executor->GetProviderStatus(msg);
-    });
+    }, DispatchLane::Control);
 
     messaging.RegisterHandler("ping", [&](const json& msg) -> json {
         return {
@@ -88,7 +106,15 @@ int main(int argc, char* argv[]) {
             {"message", "pong"},
             {"version", "1.0.0"}
         };
-    });
+    }, DispatchLane::Control);
+    
+    messaging.RegisterHandler("get_dispatch_stats", [&](const json& msg) -> json {
+        return messaging.GetDispatchStats();
+    }, DispatchLane::Control);
+    
+    messaging.RegisterHandler("get_capture_stats", [&](const json& msg) -> json {
+        return executor->GetCaptureStats();
+    }, DispatchLane::Control);
     
     LOG_INFO(L"Handlers registered, entering message loop");
     
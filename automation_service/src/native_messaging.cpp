@@ -1,8 +1,217 @@
 #include "native_messaging.h"
+#include "base64.h"
 #include <io.h>
 #include <fcntl.h>
+#include <streambuf>
+#include <ostream>
+#include <charconv>
 
-NativeMessaging::NativeMessaging() : running_(true) {
+std::mutex NativeMessaging::writeMutex_;
+
+NativeMessaging::FrameBufferPool NativeMessaging::writeBuffers_;
+
+thread_local MessageEncoding NativeMessaging::replyEncoding_ = MessageEncoding::Json;
+
+namespace {
+
+// Bytes reserved at the front of every outbound buffer for the length prefix
+constexpr size_t kPrefixSize = 4;
+
+void AppendNumber(std::string& out, uint64_t value) {
+    char digits[24];
+    auto result = std::to_chars(digits, digits + sizeof(digits), value);
+    out.append(digits, result.ptr);
+}
+
+/**
+ * Stream buffer that frames serialized JSON as it is produced.
+ *
+ * Text is serialized straight into a pooled buffer behind a reserved
+ * length prefix, so a small message costs one write and no allocation.
+ * Once the text outgrows a single frame it is flushed as chunk frames of
+ * kChunkDataSize, so a multi-megabyte screenshot is never held as one
+ * serialized string.
+ */
+class FrameStreamBuf : public std::streambuf {
+public:
+    explicit FrameStreamBuf(const json* id)
+        : id_(id)
+        , buffer_(NativeMessaging::AcquireWriteBuffer()) {
+        buffer_.assign(kPrefixSize, '\0');
+    }
+
+    ~FrameStreamBuf() override {
+        NativeMessaging::ReleaseWriteBuffer(std::move(buffer_));
+        if (chunked_) {
+            NativeMessaging::ReleaseWriteBuffer(std::move(frame_));
+        }
+    }
+
+    // Emit whatever is buffered: a single frame, or the last chunk and trailer
+    bool Finish() {
+        if (!chunked_) {
+            if (buffer_.size() - kPrefixSize <= NativeMessaging::kMaxFrameSize) {
+                return NativeMessaging::WriteFrame(buffer_);
+            }
+            BeginChunking();
+        }
+
+        while (ok_ && buffer_.size() > kPrefixSize) {
+            FlushChunk(true);
+        }
+        if (!ok_) return false;
+
+        StartChunkFrame();
+        frame_ += ",\"final\":true,\"chunks\":";
+        AppendNumber(frame_, seq_);
+        frame_ += ",\"bytes\":";
+        AppendNumber(frame_, totalBytes_);
+        frame_ += '}';
+        return NativeMessaging::WriteFrame(frame_);
+    }
+
+protected:
+    int_type overflow(int_type ch) override {
+        if (traits_type::eq_int_type(ch, traits_type::eof())) {
+            return traits_type::not_eof(ch);
+        }
+        buffer_.push_back(traits_type::to_char_type(ch));
+        MaybeFlush();
+        return ok_ ? ch : traits_type::eof();
+    }
+
+    std::streamsize xsputn(const char* s, std::streamsize n) override {
+        buffer_.append(s, static_cast<size_t>(n));
+        MaybeFlush();
+        return ok_ ? n : 0;
+    }
+
+private:
+    void BeginChunking() {
+        chunked_ = true;
+        streamId_ = nextStreamId_++;
+        frame_ = NativeMessaging::AcquireWriteBuffer();
+        if (id_) idText_ = id_->dump();
+    }
+
+    void MaybeFlush() {
+        // Stay in single-frame mode until the message can't fit in one frame
+        if (!chunked_) {
+            if (buffer_.size() - kPrefixSize <= NativeMessaging::kMaxFrameSize) return;
+            BeginChunking();
+        }
+        while (ok_ && buffer_.size() - kPrefixSize >= NativeMessaging::kChunkDataSize) {
+            FlushChunk(false);
+        }
+    }
+
+    // Common head of chunk and trailer frames, written into frame_
+    void StartChunkFrame() {
+        frame_.assign(kPrefixSize, '\0');
+        frame_ += "{\"chunked\":true,\"stream\":";
+        AppendNumber(frame_, streamId_);
+        frame_ += ",\"seq\":";
+        AppendNumber(frame_, seq_);
+        if (!idText_.empty()) {
+            frame_ += ",\"id\":";
+            frame_ += idText_;
+        }
+    }
+
+    // Send up to kChunkDataSize bytes as one chunk frame, never splitting a
+    // UTF-8 sequence (the chunk text must itself be valid JSON string data)
+    void FlushChunk(bool last) {
+        const char* pending = buffer_.data() + kPrefixSize;
+        size_t available = buffer_.size() - kPrefixSize;
+        size_t cut = std::min(available, NativeMessaging::kChunkDataSize);
+        if (cut < available || !last) {
+            size_t lead = cut;
+            while (lead > 0 && (static_cast<byte>(pending[lead - 1]) & 0xC0) == 0x80) {
+                --lead;
+            }
+            if (lead > 0 && static_cast<byte>(pending[lead - 1]) >= 0xC0) {
+                // Incomplete multi-byte sequence at the end; hold it back
+                cut = lead - 1;
+            }
+        }
+
+        // The serializer never emits raw control characters, so quoting
+        // and backslashes are the only things that need escaping here
+        StartChunkFrame();
+        frame_ += ",\"data\":\"";
+        for (size_t i = 0; i < cut; ++i) {
+            char c = pending[i];
+            if (c == '"' || c == '\\') frame_ += '\\';
+            frame_ += c;
+        }
+        frame_ += "\"}";
+
+        ok_ = NativeMessaging::WriteFrame(frame_);
+        totalBytes_ += cut;
+        ++seq_;
+        buffer_.erase(kPrefixSize, cut);
+    }
+
+    const json* id_;
+    std::string idText_;
+    std::string buffer_;
+    std::string frame_;
+    bool chunked_ = false;
+    bool ok_ = true;
+    uint64_t streamId_ = 0;
+    uint64_t seq_ = 0;
+    uint64_t totalBytes_ = 0;
+
+    static std::atomic<uint64_t> nextStreamId_;
+};
+
+std::atomic<uint64_t> FrameStreamBuf::nextStreamId_{1};
+
+} // namespace
+
+std::string NativeMessaging::FrameBufferPool::Acquire() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (free_.empty()) {
+        return std::string();
+    }
+    std::string buffer = std::move(free_.back());
+    free_.pop_back();
+    return buffer;
+}
+
+void NativeMessaging::FrameBufferPool::Release(std::string buffer) {
+    // Don't hoard the occasional huge binary frame
+    if (buffer.capacity() > kMaxPooledCapacity) {
+        return;
+    }
+    buffer.clear();
+    
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (free_.capacity() < kMaxPooled) {
+        free_.reserve(kMaxPooled);
+    }
+    if (free_.size() < kMaxPooled) {
+        free_.push_back(std::move(buffer));
+    }
+}
+
+std::string NativeMessaging::AcquireWriteBuffer() {
+    return writeBuffers_.Acquire();
+}
+
+void NativeMessaging::ReleaseWriteBuffer(std::string buffer) {
+    writeBuffers_.Release(std::move(buffer));
+}
+
+NativeMessaging::NativeMessaging(size_t controlWorkers,
+                                 size_t standardWorkers,
+                                 size_t heavyWorkers,
+                                 size_t waitWorkers)
+    : running_(true)
+    , controlLane_(controlWorkers)
+    , standardLane_(standardWorkers)
+    , heavyLane_(heavyWorkers)
+    , waitLane_(waitWorkers) {
     // Set stdin/stdout to binary mode (Windows)
     _setmode(_fileno(stdin), _O_BINARY);
     _setmode(_fileno(stdout), _O_BINARY);
@@ -17,8 +226,14 @@ NativeMessaging::~NativeMessaging() {
     LOG_INFO(L"Native Messaging shutting down");
 }
 
-void NativeMessaging::RegisterHandler(const std::string& action, MessageHandler handler) {
-    handlers_[action] = handler;
+void NativeMessaging::RegisterHandler(const std::string& action, MessageHandler handler,
+                                      DispatchLane lane) {
+    RegisterHandler(action, std::move(handler), [lane](const json&) { return lane; });
+}
+
+void NativeMessaging::RegisterHandler(const std::string& action, MessageHandler handler,
+                                      LaneSelector lane) {
+    handlers_[action] = {std::move(handler), std::move(lane)};
     LOG_DEBUG(L"Registered handler for action: " << StringToWString(action).c_str());
 }
 
@@ -36,15 +251,14 @@ void NativeMessaging::Run() {
                 break;
             }
             
-            // Process message and get response
-            json response = ProcessMessage(message);
-            
-            // Send response back to browser
-            if (!SendMessage(response)) {
-                LOG_ERROR(L"Failed to send response");
-                break;
+            if (message.is_object() && message.value("chunked", false)) {
+                message = AppendChunk(message);
+                if (message.is_null()) continue;  // more chunks to come
             }
             
+            // Hand off to a worker and go straight back to reading
+            Dispatch(std::move(message));
+            
         } catch (const std::exception& e) {
             LOG_ERROR(L"Error in message loop: " << StringToWString(e.what()).c_str());
             
@@ -53,13 +267,146 @@ void NativeMessaging::Run() {
                 {"success", false},
                 {"error", e.what()}
             };
-            SendMessage(error_response);
+            SendMessage(error_response, encoding_);
         }
     }
     
+    // Let in-flight handlers finish and flush their responses
+    controlLane_.Shutdown();
+    standardLane_.Shutdown();
+    heavyLane_.Shutdown();
+    waitLane_.Shutdown();
+    
     LOG_INFO(L"Native Messaging loop ended");
 }
 
+WorkerPool& NativeMessaging::LaneFor(const json& message) {
+    if (!message.is_object() || !message.contains("action") || !message["action"].is_string()) {
+        return controlLane_;
+    }
+    
+    auto it = handlers_.find(message["action"].get<std::string>());
+    if (it == handlers_.end()) {
+        return controlLane_;
+    }
+    
+    switch (it->second.lane(message)) {
+        case DispatchLane::Control: return controlLane_;
+        case DispatchLane::Heavy: return heavyLane_;
+        case DispatchLane::Wait: return waitLane_;
+        default: return standardLane_;
+    }
+}
+
+void NativeMessaging::Dispatch(json message) {
+    // The encoding is fixed here, in read order, rather than when the reply
+    // is sent: a ping switching encodings must not change replies to
+    // requests read before it that are still running on other lanes
+    MessageEncoding encoding = encoding_;
+    
+    // Encoding negotiation rides on the ping handshake. The reply still
+    // goes out in the old encoding; messages read after it get the new one.
+    bool negotiate = message.is_object() && message.contains("encodings")
+                     && message.value("action", "") == "ping";
+    if (negotiate) {
+        encoding_ = NegotiateEncoding(message["encodings"]);
+    }
+    MessageEncoding negotiated = encoding_;
+    
+    WorkerPool& lane = LaneFor(message);
+    bool posted = lane.Post([this, message = std::move(message), encoding, negotiate, negotiated]() {
+        replyEncoding_ = encoding;
+        json response = ProcessMessage(message);
+        
+        // Echo the caller's correlation id so out-of-order responses can be matched
+        if (message.is_object() && message.contains("id") && response.is_object()) {
+            response["id"] = message["id"];
+        }
+        
+        if (negotiate && response.is_object()) {
+            static const char* names[] = {"json", "cbor", "msgpack"};
+            response["encoding"] = names[static_cast<int>(negotiated)];
+        }
+        
+        bool sent = false;
+        try {
+            sent = SendMessage(std::move(response), encoding);
+        } catch (const std::exception& e) {
+            // Serialization failed (e.g. a string that isn't valid UTF-8);
+            // the caller still gets an answer for its id
+            LOG_ERROR(L"Failed to serialize response: " << StringToWString(e.what()).c_str());
+            json error_response = {
+                {"success", false},
+                {"error", std::string("Failed to serialize response: ") + e.what()}
+            };
+            if (message.is_object() && message.contains("id")) {
+                error_response["id"] = message["id"];
+            }
+            try {
+                sent = SendMessage(std::move(error_response), encoding);
+            } catch (const std::exception& e2) {
+                LOG_ERROR(L"Failed to send error response: " << StringToWString(e2.what()).c_str());
+                sent = true;  // the pipe itself is fine
+            }
+        }
+        
+        if (!sent) {
+            LOG_ERROR(L"Failed to send response");
+            running_ = false;
+        }
+    });
+    
+    if (!posted) {
+        LOG_ERROR(L"Worker pool is shut down, dropping message");
+    }
+}
+
+MessageEncoding NativeMessaging::NegotiateEncoding(const json& offered) {
+    if (!offered.is_array()) {
+        return MessageEncoding::Json;
+    }
+    
+    for (const auto& name : offered) {
+        if (!name.is_string()) continue;
+        if (name == "cbor") return MessageEncoding::Cbor;
+        if (name == "msgpack") return MessageEncoding::MessagePack;
+        if (name == "json") return MessageEncoding::Json;
+    }
+    return MessageEncoding::Json;
+}
+
+void NativeMessaging::BinaryToBase64(json& value) {
+    if (value.is_binary()) {
+        value = Base64::Encode(value.get_binary());
+    } else if (value.is_structured()) {
+        for (auto& child : value) {
+            BinaryToBase64(child);
+        }
+    }
+}
+
+json NativeMessaging::GetDispatchStats() {
+    auto toJson = [](const WorkerPool::Stats& stats) -> json {
+        return {
+            {"workers", stats.threads},
+            {"queued", stats.queued},
+            {"active", stats.active},
+            {"peak_queued", stats.peakQueued},
+            {"completed", stats.completed}
+        };
+    };
+    
+    return {
+        {"success", true},
+        {"lanes", {
+            {"control", toJson(controlLane_.GetStats())},
+            {"standard", toJson(standardLane_.GetStats())},
+            {"heavy", toJson(heavyLane_.GetStats())},
+            {"wait", toJson(waitLane_.GetStats())}
+        }}
+    };
+}
+
 json NativeMessaging::ReadMessage() {
     // Read 4-byte length prefix (little-endian)
     byte length_bytes[4];
@@ -73,52 +420,145 @@ json NativeMessaging::ReadMessage() {
         (static_cast<uint32_t>(length_bytes[2]) << 16) |
         (static_cast<uint32_t>(length_bytes[3]) << 24);
     
-    if (length == 0 || length > 1024 * 1024) { // Max 1MB
+    if (length == 0 || length > kMaxFrameSize) { // Max 1MB; larger messages arrive chunked
         throw std::runtime_error("Invalid message length");
     }
     
-    // Read message content
-    std::vector<byte> buffer(length);
-    if (!ReadBytes(buffer.data(), length)) {
+    // Read into the connection's buffer; it only ever grows, so steady
+    // state reads don't allocate
+    if (readBuffer_.size() < length) {
+        readBuffer_.resize(length);
+    }
+    if (!ReadBytes(readBuffer_.data(), length)) {
         throw std::runtime_error("Failed to read message content");
     }
     
-    // Parse JSON
-    std::string message_str(buffer.begin(), buffer.end());
-    return json::parse(message_str);
+    // Parse in place
+    return DecodeFrame(readBuffer_.data(), length);
 }
 
-bool NativeMessaging::SendMessage(const json& message) {
-    // Serialize JSON
-    std::string message_str = message.dump();
-    uint32_t length = static_cast<uint32_t>(message_str.length());
+json NativeMessaging::DecodeFrame(const byte* data, size_t length) {
+    // A JSON object starts with '{' (possibly after whitespace); a CBOR map
+    // has major type 5 (0xA0-0xBF); a MessagePack map is a fixmap
+    // (0x80-0x8F) or map16/map32 (0xDE/0xDF). The ranges don't overlap.
+    byte first = data[0];
+    if (first >= 0xA0 && first <= 0xBF) {
+        return json::from_cbor(data, data + length);
+    }
+    if ((first >= 0x80 && first <= 0x8F) || first == 0xDE || first == 0xDF) {
+        return json::from_msgpack(data, data + length);
+    }
+    return json::parse(data, data + length);
+}
+
+json NativeMessaging::AppendChunk(const json& frame) {
+    std::string streamId = frame.contains("stream") ? frame["stream"].dump() : "";
+    auto it = inboundStreams_.find(streamId);
+    if (it == inboundStreams_.end()) {
+        // Every open stream holds its data until its trailer comes
+        if (inboundStreams_.size() >= kMaxInboundStreams) {
+            throw std::runtime_error("Too many chunked messages in progress");
+        }
+        it = inboundStreams_.emplace(streamId, InboundStream()).first;
+    }
+    auto& stream = it->second;
     
-    // Write 4-byte length prefix (little-endian)
-    byte length_bytes[4] = {
-        static_cast<byte>(length & 0xFF),
-        static_cast<byte>((length >> 8) & 0xFF),
-        static_cast<byte>((length >> 16) & 0xFF),
-        static_cast<byte>((length >> 24) & 0xFF)
-    };
+    int64_t seq = frame.value("seq", static_cast<int64_t>(-1));
+    if (seq != stream.nextSeq) {
+        inboundStreams_.erase(streamId);
+        throw std::runtime_error("Chunk out of sequence on stream " + streamId);
+    }
+    ++stream.nextSeq;
+    
+    if (frame.value("final", false)) {
+        // The trailer's seq is the number of data chunks before it
+        std::string data = std::move(stream.data);
+        inboundStreams_.erase(streamId);
+        auto chunks = frame.find("chunks");
+        auto bytes = frame.find("bytes");
+        bool chunksMatch = chunks != frame.end() && chunks->is_number_unsigned()
+                           && chunks->get<uint64_t>() == static_cast<uint64_t>(seq);
+        bool bytesMatch = bytes != frame.end() && bytes->is_number_unsigned()
+                          && bytes->get<uint64_t>() == data.size();
+        if (!chunksMatch || !bytesMatch) {
+            throw std::runtime_error("Chunk trailer does not match the data on stream " + streamId);
+        }
+        return json::parse(data);
+    }
     
-    if (!WriteBytes(length_bytes, 4)) {
-        return false;
+    if (!frame.contains("data") || !frame["data"].is_string()) {
+        inboundStreams_.erase(streamId);
+        throw std::runtime_error("Chunk frame missing data on stream " + streamId);
     }
     
-    // Write message content
-    return WriteBytes(reinterpret_cast<const byte*>(message_str.c_str()), length);
+    const auto& piece = frame["data"].get_ref<const std::string&>();
+    if (stream.data.size() + piece.size() > kMaxReassembledSize) {
+        inboundStreams_.erase(streamId);
+        throw std::runtime_error("Chunked message exceeds size limit");
+    }
+    stream.data += piece;
+    return json();
+}
+
+bool NativeMessaging::SendMessage(json message, MessageEncoding encoding) {
+    if (encoding != MessageEncoding::Json) {
+        // Local clients have no frame cap, so binary frames are never chunked
+        std::string frame = AcquireWriteBuffer();
+        frame.assign(kPrefixSize, '\0');
+        if (encoding == MessageEncoding::Cbor) {
+            json::to_cbor(message, frame);
+        } else {
+            json::to_msgpack(message, frame);
+        }
+        bool ok = WriteFrame(frame);
+        ReleaseWriteBuffer(std::move(frame));
+        return ok;
+    }
+    
+    BinaryToBase64(message);
+    
+    const json* id = (message.is_object() && message.contains("id")) ? &message["id"] : nullptr;
+    
+    // Serialize straight into the framer; nothing holds the full text
+    // once the message is large enough to need chunking
+    FrameStreamBuf framer(id);
+    std::ostream out(&framer);
+    out << message;
+    
+    return out.good() && framer.Finish();
+}
+
+bool NativeMessaging::WriteFrame(std::string& frame) {
+    uint32_t length = static_cast<uint32_t>(frame.size() - kPrefixSize);
+    
+    // Fill in the reserved 4-byte length prefix (little-endian)
+    frame[0] = static_cast<char>(length & 0xFF);
+    frame[1] = static_cast<char>((length >> 8) & 0xFF);
+    frame[2] = static_cast<char>((length >> 16) & 0xFF);
+    frame[3] = static_cast<char>((length >> 24) & 0xFF);
+    
+    // One write per frame; the lock keeps frames from concurrent
+    // handlers from interleaving
+    std::lock_guard<std::mutex> lock(writeMutex_);
+    return WriteBytes(reinterpret_cast<const byte*>(frame.data()), frame.size());
 }
 
 json NativeMessaging::ProcessMessage(const json& message) {
     // Extract action from message
-    if (!message.contains("action")) {
+    if (!message.is_object() || !message.contains("action")) {
         return {
             {"success", false},
             {"error", "Missing 'action' field in message"}
         };
     }
     
-    std::string action = message["action"];
+    if (!message["action"].is_string()) {
+        return {
+            {"success", false},
+            {"error", "'action' must be a string"}
+        };
+    }
+    const std::string& action = message["action"].get_ref<const std::string&>();
     
     // Find handler
     auto it = handlers_.find(action);
@@ -131,7 +571,7 @@ json NativeMessaging::ProcessMessage(const json& message) {
     
     // Call handler
     try {
-        return it->second(message);
+        return it->second.handler(message);
     } catch (const std::exception& e) {
         return {
             {"success", false},
@@ -1,9 +1,13 @@
 #pragma once
 
 #include "common.h"
+#include "worker_pool.h"
 #include <nlohmann/json.hpp>
 #include <iostream>
 #include <functional>
+#include <map>
+#include <mutex>
+#include <atomic>
 
 using json = nlohmann::json;
 
@@ -13,42 +17,203 @@ using json = nlohmann::json;
  * Implements Chrome's Native Messaging protocol:
  * - Reads 4-byte length prefix from stdin
  * - Reads JSON message
- * - Processes and routes to handlers
+ * - Dispatches to handlers on a worker pool so the reader never blocks
  * - Writes response with 4-byte length prefix to stdout
+ *
+ * Responses are written as soon as each handler finishes, so they may
+ * arrive out of order. A request carrying an "id" field gets the same
+ * "id" echoed back in its response for correlation.
+ *
+ * Each handler is assigned a lane with its own workers, so cheap control
+ * messages never queue behind captures or long action batches. A handler
+ * may pick its lane per message; a long-polling poll goes to the wait
+ * lane, so parked polls can't hold up ping and cancel.
+ *
+ * Chrome drops host messages over 1 MB. Larger responses are serialized
+ * straight into a sequence of chunk frames followed by a trailer:
+ *   {"chunked": true, "stream": 3, "seq": 0, "data": "<json text>"}
+ *   {"chunked": true, "stream": 3, "seq": 5, "final": true, ...}
+ * Concatenating the "data" strings in seq order yields the original JSON.
+ * Inbound messages may use the same framing and are reassembled before
+ * dispatch.
+ *
+ * A local client can switch the connection to CBOR or MessagePack by
+ * listing "encodings" in its ping; the ping reply names the chosen one and
+ * responses to every message read after the ping use it. Each message's
+ * encoding is fixed when it is dispatched, so replies still in flight on
+ * other lanes keep the encoding their request was sent under. Binary values (json::binary) travel as raw bytes
+ * in binary encodings and as base64 strings in JSON. Inbound frames are
+ * decoded by sniffing their first byte, so either side may lag the switch.
  */
+
+// Wire encoding of a frame body
+enum class MessageEncoding {
+    Json,         // default; the only encoding Chrome speaks
+    Cbor,
+    MessagePack
+};
+
+// Dispatch lane a handler runs on
+enum class DispatchLane {
+    Control,   // ping, poll, cancel - must always answer quickly
+    Standard,  // everything not classified otherwise
+    Heavy,     // screen capture, UI tree walks, action batches
+    Wait       // long-polls, which hold their worker until they wake
+};
+
 class NativeMessaging {
 public:
     using MessageHandler = std::function<json(const json&)>;
+    using LaneSelector = std::function<DispatchLane(const json&)>;
     
-    NativeMessaging();
+    // Concurrency limit per lane. Wait is the widest because each
+    // long-poll holds its worker for the duration of the wait; it stays
+    // above AsyncRequestManager::kMaxPollWaiters so polls over that cap,
+    // which answer at once, always find a worker.
+    NativeMessaging(size_t controlWorkers = 8,
+                    size_t standardWorkers = 2,
+                    size_t heavyWorkers = 2,
+                    size_t waitWorkers = 16);
     ~NativeMessaging();
     
-    // Register a handler for an action
-    void RegisterHandler(const std::string& action, MessageHandler handler);
+    // Register a handler for an action on the given lane
+    void RegisterHandler(const std::string& action, MessageHandler handler,
+                         DispatchLane lane = DispatchLane::Standard);
+    
+    // Register a handler whose lane depends on the message. The selector
+    // runs on the reader thread, so it must be cheap and must not throw.
+    void RegisterHandler(const std::string& action, MessageHandler handler,
+                         LaneSelector lane);
     
-    // Main message loop - reads from stdin, processes, writes to stdout
+    // Queue depth and concurrency counters for every lane
+    json GetDispatchStats();
+    
+    // Main message loop - reads from stdin, dispatches to workers.
+    // Returns after stdin closes and all in-flight responses are written.
     void Run();
     
-    // Send a message to browser (writes to stdout)
-    static bool SendMessage(const json& message);
+    // Send a message to browser (writes to stdout) in the given encoding.
+    // Thread-safe; each frame is written atomically with respect to other
+    // senders. JSON messages above the frame limit are sent as chunk frames.
+    static bool SendMessage(json message, MessageEncoding encoding = MessageEncoding::Json);
+    
+    // Encoding the reply to the message being handled on this thread goes
+    // out in, so a handler can prepare text for JSON connections. Only
+    // meaningful inside a handler.
+    static MessageEncoding ReplyEncoding() { return replyEncoding_; }
+    
+    // Max bytes in a single frame (Chrome's host-to-browser limit)
+    static constexpr size_t kMaxFrameSize = 1024 * 1024;
+    
+    // Serialized JSON text carried per chunk frame. Escaping can at most
+    // double it, which keeps every chunk frame under kMaxFrameSize.
+    static constexpr size_t kChunkDataSize = 256 * 1024;
+    
+    // Upper bound on a reassembled inbound message
+    static constexpr size_t kMaxReassembledSize = 64 * 1024 * 1024;
+    
+    // Inbound chunked messages that may be in reassembly at once
+    static constexpr size_t kMaxInboundStreams = 16;
+    
+    // Write one frame to stdout in a single call. The first 4 bytes of
+    // frame are a placeholder that is filled in with the body length.
+    static bool WriteFrame(std::string& frame);
+    
+    // Lease an empty output buffer from the pool / return it when done
+    static std::string AcquireWriteBuffer();
+    static void ReleaseWriteBuffer(std::string buffer);
     
 private:
-    // Read a message from stdin
-    static json ReadMessage();
+    // Reusable output buffers. Each send leases one, so once the pool has
+    // warmed up frames are serialized without allocating.
+    class FrameBufferPool {
+    public:
+        std::string Acquire();
+        void Release(std::string buffer);
+        
+    private:
+        static constexpr size_t kMaxPooled = 8;
+        static constexpr size_t kMaxPooledCapacity = 16 * 1024 * 1024;
+        
+        std::mutex mutex_;
+        std::vector<std::string> free_;
+    };
+    
+    // Read a message from stdin into readBuffer_ and parse it in place
+    json ReadMessage();
+    
+    // Decode a frame body in whichever encoding its first byte indicates
+    static json DecodeFrame(const byte* data, size_t length);
+    
+    // Pick the first encoding from the client's preference list we support
+    static MessageEncoding NegotiateEncoding(const json& offered);
+    
+    // Replace binary values with base64 strings for the JSON encoding
+    static void BinaryToBase64(json& value);
+    
+    // Accumulate an inbound chunk frame. Returns the reassembled message
+    // once its trailer arrives, null while more chunks are expected.
+    // Throws if the trailer's chunk and byte counts don't match what
+    // arrived, or a new stream would exceed kMaxInboundStreams.
+    json AppendChunk(const json& frame);
     
     // Process a message and return response
     json ProcessMessage(const json& message);
     
+    // Run a message on its lane's worker pool and send its response in
+    // the connection's current encoding. Reader thread only.
+    void Dispatch(json message);
+    
+    // Lane for an incoming message. Unknown actions go to Control,
+    // since their error response is cheap.
+    WorkerPool& LaneFor(const json& message);
+    
     // Read exactly n bytes from stdin
     static bool ReadBytes(byte* buffer, size_t count);
     
     // Write bytes to stdout
     static bool WriteBytes(const byte* buffer, size_t count);
     
+    struct Route {
+        MessageHandler handler;
+        LaneSelector lane;
+    };
+    
     // Map of action names to handlers
-    std::map<std::string, MessageHandler> handlers_;
+    std::map<std::string, Route> handlers_;
+    
+    // Inbound chunked messages being reassembled, keyed by stream id.
+    // Only touched by the reader thread.
+    struct InboundStream {
+        std::string data;
+        int64_t nextSeq = 0;
+    };
+    std::map<std::string, InboundStream> inboundStreams_;
     
     // Whether to keep running
-    bool running_;
+    std::atomic<bool> running_;
+    
+    // Serializes frames on stdout
+    static std::mutex writeMutex_;
+    
+    // Reply encoding of the message this worker is handling
+    static thread_local MessageEncoding replyEncoding_;
+    
+    // Output buffers shared by all senders
+    static FrameBufferPool writeBuffers_;
+    
+    // Inbound frame buffer, reused for every read. Reader thread only.
+    std::vector<byte> readBuffer_;
+    
+    // Encoding for responses to messages read from now on. Switched by a
+    // negotiating ping as it is dispatched. Reader thread only.
+    MessageEncoding encoding_ = MessageEncoding::Json;
+    
+    // Handlers run here, off the stdin reader thread.
+    // Declared last so they are joined before the members they use go away.
+    WorkerPool controlLane_;
+    WorkerPool standardLane_;
+    WorkerPool heavyLane_;
+    WorkerPool waitLane_;
 };
 
@@ -0,0 +1,181 @@
+#include "pixel_pool.h"
+#include <algorithm>
+#include <new>
+
+struct PixelLease::Block {
+    uint8_t* data;
+    size_t capacity;
+    uint64_t tag = 0;
+};
+
+// Shared by the pool and its leases, so a lease outliving the pool can
+// still hand its block back (which then just frees it)
+struct PixelLease::State {
+    std::mutex mutex;
+    size_t maxIdle;
+    bool open = true;                   // false once the pool is destroyed
+    std::vector<Block*> idle;
+    PixelPool::Stats stats = {};
+
+    static Block* Allocate(size_t capacity) {
+        auto* data = static_cast<uint8_t*>(
+            ::operator new(capacity, std::align_val_t(PixelPool::kPageSize)));
+        return new Block{data, capacity};
+    }
+
+    static void Free(Block* block) {
+        ::operator delete(block->data, std::align_val_t(PixelPool::kPageSize));
+        delete block;
+    }
+
+    // Called with the mutex held; returns blocks to free outside it
+    void DropExcessIdle(std::vector<Block*>& freed) {
+        while (idle.size() > maxIdle) {
+            auto smallest = std::min_element(idle.begin(), idle.end(), [](Block* a, Block* b) {
+                return a->capacity < b->capacity;
+            });
+            stats.reservedBytes -= (*smallest)->capacity;
+            freed.push_back(*smallest);
+            idle.erase(smallest);
+        }
+        stats.idle = idle.size();
+    }
+};
+
+PixelLease& PixelLease::operator=(PixelLease&& other) noexcept {
+    if (this != &other) {
+        Release();
+        pool_ = std::move(other.pool_);
+        block_ = other.block_;
+        data_ = other.data_;
+        size_ = other.size_;
+        other.block_ = nullptr;
+        other.data_ = nullptr;
+        other.size_ = 0;
+    }
+    return *this;
+}
+
+uint64_t PixelLease::Tag() const {
+    return block_ ? block_->tag : 0;
+}
+
+void PixelLease::SetTag(uint64_t tag) {
+    if (block_) block_->tag = tag;
+}
+
+void PixelLease::Release() {
+    if (!block_) return;
+
+    std::vector<Block*> freed;
+    {
+        std::lock_guard<std::mutex> lock(pool_->mutex);
+        --pool_->stats.leased;
+        pool_->stats.leasedBytes -= block_->capacity;
+        if (pool_->open) {
+            pool_->idle.push_back(block_);
+            pool_->DropExcessIdle(freed);
+        } else {
+            pool_->stats.reservedBytes -= block_->capacity;
+            freed.push_back(block_);
+        }
+    }
+    for (Block* block : freed) {
+        State::Free(block);
+    }
+
+    pool_.reset();
+    block_ = nullptr;
+    data_ = nullptr;
+    size_ = 0;
+}
+
+PixelPool::PixelPool(size_t maxIdle)
+    : state_(std::make_shared<PixelLease::State>()) {
+    state_->maxIdle = maxIdle;
+}
+
+PixelPool::~PixelPool() {
+    std::vector<PixelLease::Block*> idle;
+    {
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        state_->open = false;
+        idle.swap(state_->idle);
+    }
+    for (auto* block : idle) {
+        PixelLease::State::Free(block);
+    }
+}
+
+PixelLease PixelPool::Acquire(size_t bytes) {
+    PixelLease lease;
+    if (bytes == 0) {
+        return lease;
+    }
+    size_t capacity = (bytes + kPageSize - 1) / kPageSize * kPageSize;
+
+    PixelLease::Block* block = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        // Smallest idle block that fits and is not more than twice the
+        // request, so a small buffer never pins a desktop-sized block
+        auto best = state_->idle.end();
+        for (auto it = state_->idle.begin(); it != state_->idle.end(); ++it) {
+            size_t have = (*it)->capacity;
+            if (have >= capacity && have / 2 <= capacity &&
+                (best == state_->idle.end() || have < (*best)->capacity)) {
+                best = it;
+            }
+        }
+        if (best != state_->idle.end()) {
+            block = *best;
+            state_->idle.erase(best);
+            ++state_->stats.reuses;
+        }
+    }
+
+    bool allocated = !block;
+    if (allocated) {
+        block = PixelLease::State::Allocate(capacity);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        Stats& stats = state_->stats;
+        if (allocated) {
+            ++stats.allocations;
+            stats.reservedBytes += block->capacity;
+            stats.peakReservedBytes = std::max(stats.peakReservedBytes, stats.reservedBytes);
+        }
+        ++stats.leased;
+        stats.leasedBytes += block->capacity;
+        stats.peakLeased = std::max(stats.peakLeased, stats.leased);
+        stats.idle = state_->idle.size();
+    }
+
+    lease.pool_ = state_;
+    lease.block_ = block;
+    lease.data_ = block->data;
+    lease.size_ = bytes;
+    return lease;
+}
+
+void PixelPool::Trim() {
+    std::vector<PixelLease::Block*> idle;
+    {
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        idle.swap(state_->idle);
+        for (auto* block : idle) {
+            state_->stats.reservedBytes -= block->capacity;
+        }
+        state_->stats.idle = 0;
+    }
+    for (auto* block : idle) {
+        PixelLease::State::Free(block);
+    }
+}
+
+PixelPool::Stats PixelPool::GetStats() const {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    return state_->stats;
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+class PixelPool;
+
+/**
+ * Pixel Lease
+ *
+ * Exclusive use of one page-aligned block from a PixelPool. The block is
+ * NOT initialized: a new lease holds whatever its last user left there
+ * (see Tag). Move-only; the block goes back to the pool when the lease is
+ * destroyed or reassigned, even if the pool itself is gone by then.
+ */
+class PixelLease {
+public:
+    PixelLease() = default;
+    ~PixelLease() { Release(); }
+
+    PixelLease(PixelLease&& other) noexcept { *this = std::move(other); }
+    PixelLease& operator=(PixelLease&& other) noexcept;
+    PixelLease(const PixelLease&) = delete;
+    PixelLease& operator=(const PixelLease&) = delete;
+
+    bool Empty() const { return size_ == 0; }
+    size_t Size() const { return size_; }     // bytes requested
+    uint8_t* Data() { return data_; }
+    const uint8_t* Data() const { return data_; }
+
+    // Owner-defined note about the block's contents, kept across leases
+    // of the same block (e.g. which frame generation it holds). 0 until
+    // someone sets it.
+    uint64_t Tag() const;
+    void SetTag(uint64_t tag);
+
+    // Return the block to the pool now
+    void Release();
+
+private:
+    friend class PixelPool;
+    struct State;
+    struct Block;
+
+    std::shared_ptr<State> pool_;
+    Block* block_ = nullptr;
+    uint8_t* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+/**
+ * Pixel Pool
+ *
+ * Recycles large pixel buffers (whole-desktop frames are tens of MB) so
+ * steady-state capture does no large allocations: a block released by
+ * one frame is leased again by a later one. Blocks are page-aligned and
+ * never zero-filled, since every byte handed out is about to be
+ * overwritten anyway.
+ *
+ * Thread-safe. Counters include high-water marks so the pool can be
+ * sized from real use.
+ */
+class PixelPool {
+public:
+    static constexpr size_t kPageSize = 4096;
+
+    // Up to maxIdle released blocks are kept for reuse; beyond that the
+    // smallest idle blocks are freed
+    explicit PixelPool(size_t maxIdle = 4);
+    ~PixelPool();
+
+    PixelPool(const PixelPool&) = delete;
+    PixelPool& operator=(const PixelPool&) = delete;
+
+    // A block of at least bytes. Reuses the smallest idle block that fits
+    // without wasting more than half of it; allocates otherwise.
+    PixelLease Acquire(size_t bytes);
+
+    // Free every idle block
+    void Trim();
+
+    struct Stats {
+        uint64_t allocations;     // blocks allocated since start
+        uint64_t reuses;          // leases served from idle blocks
+        size_t leased;            // blocks currently leased
+        size_t peakLeased;        // high-water mark of leased
+        size_t idle;              // blocks waiting for reuse
+        size_t leasedBytes;       // capacity of leased blocks
+        size_t reservedBytes;     // capacity of leased + idle blocks
+        size_t peakReservedBytes; // high-water mark of reservedBytes
+    };
+    Stats GetStats() const;
+
+private:
+    std::shared_ptr<PixelLease::State> state_;
+};
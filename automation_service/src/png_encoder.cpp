@@ -0,0 +1,789 @@
+#include "png_encoder.h"
+#include "worker_pool.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <utility>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PNG_ENCODER_SSE2 1
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#define PNG_ENCODER_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace {
+
+// Strips smaller than this are not worth a thread and lose too much
+// compression at their edges
+constexpr size_t kMinStripBytes = 512 * 1024;
+
+// Filter types
+constexpr uint8_t kFilterNone = 0;
+constexpr uint8_t kFilterSub = 1;
+constexpr uint8_t kFilterUp = 2;
+constexpr uint8_t kFilterPaeth = 4;
+
+struct CrcTable {
+    uint32_t entries[256];
+    CrcTable() {
+        for (uint32_t n = 0; n < 256; ++n) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; ++k) {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            entries[n] = c;
+        }
+    }
+};
+
+uint32_t Crc32(const uint8_t* data, size_t size) {
+    static const CrcTable table;
+    uint32_t c = 0xFFFFFFFFu;
+    for (size_t i = 0; i < size; ++i) {
+        c = table.entries[(c ^ data[i]) & 0xFF] ^ (c >> 8);
+    }
+    return c ^ 0xFFFFFFFFu;
+}
+
+inline uint8_t* PutBigEndian(uint8_t* p, uint32_t value) {
+    p[0] = static_cast<uint8_t>(value >> 24);
+    p[1] = static_cast<uint8_t>(value >> 16);
+    p[2] = static_cast<uint8_t>(value >> 8);
+    p[3] = static_cast<uint8_t>(value);
+    return p + 4;
+}
+
+// Length, type, data and CRC; returns the end of the chunk
+uint8_t* WriteChunk(uint8_t* p, const char* type, const uint8_t* data, uint32_t size) {
+    uint8_t* start = PutBigEndian(p, size);
+    std::memcpy(start, type, 4);
+    if (size) {
+        std::memcpy(start + 4, data, size);
+    }
+    return PutBigEndian(start + 4 + size, Crc32(start, size + 4));
+}
+
+void ConvertRow(const uint8_t* bgra, int width, bool alpha, uint8_t* out) {
+    if (alpha) {
+        for (int x = 0; x < width; ++x, bgra += 4, out += 4) {
+            out[0] = bgra[2];
+            out[1] = bgra[1];
+            out[2] = bgra[0];
+            out[3] = bgra[3];
+        }
+    } else {
+        for (int x = 0; x < width; ++x, bgra += 4, out += 3) {
+            out[0] = bgra[2];
+            out[1] = bgra[1];
+            out[2] = bgra[0];
+        }
+    }
+}
+
+// Up to 256 colors (0xRRGGBB) and their palette indices, in the order
+// they were added. Open addressing at a load of at most 1/4.
+class ColorTable {
+public:
+    ColorTable() { std::memset(keys_, 0, sizeof(keys_)); }
+
+    // Index of color, adding it if it is new; -1 if 256 are taken
+    int Insert(uint32_t color) {
+        uint32_t key = color | kUsed;
+        for (size_t slot = Slot(color);; slot = (slot + 1) % kSlots) {
+            if (keys_[slot] == key) return values_[slot];
+            if (keys_[slot] == 0) {
+                if (size_ == 256) return -1;
+                keys_[slot] = key;
+                values_[slot] = static_cast<uint8_t>(size_);
+                colors_[size_] = color;
+                return size_++;
+            }
+        }
+    }
+
+    // Index of a color that was added
+    uint8_t Find(uint32_t color) const {
+        uint32_t key = color | kUsed;
+        size_t slot = Slot(color);
+        while (keys_[slot] != key) {
+            slot = (slot + 1) % kSlots;
+        }
+        return values_[slot];
+    }
+
+    int Size() const { return size_; }
+    uint32_t Color(int index) const { return colors_[index]; }
+
+private:
+    static constexpr size_t kSlots = 1024;
+    static constexpr uint32_t kUsed = 0x1000000;
+
+    static size_t Slot(uint32_t color) { return (color * 0x9E3779B1u) >> 22; }
+
+    uint32_t keys_[kSlots];
+    uint8_t values_[kSlots];
+    uint32_t colors_[256];
+    int size_ = 0;
+};
+
+inline uint32_t LoadColor(const uint8_t* bgra) {
+    uint32_t pixel;
+    std::memcpy(&pixel, bgra, 4);
+    return pixel & 0xFFFFFF;     // little-endian BGRA: 0xRRGGBB
+}
+
+// Add every color of view to table; false as soon as there are more
+// than 256. Every 16th row is read first, so a busy image is usually
+// turned away after a sample, and runs of one color cost a compare.
+bool CollectColors(const FrameView& view, ColorTable& table) {
+    constexpr int kInterleave = 16;
+    for (int phase = 0; phase < kInterleave; ++phase) {
+        for (int y = phase; y < view.Height(); y += kInterleave) {
+            const uint8_t* row = view.Row(y);
+            uint32_t last = ~0u;
+            for (int x = 0; x < view.Width(); ++x) {
+                uint32_t color = LoadColor(row + static_cast<size_t>(x) * 4);
+                if (color != last) {
+                    last = color;
+                    if (table.Insert(color) < 0) return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+// Colors are quantized to 5 bits per channel for the median cut
+inline uint32_t Bin15(uint32_t color) {
+    return ((color >> 9) & 0x7C00) | ((color >> 6) & 0x3E0) | ((color >> 3) & 0x1F);
+}
+
+// Median cut: split the color space of view into at most 256 boxes of
+// 5-bit-per-channel bins, each time cutting the box with the most
+// pixels times its longest side at the pixel median of that side. Each
+// box's entry is the mean of its pixels; map takes every bin to its box.
+int MedianCut(const FrameView& view, uint8_t* palette, std::vector<uint8_t>& map) {
+    constexpr int kBins = 32768;
+    std::vector<uint32_t> counts(kBins, 0);
+    std::vector<uint64_t> sums(static_cast<size_t>(kBins) * 3, 0);
+    for (int y = 0; y < view.Height(); ++y) {
+        const uint8_t* row = view.Row(y);
+        for (int x = 0; x < view.Width();) {
+            uint32_t color = LoadColor(row + static_cast<size_t>(x) * 4);
+            int run = 1;
+            while (x + run < view.Width() && LoadColor(row + static_cast<size_t>(x + run) * 4) == color) {
+                ++run;
+            }
+            uint32_t bin = Bin15(color);
+            counts[bin] += run;
+            sums[bin * 3] += static_cast<uint64_t>(color >> 16) * run;
+            sums[bin * 3 + 1] += static_cast<uint64_t>((color >> 8) & 0xFF) * run;
+            sums[bin * 3 + 2] += static_cast<uint64_t>(color & 0xFF) * run;
+            x += run;
+        }
+    }
+
+    // Channels in bin order: red (bits 10-14), green, blue
+    struct Box {
+        int lo[3];
+        int hi[3];
+        uint64_t count;
+    };
+    auto binOf = [](const int* c) { return (c[0] << 10) | (c[1] << 5) | c[2]; };
+    auto forEachBin = [&binOf](const Box& box, auto&& visit) {
+        int c[3];
+        for (c[0] = box.lo[0]; c[0] <= box.hi[0]; ++c[0]) {
+            for (c[1] = box.lo[1]; c[1] <= box.hi[1]; ++c[1]) {
+                for (c[2] = box.lo[2]; c[2] <= box.hi[2]; ++c[2]) {
+                    visit(c, static_cast<uint32_t>(binOf(c)));
+                }
+            }
+        }
+    };
+    // Tighten a box to the bins it has pixels in
+    auto shrink = [&](Box& box) {
+        Box tight = {{31, 31, 31}, {0, 0, 0}, 0};
+        forEachBin(box, [&](const int* c, uint32_t bin) {
+            if (counts[bin] == 0) return;
+            for (int k = 0; k < 3; ++k) {
+                tight.lo[k] = std::min(tight.lo[k], c[k]);
+                tight.hi[k] = std::max(tight.hi[k], c[k]);
+            }
+            tight.count += counts[bin];
+        });
+        box = tight;
+    };
+
+    std::vector<Box> boxes = {{{0, 0, 0}, {31, 31, 31}, 0}};
+    shrink(boxes[0]);
+    while (boxes.size() < 256) {
+        // The box to cut, and along which channel
+        int best = -1, axis = 0;
+        uint64_t bestScore = 0;
+        for (size_t i = 0; i < boxes.size(); ++i) {
+            for (int k = 0; k < 3; ++k) {
+                uint64_t score = boxes[i].count * static_cast<uint64_t>(boxes[i].hi[k] - boxes[i].lo[k]);
+                if (score > bestScore) {
+                    bestScore = score;
+                    best = static_cast<int>(i);
+                    axis = k;
+                }
+            }
+        }
+        if (best < 0) break;    // every box is a single bin
+
+        Box& box = boxes[best];
+        std::vector<uint64_t> along(32, 0);
+        forEachBin(box, [&](const int* c, uint32_t bin) { along[c[axis]] += counts[bin]; });
+        int cut = box.lo[axis];
+        for (uint64_t below = along[cut]; cut + 1 < box.hi[axis] && below * 2 < box.count;) {
+            below += along[++cut];
+        }
+        Box upper = box;
+        box.hi[axis] = cut;
+        upper.lo[axis] = cut + 1;
+        shrink(box);
+        shrink(upper);
+        boxes.push_back(upper);
+    }
+
+    map.assign(kBins, 0);
+    for (size_t i = 0; i < boxes.size(); ++i) {
+        uint64_t total[3] = {0, 0, 0};
+        forEachBin(boxes[i], [&](const int*, uint32_t bin) {
+            for (int k = 0; k < 3; ++k) total[k] += sums[bin * 3 + k];
+            map[bin] = static_cast<uint8_t>(i);
+        });
+        uint64_t count = std::max<uint64_t>(boxes[i].count, 1);
+        for (int k = 0; k < 3; ++k) {
+            palette[i * 3 + k] = static_cast<uint8_t>((total[k] + count / 2) / count);
+        }
+    }
+    return static_cast<int>(boxes.size());
+}
+
+// Row filters. The first bpp bytes have no left neighbour (a = c = 0);
+// the rest are independent of each other when encoding, so every filter
+// vectorizes with plain unaligned loads.
+
+void FilterSub(const uint8_t* cur, size_t n, size_t bpp, uint8_t* out) {
+    size_t i = 0;
+    for (; i < bpp && i < n; ++i) {
+        out[i] = cur[i];
+    }
+#if defined(PNG_ENCODER_SSE2)
+    for (; i + 16 <= n; i += 16) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(cur + i));
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(cur + i - bpp));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_sub_epi8(x, a));
+    }
+#elif defined(PNG_ENCODER_NEON)
+    for (; i + 16 <= n; i += 16) {
+        vst1q_u8(out + i, vsubq_u8(vld1q_u8(cur + i), vld1q_u8(cur + i - bpp)));
+    }
+#endif
+    for (; i < n; ++i) {
+        out[i] = static_cast<uint8_t>(cur[i] - cur[i - bpp]);
+    }
+}
+
+void FilterUp(const uint8_t* cur, const uint8_t* prev, size_t n, uint8_t* out) {
+    size_t i = 0;
+#if defined(PNG_ENCODER_SSE2)
+    for (; i + 16 <= n; i += 16) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(cur + i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(prev + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_sub_epi8(x, b));
+    }
+#elif defined(PNG_ENCODER_NEON)
+    for (; i + 16 <= n; i += 16) {
+        vst1q_u8(out + i, vsubq_u8(vld1q_u8(cur + i), vld1q_u8(prev + i)));
+    }
+#endif
+    for (; i < n; ++i) {
+        out[i] = static_cast<uint8_t>(cur[i] - prev[i]);
+    }
+}
+
+inline uint8_t PaethPredictor(int a, int b, int c) {
+    int pa = std::abs(b - c);
+    int pb = std::abs(a - c);
+    int pc = std::abs(a + b - 2 * c);
+    if (pa <= pb && pa <= pc) return static_cast<uint8_t>(a);
+    return static_cast<uint8_t>(pb <= pc ? b : c);
+}
+
+#if defined(PNG_ENCODER_SSE2)
+inline __m128i Abs16(__m128i v) {
+    return _mm_max_epi16(v, _mm_sub_epi16(_mm_setzero_si128(), v));
+}
+
+// Paeth predictor on eight 16-bit lanes
+inline __m128i Paeth8(__m128i a, __m128i b, __m128i c) {
+    __m128i ac = _mm_sub_epi16(a, c);
+    __m128i bc = _mm_sub_epi16(b, c);
+    __m128i pa = Abs16(bc);
+    __m128i pb = Abs16(ac);
+    __m128i pc = Abs16(_mm_add_epi16(ac, bc));
+    __m128i notA = _mm_or_si128(_mm_cmpgt_epi16(pa, pb), _mm_cmpgt_epi16(pa, pc));
+    __m128i notB = _mm_cmpgt_epi16(pb, pc);
+    __m128i bOrC = _mm_or_si128(_mm_and_si128(notB, c), _mm_andnot_si128(notB, b));
+    return _mm_or_si128(_mm_and_si128(notA, bOrC), _mm_andnot_si128(notA, a));
+}
+#elif defined(PNG_ENCODER_NEON)
+inline uint8x8_t Paeth8(uint8x8_t a, uint8x8_t b, uint8x8_t c) {
+    uint16x8_t pa = vabdl_u8(b, c);
+    uint16x8_t pb = vabdl_u8(a, c);
+    int16x8_t ac = vreinterpretq_s16_u16(vsubl_u8(a, c));
+    int16x8_t bc = vreinterpretq_s16_u16(vsubl_u8(b, c));
+    uint16x8_t pc = vreinterpretq_u16_s16(vabsq_s16(vaddq_s16(ac, bc)));
+    uint8x8_t useA = vmovn_u16(vandq_u16(vcleq_u16(pa, pb), vcleq_u16(pa, pc)));
+    uint8x8_t useB = vmovn_u16(vcleq_u16(pb, pc));
+    return vbsl_u8(useA, a, vbsl_u8(useB, b, c));
+}
+#endif
+
+void FilterPaeth(const uint8_t* cur, const uint8_t* prev, size_t n, size_t bpp, uint8_t* out) {
+    size_t i = 0;
+    for (; i < bpp && i < n; ++i) {
+        out[i] = static_cast<uint8_t>(cur[i] - prev[i]);
+    }
+#if defined(PNG_ENCODER_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 16 <= n; i += 16) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(cur + i));
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(cur + i - bpp));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(prev + i));
+        __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(prev + i - bpp));
+        __m128i low = Paeth8(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero), _mm_unpacklo_epi8(c, zero));
+        __m128i high = Paeth8(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero), _mm_unpackhi_epi8(c, zero));
+        __m128i predicted = _mm_packus_epi16(low, high);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_sub_epi8(x, predicted));
+    }
+#elif defined(PNG_ENCODER_NEON)
+    for (; i + 16 <= n; i += 16) {
+        uint8x16_t a = vld1q_u8(cur + i - bpp);
+        uint8x16_t b = vld1q_u8(prev + i);
+        uint8x16_t c = vld1q_u8(prev + i - bpp);
+        uint8x16_t predicted = vcombine_u8(Paeth8(vget_low_u8(a), vget_low_u8(b), vget_low_u8(c)),
+                                           Paeth8(vget_high_u8(a), vget_high_u8(b), vget_high_u8(c)));
+        vst1q_u8(out + i, vsubq_u8(vld1q_u8(cur + i), predicted));
+    }
+#endif
+    for (; i < n; ++i) {
+        out[i] = static_cast<uint8_t>(cur[i] - PaethPredictor(cur[i - bpp], prev[i], prev[i - bpp]));
+    }
+}
+
+// Sum of the bytes as signed magnitudes: the usual estimate of how well
+// a filtered row compresses
+uint64_t RowCost(const uint8_t* row, size_t n) {
+    uint64_t total = 0;
+    size_t i = 0;
+#if defined(PNG_ENCODER_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    __m128i sum = zero;
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i));
+        __m128i magnitude = _mm_min_epu8(v, _mm_sub_epi8(zero, v));
+        sum = _mm_add_epi64(sum, _mm_sad_epu8(magnitude, zero));
+    }
+    uint64_t lanes[2];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), sum);
+    total = lanes[0] + lanes[1];
+#elif defined(PNG_ENCODER_NEON)
+    uint32x4_t sum = vdupq_n_u32(0);
+    for (; i + 16 <= n; i += 16) {
+        uint8x16_t magnitude = vreinterpretq_u8_s8(vabsq_s8(vreinterpretq_s8_u8(vld1q_u8(row + i))));
+        sum = vpadalq_u16(sum, vpaddlq_u8(magnitude));
+    }
+    uint64x2_t wide = vpaddlq_u32(sum);
+    total = vgetq_lane_u64(wide, 0) + vgetq_lane_u64(wide, 1);
+#endif
+    for (; i < n; ++i) {
+        total += static_cast<uint64_t>(std::abs(static_cast<int>(static_cast<int8_t>(row[i]))));
+    }
+    return total;
+}
+
+// Filter one row into out (type byte, then the bytes) with the cheapest
+// filter. scratch holds three rows. An unchanged row (Up is all zeros)
+// is the common case on screen and skips the other candidates.
+void FilterRow(const uint8_t* cur, const uint8_t* prev, size_t n, size_t bpp,
+               uint8_t* scratch, uint8_t* out) {
+    uint8_t* up = scratch;
+    uint8_t* sub = scratch + n;
+    uint8_t* paeth = scratch + 2 * n;
+
+    FilterUp(cur, prev, n, up);
+    uint8_t type = kFilterUp;
+    const uint8_t* best = up;
+    uint64_t bestCost = RowCost(up, n);
+    if (bestCost > 0) {
+        uint64_t cost = RowCost(cur, n);
+        if (cost < bestCost) {
+            type = kFilterNone;
+            best = cur;
+            bestCost = cost;
+        }
+        FilterSub(cur, n, bpp, sub);
+        cost = RowCost(sub, n);
+        if (cost < bestCost) {
+            type = kFilterSub;
+            best = sub;
+            bestCost = cost;
+        }
+        FilterPaeth(cur, prev, n, bpp, paeth);
+        cost = RowCost(paeth, n);
+        if (cost < bestCost) {
+            type = kFilterPaeth;
+            best = paeth;
+        }
+    }
+    out[0] = type;
+    std::memcpy(out + 1, best, n);
+}
+
+}  // namespace
+
+struct PngEncoder::Workspace {
+    DeflateEncoder deflate;
+    std::vector<uint8_t> rows;      // previous, current, three filter candidates
+    std::vector<uint8_t> filtered;  // type byte + filtered bytes per row
+    std::vector<uint8_t> chunk;     // the strip's IDAT chunk, CRC included
+};
+
+struct PngEncoder::Strip {
+    int top = 0;
+    int bottom = 0;
+    bool first = false;
+    bool last = false;
+    uint32_t adler = 1;             // of the filtered bytes
+    size_t filteredSize = 0;
+    std::unique_ptr<Workspace> workspace;
+};
+
+struct PngEncoder::Format {
+    bool alpha = false;
+    bool indexed = false;
+    int depth = 8;                  // bits per index
+    int colors = 0;
+    uint8_t palette[256 * 3];       // RGB entries
+    ColorTable exact;               // color to index, unless quantized
+    std::vector<uint8_t> quantized; // 15-bit bin to index of a median-cut palette
+
+    // Bytes of one unfiltered row
+    size_t RowBytes(int width) const {
+        if (indexed) return (static_cast<size_t>(width) * depth + 7) / 8;
+        return static_cast<size_t>(width) * (alpha ? 4 : 3);
+    }
+
+    // A row of BGRA pixels as packed palette indices
+    void IndexRow(const uint8_t* bgra, int width, uint8_t* out) const {
+        uint32_t last = ~0u;
+        uint8_t index = 0;
+        if (depth < 8) {
+            std::memset(out, 0, RowBytes(width));
+        }
+        for (int x = 0; x < width; ++x) {
+            uint32_t color = LoadColor(bgra + static_cast<size_t>(x) * 4);
+            if (color != last) {
+                last = color;
+                index = quantized.empty() ? exact.Find(color) : quantized[Bin15(color)];
+            }
+            if (depth == 8) {
+                out[x] = index;
+            } else {
+                // Leftmost pixel in the high bits
+                int bit = x * depth;
+                out[bit >> 3] |= static_cast<uint8_t>(index << (8 - depth - (bit & 7)));
+            }
+        }
+    }
+};
+
+PngEncoder::PngEncoder(const Options& options)
+    : options_(options) {
+    if (options_.threads <= 0) {
+        options_.threads = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+    }
+}
+
+PngEncoder::~PngEncoder() = default;
+
+bool PngEncoder::Encode(const FrameView& view, std::vector<uint8_t>& out) {
+    Format format;
+    ChooseFormat(view, format);
+    std::vector<Strip> strips;
+    if (!EncodeStrips(view, format, strips)) {
+        out.clear();
+        return false;
+    }
+    out.resize(AssembledSize(format, strips));
+    Assemble(view, format, strips, out.data());
+    for (auto& strip : strips) {
+        ReleaseWorkspace(std::move(strip.workspace));
+    }
+    return true;
+}
+
+size_t PngEncoder::Encode(const FrameView& view, uint8_t* out, size_t capacity) {
+    Format format;
+    ChooseFormat(view, format);
+    std::vector<Strip> strips;
+    if (!EncodeStrips(view, format, strips)) {
+        return 0;
+    }
+    size_t size = AssembledSize(format, strips);
+    if (size <= capacity) {
+        Assemble(view, format, strips, out);
+    } else {
+        size = 0;
+    }
+    for (auto& strip : strips) {
+        ReleaseWorkspace(std::move(strip.workspace));
+    }
+    return size;
+}
+
+bool PngEncoder::Encode(const FrameView& view, const Sink& sink) {
+    if (view.Empty()) {
+        return false;
+    }
+    Format format;
+    ChooseFormat(view, format);
+    uint8_t header[kMaxHeaderSize];
+    WriteHeader(view, format, header);
+    sink(header, HeaderSize(format));
+
+    uint32_t adler = 1;
+    std::vector<Strip> strips;
+    EncodeStrips(view, format, strips, [&](Strip& strip) {
+        const auto& chunk = strip.workspace->chunk;
+        sink(chunk.data(), chunk.size());
+        adler = strip.first ? strip.adler : Adler32Combine(adler, strip.adler, strip.filteredSize);
+        ReleaseWorkspace(std::move(strip.workspace));
+    });
+
+    uint8_t trailer[kTrailerSize];
+    WriteTrailer(adler, trailer);
+    sink(trailer, sizeof(trailer));
+    return true;
+}
+
+size_t PngEncoder::MaxEncodedSize(int width, int height, bool alpha) {
+    if (width <= 0 || height <= 0) {
+        return 0;
+    }
+    // Everything stored: a 5-byte header per 64 KB and per deflate block
+    // (blocks hold at least 32 KB), plus chunk and flush overhead per
+    // strip (at most one per row) and room for a palette. Indexed rows
+    // are smaller than RGB ones.
+    size_t filtered = (static_cast<size_t>(width) * (alpha ? 4 : 3) + 1) * height;
+    return filtered + filtered / 2048 + static_cast<size_t>(height) * 32 + kMaxHeaderSize + kTrailerSize + 128;
+}
+
+void PngEncoder::ChooseFormat(const FrameView& view, Format& format) const {
+    format.alpha = options_.alpha;
+    if (options_.alpha || options_.palette == Palette::Off || view.Empty()) {
+        return;
+    }
+    if (CollectColors(view, format.exact)) {
+        format.colors = format.exact.Size();
+        for (int i = 0; i < format.colors; ++i) {
+            uint32_t color = format.exact.Color(i);
+            format.palette[i * 3] = static_cast<uint8_t>(color >> 16);
+            format.palette[i * 3 + 1] = static_cast<uint8_t>(color >> 8);
+            format.palette[i * 3 + 2] = static_cast<uint8_t>(color);
+        }
+    } else if (options_.palette == Palette::Quantize) {
+        format.colors = MedianCut(view, format.palette, format.quantized);
+    } else {
+        return;
+    }
+    format.indexed = true;
+    format.depth = format.colors <= 2 ? 1 : format.colors <= 4 ? 2 : format.colors <= 16 ? 4 : 8;
+}
+
+bool PngEncoder::EncodeStrips(const FrameView& view, const Format& format, std::vector<Strip>& strips,
+                              const std::function<void(Strip&)>& done) {
+    if (view.Empty()) {
+        return false;
+    }
+    int height = view.Height();
+    size_t rowBytes = format.RowBytes(view.Width());
+    size_t filteredSize = (rowBytes + 1) * height;
+
+    size_t count = std::min<size_t>(filteredSize / kMinStripBytes, options_.threads);
+    count = std::max<size_t>(std::min<size_t>(count, height), 1);
+    int rowsPerStrip = static_cast<int>((height + count - 1) / count);
+    count = (height + rowsPerStrip - 1) / rowsPerStrip;
+
+    strips.resize(count);
+    for (size_t s = 0; s < count; ++s) {
+        Strip& strip = strips[s];
+        strip.top = static_cast<int>(s) * rowsPerStrip;
+        strip.bottom = std::min(strip.top + rowsPerStrip, height);
+        strip.first = s == 0;
+        strip.last = s + 1 == count;
+        strip.workspace = AcquireWorkspace();
+    }
+
+    // The rest go to the shared strip pool; the calling thread takes the
+    // first strip, then hands each one on in order as it finishes
+    TaskGroup group(WorkerPool::Strips());
+    std::vector<size_t> tasks(count);
+    for (size_t s = 1; s < count; ++s) {
+        tasks[s] = group.Run([this, &view, &format, &strips, s] { EncodeStrip(view, format, strips[s]); });
+    }
+    EncodeStrip(view, format, strips[0]);
+    if (done) {
+        done(strips[0]);
+    }
+    for (size_t s = 1; s < count; ++s) {
+        group.Wait(tasks[s]);
+        if (done) {
+            done(strips[s]);
+        }
+    }
+    return true;
+}
+
+void PngEncoder::EncodeStrip(const FrameView& view, const Format& format, Strip& strip) {
+    Workspace& work = *strip.workspace;
+    bool alpha = format.alpha;
+    int width = view.Width();
+    size_t rowBytes = format.RowBytes(width);
+    size_t bpp = format.indexed ? 1 : alpha ? 4 : 3;
+
+    strip.filteredSize = (rowBytes + 1) * (strip.bottom - strip.top);
+    work.filtered.resize(strip.filteredSize);
+    uint8_t* out = work.filtered.data();
+
+    if (format.indexed) {
+        // Palette indices are labels, not intensities: the filters would
+        // only scramble them, so every row goes out unfiltered
+        for (int y = strip.top; y < strip.bottom; ++y) {
+            out[0] = kFilterNone;
+            format.IndexRow(view.Row(y), width, out + 1);
+            out += rowBytes + 1;
+        }
+    } else {
+        work.rows.resize(rowBytes * 5);
+        uint8_t* prev = work.rows.data();
+        uint8_t* cur = prev + rowBytes;
+        uint8_t* scratch = cur + rowBytes;
+
+        // Filters look at the row above even across a strip boundary;
+        // only the first row of the image has none
+        if (strip.top > 0) {
+            ConvertRow(view.Row(strip.top - 1), width, alpha, prev);
+        } else {
+            std::memset(prev, 0, rowBytes);
+        }
+
+        for (int y = strip.top; y < strip.bottom; ++y) {
+            ConvertRow(view.Row(y), width, alpha, cur);
+            FilterRow(cur, prev, rowBytes, bpp, scratch, out);
+            out += rowBytes + 1;
+            std::swap(prev, cur);
+        }
+    }
+    strip.adler = Adler32(work.filtered.data(), strip.filteredSize);
+
+    // Length and type are filled in once the size is known
+    work.chunk.assign(8, 0);
+    if (strip.first) {
+        work.chunk.push_back(0x78);     // zlib header: deflate, 32 KB window,
+        work.chunk.push_back(0x01);     // fastest level
+    }
+    work.deflate.SetProbes(bpp, rowBytes + 1);
+    work.deflate.Compress(work.filtered.data(), strip.filteredSize, strip.last, work.chunk);
+
+    uint32_t length = static_cast<uint32_t>(work.chunk.size() - 8);
+    PutBigEndian(work.chunk.data(), length);
+    std::memcpy(work.chunk.data() + 4, "IDAT", 4);
+    uint32_t crc = Crc32(work.chunk.data() + 4, length + 4);
+    work.chunk.resize(work.chunk.size() + 4);
+    PutBigEndian(work.chunk.data() + work.chunk.size() - 4, crc);
+}
+
+size_t PngEncoder::AssembledSize(const Format& format, const std::vector<Strip>& strips) {
+    size_t size = HeaderSize(format) + kTrailerSize;
+    for (const auto& strip : strips) {
+        size += strip.workspace->chunk.size();
+    }
+    return size;
+}
+
+void PngEncoder::Assemble(const FrameView& view, const Format& format, const std::vector<Strip>& strips,
+                          uint8_t* out) {
+    WriteHeader(view, format, out);
+    uint8_t* p = out + HeaderSize(format);
+
+    uint32_t adler = 1;
+    for (const auto& strip : strips) {
+        const auto& chunk = strip.workspace->chunk;
+        std::memcpy(p, chunk.data(), chunk.size());
+        p += chunk.size();
+        adler = strip.first ? strip.adler : Adler32Combine(adler, strip.adler, strip.filteredSize);
+    }
+    WriteTrailer(adler, p);
+}
+
+size_t PngEncoder::HeaderSize(const Format& format) {
+    size_t size = 8 + (12 + 13);
+    if (format.indexed) {
+        size += 12 + static_cast<size_t>(format.colors) * 3;
+    }
+    return size;
+}
+
+void PngEncoder::WriteHeader(const FrameView& view, const Format& format, uint8_t* out) const {
+    static const uint8_t kSignature[8] = {137, 80, 78, 71, 13, 10, 26, 10};
+    std::memcpy(out, kSignature, 8);
+
+    uint8_t header[13];
+    PutBigEndian(header, static_cast<uint32_t>(view.Width()));
+    PutBigEndian(header + 4, static_cast<uint32_t>(view.Height()));
+    header[8] = static_cast<uint8_t>(format.indexed ? format.depth : 8);   // bits per sample
+    header[9] = format.indexed ? 3 : format.alpha ? 6 : 2;  // indexed : RGBA : RGB
+    header[10] = 0;                             // deflate
+    header[11] = 0;                             // adaptive filtering
+    header[12] = 0;                             // not interlaced
+    uint8_t* p = WriteChunk(out + 8, "IHDR", header, sizeof(header));
+    if (format.indexed) {
+        WriteChunk(p, "PLTE", format.palette, static_cast<uint32_t>(format.colors) * 3);
+    }
+}
+
+void PngEncoder::WriteTrailer(uint32_t adler, uint8_t* out) {
+    // The zlib stream's checksum follows its last strip
+    uint8_t trailer[4];
+    PutBigEndian(trailer, adler);
+    uint8_t* p = WriteChunk(out, "IDAT", trailer, sizeof(trailer));
+    WriteChunk(p, "IEND", nullptr, 0);
+}
+
+std::unique_ptr<PngEncoder::Workspace> PngEncoder::AcquireWorkspace() {
+    {
+        std::lock_guard<std::mutex> lock(idleMutex_);
+        if (!idle_.empty()) {
+            auto workspace = std::move(idle_.back());
+            idle_.pop_back();
+            return workspace;
+        }
+    }
+    return std::make_unique<Workspace>();
+}
+
+void PngEncoder::ReleaseWorkspace(std::unique_ptr<Workspace> workspace) {
+    std::lock_guard<std::mutex> lock(idleMutex_);
+    // Enough for two encodes at once; extras from bursts are freed
+    if (idle_.size() < static_cast<size_t>(options_.threads) * 2) {
+        idle_.push_back(std::move(workspace));
+    }
+}
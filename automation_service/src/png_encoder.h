@@ -0,0 +1,123 @@
+#pragma once
+
+#include "deflate.h"
+#include "frame_view.h"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/**
+ * PNG Encoder
+ *
+ * Built-in PNG writer for BGRA frames. Screen pixels are opaque, so rows
+ * are written as 8-bit RGB unless alpha is asked for. Each row gets the
+ * PNG filter (None, Sub, Up or Paeth) whose output has the smallest sum
+ * of absolute values; the filters run with SSE2 on x86, NEON on ARM and
+ * in scalar code elsewhere. Filtered rows are compressed by
+ * DeflateEncoder.
+ *
+ * Screens often hold only a few hundred colors or fewer. With
+ * Palette::Exact an image with at most 256 colors is written as an
+ * indexed PNG instead (1, 2, 4 or 8 bits per pixel), which is lossless
+ * and typically several times smaller. Rows are sampled 1 in 16 first
+ * when counting colors, so images with many colors are turned away
+ * after a small part of the frame. Palette::Quantize always writes
+ * indexed: exactly when possible, otherwise through a 256-color
+ * median-cut palette (lossy, but flat UI colors stay close).
+ *
+ * Large images are cut into horizontal strips compressed in parallel.
+ * Each strip becomes its own IDAT chunk (a PNG's IDAT payloads join
+ * into one zlib stream), so strips are only stitched by combining their
+ * Adler-32 checksums; the price is that matches cannot reach across a
+ * strip boundary.
+ *
+ * The sink form of Encode hands the PNG over piece by piece: the
+ * header, then each strip's chunk as soon as it and the ones above it
+ * are done (while later strips are still compressing), then the
+ * trailer. Consumers such as a base64 encoder can work on the early
+ * pieces without the whole file ever being held in one buffer.
+ *
+ * Platform-neutral and thread-safe: concurrent Encode calls take their
+ * own strip workspaces from a shared free list, so steady-state
+ * encoding allocates nothing large beyond the output.
+ */
+class PngEncoder {
+public:
+    enum class Palette {
+        Off,        // always RGB (or RGBA)
+        Exact,      // indexed when the image has at most 256 colors
+        Quantize    // indexed always, median-cut when there are more
+    };
+
+    struct Options {
+        bool alpha = false;     // keep the alpha channel (RGBA rather than RGB)
+        int threads = 0;        // strips encoded at once; 0 = hardware threads
+        Palette palette = Palette::Off;     // ignored with alpha
+    };
+
+    PngEncoder() : PngEncoder(Options()) {}
+    explicit PngEncoder(const Options& options);
+    ~PngEncoder();
+
+    PngEncoder(const PngEncoder&) = delete;
+    PngEncoder& operator=(const PngEncoder&) = delete;
+
+    // Encode into out, replacing its contents but keeping its capacity.
+    // False if the view is empty.
+    bool Encode(const FrameView& view, std::vector<uint8_t>& out);
+
+    // Encode into a caller-owned buffer. Returns the bytes written, 0 if
+    // the view is empty or the PNG does not fit (MaxEncodedSize always
+    // fits).
+    size_t Encode(const FrameView& view, uint8_t* out, size_t capacity);
+
+    // Receives the encoded PNG in order, one piece per call
+    using Sink = std::function<void(const uint8_t* data, size_t size)>;
+
+    // Encode into sink (see above). False, with nothing sent, if the view
+    // is empty.
+    bool Encode(const FrameView& view, const Sink& sink);
+
+    // Upper bound of Encode's output for an image of this size
+    static size_t MaxEncodedSize(int width, int height, bool alpha = false);
+
+private:
+    struct Workspace;
+    struct Strip;
+    struct Format;
+
+    Options options_;
+
+    std::mutex idleMutex_;
+    std::vector<std::unique_ptr<Workspace>> idle_;
+
+    // RGB(A) or indexed, and the palette, for view (see Options::palette)
+    void ChooseFormat(const FrameView& view, Format& format) const;
+
+    // Filter and compress every strip; false if the view is empty. If
+    // given, done is called on the calling thread for each strip in
+    // order, as soon as it is compressed.
+    bool EncodeStrips(const FrameView& view, const Format& format, std::vector<Strip>& strips,
+                      const std::function<void(Strip&)>& done = nullptr);
+    void EncodeStrip(const FrameView& view, const Format& format, Strip& strip);
+
+    // Header, strip chunks, checksum and end chunk into out (which holds
+    // at least AssembledSize bytes)
+    static size_t AssembledSize(const Format& format, const std::vector<Strip>& strips);
+    void Assemble(const FrameView& view, const Format& format, const std::vector<Strip>& strips,
+                  uint8_t* out);
+
+    // The pieces around the strip chunks: signature, IHDR and any PLTE,
+    // then the zlib checksum IDAT and IEND
+    static constexpr size_t kMaxHeaderSize = 8 + (12 + 13) + (12 + 256 * 3);
+    static constexpr size_t kTrailerSize = (12 + 4) + 12;
+    static size_t HeaderSize(const Format& format);
+    void WriteHeader(const FrameView& view, const Format& format, uint8_t* out) const;
+    static void WriteTrailer(uint32_t adler, uint8_t* out);
+
+    std::unique_ptr<Workspace> AcquireWorkspace();
+    void ReleaseWorkspace(std::unique_ptr<Workspace> workspace);
+};
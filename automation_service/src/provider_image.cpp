@@ -0,0 +1,65 @@
+#include "provider_image.h"
+#include <algorithm>
+#include <cmath>
+
+json ProviderImage::ToImageSpace(json node) const {
+    double sx = static_cast<double>(width) / sourceWidth;
+    double sy = static_cast<double>(height) / sourceHeight;
+
+    if (node.is_object()) {
+        if (node.contains("bounds") && node["bounds"].is_object()) {
+            json& bounds = node["bounds"];
+            for (const char* key : {"x", "width"}) {
+                if (bounds.contains(key) && bounds[key].is_number()) {
+                    bounds[key] = static_cast<int>(std::lround(bounds[key].get<double>() * sx));
+                }
+            }
+            for (const char* key : {"y", "height"}) {
+                if (bounds.contains(key) && bounds[key].is_number()) {
+                    bounds[key] = static_cast<int>(std::lround(bounds[key].get<double>() * sy));
+                }
+            }
+        }
+        if (node.contains("children") && node["children"].is_array()) {
+            for (auto& child : node["children"]) {
+                child = ToImageSpace(std::move(child));
+            }
+        }
+    }
+    return node;
+}
+
+bool ProviderImage::ToPhysical(json& params) const {
+    // Size unknown (no screenshot): nothing to check against
+    if (width <= 0 || height <= 0) {
+        return true;
+    }
+    auto inside = [&params](const char* key, int size) {
+        if (!params.contains(key) || !params[key].is_number()) {
+            return true;
+        }
+        double value = params[key].get<double>();
+        return value >= 0 && value < size;
+    };
+    if (!inside("x", width) || !inside("y", height)) {
+        return false;
+    }
+    if (!Scaled()) {
+        return true;
+    }
+
+    // An image pixel covers a block of physical pixels; aim at its centre.
+    // A fractional coordinate in the last image pixel can land half a
+    // block past the edge, hence the min.
+    auto map = [](json& value, int size, int sourceSize) {
+        double physical = (value.get<double>() + 0.5) * sourceSize / size;
+        value = std::min(static_cast<int>(physical), sourceSize - 1);
+    };
+    if (params.contains("x") && params["x"].is_number()) {
+        map(params["x"], width, sourceWidth);
+    }
+    if (params.contains("y") && params["y"].is_number()) {
+        map(params["y"], height, sourceHeight);
+    }
+    return true;
+}
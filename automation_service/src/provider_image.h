@@ -0,0 +1,39 @@
+#pragma once
+
+#include <nlohmann/json.hpp>
+#include <string>
+
+using json = nlohmann::json;
+
+/**
+ * Provider Image
+ *
+ * A screenshot as sent to a provider, and the mapping between the sent
+ * image's pixels and the screenshot it was downscaled from. The model
+ * works in the sent image's pixels, so the UI tree it sees and the
+ * coordinates it returns are scaled by their ratio.
+ *
+ * Platform-neutral.
+ */
+struct ProviderImage {
+    std::string base64;                     // empty if there is none
+    std::string mediaType = "image/png";    // e.g. image/jpeg
+
+    // Size as sent, and the size of the screenshot it was downscaled from
+    int width = 0;
+    int height = 0;
+    int sourceWidth = 0;
+    int sourceHeight = 0;
+
+    bool Scaled() const {
+        return width > 0 && height > 0 && (width != sourceWidth || height != sourceHeight);
+    }
+
+    // The UI tree with every element's bounds in the sent image's pixels
+    json ToImageSpace(json node) const;
+
+    // Rewrite an action's x/y from image to physical pixels. False, with
+    // params untouched, if either lies outside the sent image: the model
+    // pointed at something it was not shown.
+    bool ToPhysical(json& params) const;
+};
@@ -1,26 +1,21 @@
 #include "screen_capture.h"
-#include <wincodec.h>
-#include <wincodecsdk.h>
-#include "../third_party/base64.h"
+#include "base64.h"
+#include "dxgi_frame_source.h"
 #include <sstream>
 
-#pragma comment(lib, "windowscodecs.lib")
-
 ScreenCapture::ScreenCapture()
-    : device_(nullptr)
-    , context_(nullptr)
-    , duplication_(nullptr)
-    , stagingTexture_(nullptr)
-    , screenWidth_(0)
+    : screenWidth_(0)
     , screenHeight_(0)
     , initialized_(false) {
 }
 
 ScreenCapture::~ScreenCapture() {
-    if (stagingTexture_) stagingTexture_->Release();
-    if (duplication_) duplication_->Release();
-    if (context_) context_->Release();
-    if (device_) device_->Release();
+    running_ = false;
+    for (auto& output : outputs_) {
+        if (output->thread.joinable()) {
+            output->thread.join();
+        }
+    }
 }
 
 bool ScreenCapture::Initialize() {
@@ -28,374 +23,438 @@ bool ScreenCapture::Initialize() {
         return true;
     }
     
-    // Create D3D11 device
-    D3D_FEATURE_LEVEL featureLevel;
-    HRESULT hr = D3D11CreateDevice(
-        nullptr,
-        D3D_DRIVER_TYPE_HARDWARE,
-        nullptr,
-        0,
-        nullptr,
-        0,
-        D3D11_SDK_VERSION,
-        &device_,
-        &featureLevel,
-        &context_
-    );
-    
-    if (FAILED(hr)) {
-        LOG_ERROR(L"Failed to create D3D11 device");
-        return false;
-    }
-    
-    // Get DXGI device
-    IDXGIDevice* dxgiDevice = nullptr;
-    hr = device_->QueryInterface(__uuidof(IDXGIDevice), reinterpret_cast<void**>(&dxgiDevice));
-    if (FAILED(hr)) {
-        LOG_ERROR(L"Failed to get DXGI device");
+    // Duplicate every output; one that cannot be duplicated (e.g. a
+    // protected or disconnected display) is left out of the desktop
+    std::vector<OutputInfo> infos;
+    for (const auto& candidate : DxgiFrameSource::EnumerateOutputs()) {
+        auto source = std::make_unique<DxgiFrameSource>(candidate.adapter, candidate.output);
+        if (!source->Initialize()) {
+            LOG_ERROR(L"Failed to duplicate output " + StringToWString(candidate.info.name));
+            continue;
+        }
+        auto output = std::make_unique<Output>();
+        output->source = std::move(source);
+        output->info = candidate.info;
+        outputs_.push_back(std::move(output));
+        infos.push_back(candidate.info);
+    }
+    
+    if (outputs_.empty()) {
+        LOG_ERROR(L"No output could be duplicated");
         return false;
     }
     
-    // Get DXGI adapter
-    IDXGIAdapter* dxgiAdapter = nullptr;
-    hr = dxgiDevice->GetAdapter(&dxgiAdapter);
-    dxgiDevice->Release();
-    
-    if (FAILED(hr)) {
-        LOG_ERROR(L"Failed to get DXGI adapter");
-        return false;
+    layout_ = DesktopLayout(std::move(infos));
+    for (int i = 0; i < layout_.Count(); ++i) {
+        outputs_[i]->placement = layout_.Placement(i);
     }
+    screenWidth_ = layout_.Width();
+    screenHeight_ = layout_.Height();
+    frame_.Reset(screenWidth_, screenHeight_);
+    waitingOutputs_ = layout_.Count();
+    firstFrameBy_ = std::chrono::steady_clock::now() + std::chrono::milliseconds(kFirstFrameWaitMs);
     
-    // Get output (monitor)
-    IDXGIOutput* dxgiOutput = nullptr;
-    hr = dxgiAdapter->EnumOutputs(0, &dxgiOutput);
-    dxgiAdapter->Release();
-    
-    if (FAILED(hr)) {
-        LOG_ERROR(L"Failed to enumerate outputs");
-        return false;
+    running_ = true;
+    for (auto& output : outputs_) {
+        output->thread = std::thread(&ScreenCapture::CaptureLoop, this, output.get());
     }
     
-    // Get output1 interface for desktop duplication
-    IDXGIOutput1* dxgiOutput1 = nullptr;
-    hr = dxgiOutput->QueryInterface(__uuidof(IDXGIOutput1), reinterpret_cast<void**>(&dxgiOutput1));
-    dxgiOutput->Release();
+    initialized_ = true;
+    LOG_INFO(L"Screen capture initialized successfully (" + std::to_wstring(layout_.Count()) + L" outputs)");
+    return true;
+}
+
+bool ScreenCapture::Refresh(Output& output, int timeoutMs) {
+    FrameUpdate update;
+    FrameStatus status = output.source->AcquireFrame(timeoutMs, update);
     
-    if (FAILED(hr)) {
-        LOG_ERROR(L"Failed to get IDXGIOutput1");
-        return false;
+    if (status == FrameStatus::Timeout) {
+        // Nothing changed since the last frame; the buffer is current
+        return true;
     }
     
-    // Get screen dimensions
-    DXGI_OUTPUT_DESC outputDesc;
-    dxgiOutput1->GetDesc(&outputDesc);
-    screenWidth_ = outputDesc.DesktopCoordinates.right - outputDesc.DesktopCoordinates.left;
-    screenHeight_ = outputDesc.DesktopCoordinates.bottom - outputDesc.DesktopCoordinates.top;
-    
-    // Create desktop duplication
-    hr = dxgiOutput1->DuplicateOutput(device_, &duplication_);
-    dxgiOutput1->Release();
-    
-    if (FAILED(hr)) {
-        LOG_ERROR(L"Failed to create desktop duplication");
+    if (status == FrameStatus::Error) {
         return false;
     }
     
-    // Create staging texture
-    if (!CreateStagingTexture(screenWidth_, screenHeight_)) {
-        return false;
+    // A mode change resizes the output (its duplication is lost, and the
+    // new one delivers a full frame at the new size). The desktop is laid
+    // out again around it, so it cannot spill into its neighbours; where
+    // Windows now puts each output is read before taking the lock.
+    bool resized = false;
+    {
+        std::lock_guard<std::mutex> lock(captureMutex_);
+        resized = update.width != output.placement.width || update.height != output.placement.height;
+    }
+    std::vector<DxgiOutput> current;
+    if (resized) {
+        current = DxgiFrameSource::EnumerateOutputs();
+    }
+    
+    bool changed = false;
+    bool relaid = false;
+    DesktopLayout layout;
+    {
+        std::lock_guard<std::mutex> lock(captureMutex_);
+        if (resized && RelayoutLocked(output, update.width, update.height, current)) {
+            relaid = true;
+            layout = layout_;
+        }
+        changed = frame_.ApplyAt(update, output.placement.x, output.placement.y);
+        if (changed || relaid) {
+            PublishLocked();
+        }
+    }
+    output.source->ReleaseFrame();
+    
+    if (changed) {
+        Settle(output);
+    }
+    if (relaid) {
+        std::lock_guard<std::mutex> lock(listenerMutex_);
+        if (layoutListener_) {
+            layoutListener_(layout);
+        }
     }
-    
-    initialized_ = true;
-    LOG_INFO(L"Screen capture initialized successfully");
     return true;
 }
 
-bool ScreenCapture::CreateStagingTexture(int width, int height) {
-    D3D11_TEXTURE2D_DESC desc = {};
-    desc.Width = width;
-    desc.Height = height;
-    desc.MipLevels = 1;
-    desc.ArraySize = 1;
-    desc.Format = DXGI_FORMAT_B8G8R8A8_UNORM;
-    desc.SampleDesc.Count = 1;
-    desc.Usage = D3D11_USAGE_STAGING;
-    desc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
-    
-    HRESULT hr = device_->CreateTexture2D(&desc, nullptr, &stagingTexture_);
-    
-    if (FAILED(hr)) {
-        LOG_ERROR(L"Failed to create staging texture");
-        return false;
-    }
-    
+bool ScreenCapture::RelayoutLocked(Output& resized, int width, int height, const std::vector<DxgiOutput>& current) {
+    if (width == resized.placement.width && height == resized.placement.height) {
+        return false;   // another output's thread got here first
+    }
+    
+    // Positions as Windows has them now; sizes as each source delivers
+    // them, so an output still captured at its old mode keeps its old
+    // size until its own frames change
+    std::vector<OutputInfo> infos;
+    std::vector<Rect> before;
+    for (auto& output : outputs_) {
+        OutputInfo& info = output->info;
+        for (const auto& entry : current) {
+            if (entry.info.name == info.name) {
+                info.bounds.x = entry.info.bounds.x;
+                info.bounds.y = entry.info.bounds.y;
+                info.primary = entry.info.primary;
+            }
+        }
+        info.bounds.width = output.get() == &resized ? width : output->placement.width;
+        info.bounds.height = output.get() == &resized ? height : output->placement.height;
+        infos.push_back(info);
+        before.push_back(output->placement);
+    }
+    
+    // The new composite starts as the old one rearranged: every other
+    // output is carried over as a full frame at its new placement
+    std::vector<uint8_t> previous = frame_.Pixels();
+    size_t stride = frame_.Stride();
+    layout_ = DesktopLayout(std::move(infos));
+    screenWidth_ = layout_.Width();
+    screenHeight_ = layout_.Height();
+    frame_.Reset(screenWidth_, screenHeight_);
+    for (size_t i = 0; i < outputs_.size(); ++i) {
+        Output& output = *outputs_[i];
+        output.placement = layout_.Placement(static_cast<int>(i));
+        if (&output == &resized) {
+            continue;
+        }
+        FrameUpdate carried;
+        carried.width = before[i].width;
+        carried.height = before[i].height;
+        carried.pixels = previous.data() + static_cast<size_t>(before[i].y) * stride + static_cast<size_t>(before[i].x) * 4;
+        carried.pitch = stride;
+        carried.full = true;
+        frame_.ApplyAt(carried, output.placement.x, output.placement.y);
+    }
+    
+    // Slots are tied to a layout; readers holding one keep it
+    for (auto& slot : slots_) {
+        slot.reset();
+    }
+    LOG_INFO(L"Display mode changed; desktop is now " + std::to_wstring(screenWidth_) + L"x" +
+             std::to_wstring(screenHeight_));
     return true;
 }
 
-ImageData ScreenCapture::CaptureScreen() {
+void ScreenCapture::SetLayoutListener(LayoutListener listener) {
+    std::lock_guard<std::mutex> lock(listenerMutex_);
+    layoutListener_ = std::move(listener);
+}
+
+DesktopLayout ScreenCapture::GetLayout() {
+    std::lock_guard<std::mutex> lock(captureMutex_);
+    return layout_;
+}
+
+void ScreenCapture::Settle(Output& output) {
+    {
+        std::lock_guard<std::mutex> lock(firstFrameMutex_);
+        if (output.settled) {
+            return;
+        }
+        output.settled = true;
+        --waitingOutputs_;
+    }
+    firstFrame_.notify_all();
+}
+
+void ScreenCapture::CaptureLoop(Output* output) {
+    LOG_INFO(L"Screen capture thread started");
+    
+    int retryMs = kCaptureWaitMs;
+    while (running_) {
+        if (Refresh(*output, kCaptureWaitMs)) {
+            if (output->failing) {
+                LOG_INFO(L"Screen capture recovered");
+                output->failing = false;
+                ++output->recoveries;
+            }
+            retryMs = kCaptureWaitMs;
+            continue;
+        }
+        
+        // Typically a desktop switch (UAC, lock screen) or a mode change,
+        // which loses the duplication. Readers stop waiting for this
+        // output's first frame, and see it as failing until it is back.
+        if (!output->failing) {
+            LOG_ERROR(L"Screen capture failing, retrying");
+            output->failing = true;
+            ++output->failures;
+        }
+        Settle(*output);
+        
+        // Back off, in steps short enough not to hold up shutdown, then
+        // duplicate the output again (a no-op if it was not lost)
+        for (int waited = 0; running_ && waited < retryMs; waited += kCaptureWaitMs) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(kCaptureWaitMs));
+        }
+        retryMs = std::min(retryMs * 2, kMaxRetryMs);
+        if (running_) {
+            output->source->Initialize();
+        }
+    }
+    
+    LOG_INFO(L"Screen capture thread stopped");
+}
+
+void ScreenCapture::PublishLocked() {
+    std::shared_ptr<const CapturedFrame> published = std::atomic_load(&latest_);
+    
+    // A slot nobody else holds can be rewritten in place. If readers
+    // still hold every spare slot, give one a fresh buffer; theirs lives
+    // on until they drop it.
+    std::shared_ptr<CapturedFrame> target;
+    for (auto& slot : slots_) {
+        if (slot && slot != published && slot.use_count() == 1) {
+            target = slot;
+            break;
+        }
+    }
+    if (!target) {
+        for (auto& slot : slots_) {
+            if (slot != published) {
+                slot = std::make_shared<CapturedFrame>();
+                target = slot;
+                break;
+            }
+        }
+    }
+    
+    // A slot's buffer is reused while the desktop keeps its size; on a
+    // new size (or a fresh slot) it takes a block from the pool
+    size_t bytes = frame_.Pixels().size();
+    if (target->pixels.Size() != bytes) {
+        target->pixels = framePool_.Acquire(bytes);
+    }
+    if (target->width != frame_.Width() || target->height != frame_.Height()) {
+        target->width = frame_.Width();
+        target->height = frame_.Height();
+        target->layout = layout_;
+    }
+    
+    // The block's tag is the generation of frame_ it last held (0 if it
+    // held something else), whichever slot held it. Bring it up to date
+    // from there: only tiles changed since need copying.
+    uint64_t held = target->pixels.Tag();
+    if (held == 0) {
+        memcpy(target->pixels.Data(), frame_.Data(), bytes);
+    } else {
+        size_t stride = frame_.Stride();
+        for (const auto& region : frame_.ChangedRegions(held)) {
+            size_t offset = static_cast<size_t>(region.y) * stride + static_cast<size_t>(region.x) * 4;
+            size_t rowBytes = static_cast<size_t>(region.width) * 4;
+            for (int row = 0; row < region.height; ++row) {
+                memcpy(target->pixels.Data() + offset, frame_.Data() + offset, rowBytes);
+                offset += stride;
+            }
+        }
+    }
+    target->pixels.SetTag(frame_.Generation());
+    target->generation = frame_.Generation();
+    target->capturedAt = std::chrono::steady_clock::now();
+    
+    std::atomic_store(&latest_, std::shared_ptr<const CapturedFrame>(target));
+}
+
+std::shared_ptr<const CapturedFrame> ScreenCapture::GetLatestFrame(const Deadline& deadline) {
     if (!initialized_) {
         throw std::runtime_error("Screen capture not initialized");
     }
     
-    IDXGIResource* desktopResource = nullptr;
-    DXGI_OUTDUPL_FRAME_INFO frameInfo;
-    
-    // Acquire next frame
-    HRESULT hr = duplication_->AcquireNextFrame(500, &frameInfo, &desktopResource);
-    
-    if (hr == DXGI_ERROR_WAIT_TIMEOUT) {
-        // No new frame available, try to get current desktop
-        LOG_DEBUG(L"Frame timeout, retrying");
-        return ImageData();
+    {
+        // Only right after startup: wait briefly until every output has
+        // delivered a frame, so none shows up blank. Once the startup
+        // window has passed, an output still missing is not waited for.
+        std::unique_lock<std::mutex> lock(firstFrameMutex_);
+        if (waitingOutputs_ > 0) {
+            auto until = std::min(firstFrameBy_, std::chrono::steady_clock::now() +
+                                                     std::chrono::milliseconds(deadline.Clamp(kFirstFrameWaitMs)));
+            firstFrame_.wait_until(lock, until, [this] { return waitingOutputs_ == 0; });
+        }
     }
-    
-    if (FAILED(hr)) {
-        LOG_ERROR(L"Failed to acquire frame");
-        return ImageData();
-    }
-    
-    // Read pixels from frame
-    ImageData pixels = ReadPixels(desktopResource);
-    
-    // Release frame
-    desktopResource->Release();
-    duplication_->ReleaseFrame();
-    
-    return pixels;
+    return std::atomic_load(&latest_);
 }
 
-ImageData ScreenCapture::ReadPixels(IDXGIResource* resource) {
-    // Get texture from resource
-    ID3D11Texture2D* texture = nullptr;
-    HRESULT hr = resource->QueryInterface(__uuidof(ID3D11Texture2D), reinterpret_cast<void**>(&texture));
-    
-    if (FAILED(hr)) {
-        LOG_ERROR(L"Failed to get texture from resource");
-        return ImageData();
+FrameView ScreenCapture::GetOutputView(int index, std::shared_ptr<const CapturedFrame> frame) {
+    if (!frame) {
+        frame = std::atomic_load(&latest_);
     }
-    
-    // Copy to staging texture
-    context_->CopyResource(stagingTexture_, texture);
-    texture->Release();
-    
-    // Map staging texture to read pixels
-    D3D11_MAPPED_SUBRESOURCE mapped;
-    hr = context_->Map(stagingTexture_, 0, D3D11_MAP_READ, 0, &mapped);
-    
-    if (FAILED(hr)) {
-        LOG_ERROR(L"Failed to map staging texture");
-        return ImageData();
+    if (!frame) {
+        return FrameView();
     }
-    
-    // Copy pixels
-    ImageData pixels(screenWidth_ * screenHeight_ * 4); // BGRA format
-    
-    byte* src = static_cast<byte*>(mapped.pData);
-    byte* dst = pixels.data();
-    
-    for (int y = 0; y < screenHeight_; y++) {
-        memcpy(dst, src, screenWidth_ * 4);
-        src += mapped.RowPitch;
-        dst += screenWidth_ * 4;
+    int position = frame->layout.Find(index);
+    if (position < 0) {
+        return FrameView();
     }
-    
-    context_->Unmap(stagingTexture_, 0);
-    
-    return pixels;
+    Rect placement = frame->layout.Placement(position);
+    return GetRegionView(placement, std::move(frame));
 }
 
-ImageData ScreenCapture::CaptureRegion(const Rect& region) {
-    ImageData fullScreen = CaptureScreen();
-
-    if (fullScreen.empty()) {
+ImageData ScreenCapture::CaptureScreen(const Deadline& deadline) {
+    std::shared_ptr<const CapturedFrame> frame = GetLatestFrame(deadline);
+    if (!frame || frame->pixels.Empty()) {
         return ImageData();
     }
+    return ImageData(frame->pixels.Data(), frame->pixels.Data() + frame->pixels.Size());
+}
 
-    int screenW, screenH;
-    GetScreenDimensions(screenW, screenH);
-
-    // Clamp region to screen bounds
-    int rx = std::max(0, region.x);
-    int ry = std::max(0, region.y);
-    int rw = std::min(region.width, screenW - rx);
-    int rh = std::min(region.height, screenH - ry);
-
-    if (rw <= 0 || rh <= 0) {
-        return ImageData();
+FrameView ScreenCapture::GetRegionView(const Rect& region, std::shared_ptr<const CapturedFrame> frame) {
+    if (!frame) {
+        frame = std::atomic_load(&latest_);
     }
-
-    // fullScreen is BGRA, 4 bytes per pixel, rows are screenW * 4 bytes
-    int srcStride = screenW * 4;
-    int dstStride = rw * 4;
-    ImageData cropped(dstStride * rh);
-
-    for (int row = 0; row < rh; ++row) {
-        const uint8_t* srcRow = fullScreen.data() + (ry + row) * srcStride + rx * 4;
-        uint8_t* dstRow = cropped.data() + row * dstStride;
-        memcpy(dstRow, srcRow, dstStride);
+    if (!frame || frame->pixels.Empty()) {
+        return FrameView();
     }
-
-    return cropped;
+    
+    const uint8_t* data = frame->pixels.Data();
+    int width = frame->width;
+    int height = frame->height;
+    FrameView whole(std::move(frame), data, width, height, static_cast<size_t>(width) * 4);
+    return whole.Crop(region);
 }
 
-std::string ScreenCapture::EncodeToPNG(const ImageData& pixels, int width, int height) {
-    if (pixels.empty()) {
-        return "";
-    }
-    
-    // Use Windows Imaging Component to encode PNG
-    IWICImagingFactory* factory = nullptr;
-    HRESULT hr = CoCreateInstance(
-        CLSID_WICImagingFactory,
-        nullptr,
-        CLSCTX_INPROC_SERVER,
-        IID_IWICImagingFactory,
-        reinterpret_cast<void**>(&factory)
-    );
-    
-    if (FAILED(hr) || !factory) {
-        LOG_ERROR(L"Failed to create WIC factory");
-        return "";
+ImageData ScreenCapture::CaptureRegion(Rect& region, const Deadline& deadline) {
+    if (!initialized_) {
+        throw std::runtime_error("Screen capture not initialized");
     }
     
-    // Create growable memory stream
-    IStream* memStream = nullptr;
-    hr = CreateStreamOnHGlobal(nullptr, TRUE, &memStream);
-    if (FAILED(hr) || !memStream) {
-        factory->Release();
-        LOG_ERROR(L"Failed to create memory stream");
-        return "";
+    std::shared_ptr<const CapturedFrame> frame = std::atomic_load(&latest_);
+    if (frame) {
+        Rect requested = region;
+        FrameView view = GetRegionView(requested, frame);
+        if (view.Empty()) {
+            return ImageData();
+        }
+        region.x = std::max(requested.x, 0);
+        region.y = std::max(requested.y, 0);
+        region.width = view.Width();
+        region.height = view.Height();
+        return view.CopyPixels();
+    }
+    
+    // No frame published yet: read only the region from the source
+    // rather than waiting for a whole first frame. Direct reads serve a
+    // region within one output.
+    int position;
+    Rect placement;
+    {
+        std::lock_guard<std::mutex> lock(captureMutex_);
+        position = layout_.OutputAt(std::max(region.x, 0), std::max(region.y, 0));
+        placement = position >= 0 ? layout_.Placement(position) : Rect{0, 0, 0, 0};
+    }
+    if (position < 0 || deadline.Expired()) {
+        return ImageData();
     }
+    Rect local = {region.x - placement.x, region.y - placement.y, region.width, region.height};
     
-    // Create PNG encoder
-    IWICBitmapEncoder* encoder = nullptr;
-    hr = factory->CreateEncoder(GUID_ContainerFormatPng, nullptr, &encoder);
-    if (FAILED(hr)) {
-        memStream->Release();
-        factory->Release();
-        return "";
+    ImageData pixels;
+    if (!outputs_[position]->source->ReadRegion(local, pixels)) {
+        return ImageData();
     }
+    region = {local.x + placement.x, local.y + placement.y, local.width, local.height};
+    return pixels;
+}
 
-    hr = encoder->Initialize(memStream, WICBitmapEncoderNoCache);
-    if (FAILED(hr)) {
-        encoder->Release();
-        memStream->Release();
-        factory->Release();
-        return "";
-    }
-    
-    // Create frame
-    IWICBitmapFrameEncode* frame = nullptr;
-    hr = encoder->CreateNewFrame(&frame, nullptr);
-    if (FAILED(hr)) {
-        encoder->Release();
-        memStream->Release();
-        factory->Release();
-        return "";
-    }
+void ScreenCapture::SetEncodePolicy(const std::string& provider, const EncodePolicy& policy) {
+    std::lock_guard<std::mutex> lock(policyMutex_);
+    encodePolicies_[provider] = policy;
+}
 
-    hr = frame->Initialize(nullptr);
-    if (FAILED(hr)) {
-        frame->Release();
-        encoder->Release();
-        memStream->Release();
-        factory->Release();
-        return "";
-    }
+EncodePolicy ScreenCapture::GetEncodePolicy(const std::string& provider) {
+    std::lock_guard<std::mutex> lock(policyMutex_);
+    auto it = encodePolicies_.find(provider);
+    return it != encodePolicies_.end() ? it->second : EncodePolicy();
+}
 
-    // Set size
-    hr = frame->SetSize(width, height);
-    if (FAILED(hr)) {
-        frame->Release();
-        encoder->Release();
-        memStream->Release();
-        factory->Release();
-        return "";
-    }
+bool ScreenCapture::Encode(const FrameView& view, const EncodePolicy& policy, EncodedImage& out) {
+    return imageEncoder_.Encode(view, policy, out);
+}
 
-    // Set pixel format (BGRA)
-    WICPixelFormatGUID pixelFormat = GUID_WICPixelFormat32bppBGRA;
-    hr = frame->SetPixelFormat(&pixelFormat);
-    if (FAILED(hr)) {
-        frame->Release();
-        encoder->Release();
-        memStream->Release();
-        factory->Release();
-        return "";
+std::shared_ptr<const CachedEncoding> ScreenCapture::EncodeCached(const FrameView& view, uint64_t generation,
+                                                                  const EncodePolicy& policy, bool base64,
+                                                                  bool* hit) {
+    if (hit) {
+        *hit = false;
     }
-
-    // Write pixels
-    hr = frame->WritePixels(height, width * 4, pixels.size(), const_cast<BYTE*>(pixels.data()));
-    if (FAILED(hr)) {
-        frame->Release();
-        encoder->Release();
-        memStream->Release();
-        factory->Release();
-        return "";
+    if (view.Empty()) {
+        return nullptr;
     }
 
-    // Commit
-    hr = frame->Commit();
-    if (FAILED(hr)) {
-        frame->Release();
-        encoder->Release();
-        memStream->Release();
-        factory->Release();
-        return "";
+    EncodeCache::Key key;
+    key.content = encodeCache_.ContentHash(view, generation);
+    key.width = view.Width();
+    key.height = view.Height();
+    key.policy = policy;
+    key.base64 = base64;
+    if (auto cached = encodeCache_.Find(key)) {
+        if (hit) {
+            *hit = true;
+        }
+        return cached;
     }
 
-    hr = encoder->Commit();
-    if (FAILED(hr)) {
-        frame->Release();
-        encoder->Release();
-        memStream->Release();
-        factory->Release();
-        return "";
+    auto encoding = std::make_shared<CachedEncoding>();
+    if (!imageEncoder_.Encode(view, policy, encoding->image)) {
+        return nullptr;
     }
-    
-    // Get stream size
-    LARGE_INTEGER zero = {};
-    ULARGE_INTEGER streamSize;
-    hr = memStream->Seek(zero, STREAM_SEEK_END, &streamSize);
-    if (FAILED(hr)) {
-        frame->Release();
-        encoder->Release();
-        memStream->Release();
-        factory->Release();
-        return "";
+    if (base64) {
+        encoding->base64 = Base64::Encode(encoding->image.bytes);
     }
+    encodeCache_.Insert(key, encoding);
+    return encoding;
+}
 
-    hr = memStream->Seek(zero, STREAM_SEEK_SET, nullptr);
-    if (FAILED(hr)) {
-        frame->Release();
-        encoder->Release();
-        memStream->Release();
-        factory->Release();
-        return "";
-    }
-
-    // Read stream data
-    std::vector<unsigned char> pngData(static_cast<size_t>(streamSize.QuadPart));
-    ULONG bytesRead = 0;
-    hr = memStream->Read(pngData.data(), static_cast<ULONG>(pngData.size()), &bytesRead);
-
-    // Clean up
-    frame->Release();
-    encoder->Release();
-    memStream->Release();
-    factory->Release();
-    
-    if (FAILED(hr) || bytesRead == 0) {
-        LOG_ERROR(L"Failed to read PNG data");
-        return "";
+std::vector<ScreenCapture::OutputStatus> ScreenCapture::GetOutputStatus() const {
+    std::vector<OutputStatus> status;
+    status.reserve(outputs_.size());
+    for (const auto& output : outputs_) {
+        status.push_back({output->info.index, output->failing, output->failures, output->recoveries});
     }
-    
-    // Encode to base64
-    std::string base64Encoded = base64::encode(pngData);
-    return base64Encoded;
+    return status;
 }
 
 void ScreenCapture::GetScreenDimensions(int& width, int& height) {
+    std::lock_guard<std::mutex> lock(captureMutex_);
     width = screenWidth_;
     height = screenHeight_;
 }
@@ -1,56 +1,240 @@
 #pragma once
 
 #include "common.h"
-#include <d3d11.h>
-#include <dxgi1_2.h>
+#include "deadline.h"
+#include "desktop_layout.h"
+#include "encode_cache.h"
+#include "frame_buffer.h"
+#include "frame_source.h"
+#include "frame_view.h"
+#include "image_encoder.h"
+#include "pixel_pool.h"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct DxgiOutput;
+
+// Immutable snapshot of the desktop published by the capture threads:
+// every output composited into one image (see DesktopLayout)
+struct CapturedFrame {
+    PixelLease pixels;      // BGRA, width * 4 bytes per row, from the frame pool
+    int width = 0;
+    int height = 0;
+    uint64_t generation = 0;
+    std::chrono::steady_clock::time_point capturedAt;   // when this content was read
+    DesktopLayout layout;   // where each output sits in the image and on the desktop
+};
 
 /**
  * Screen Capture using Desktop Duplication API
  * 
  * Provides GPU-accelerated screen capture functionality.
+ * Every output (monitor) on every adapter is duplicated, each on its own
+ * thread, and composited into one virtual-desktop image. When a display
+ * mode change resizes an output, the composite is laid out again around
+ * its new size.
+ * Frames are folded into a FrameBuffer from their dirty/move rects, so
+ * a capture reads back only what changed, and callers can ask which
+ * regions changed since a frame generation they already have.
+ *
+ * The background threads own the duplications and publish each changed
+ * frame as an immutable CapturedFrame from a small pool of buffers
+ * (triple buffering), so readers get the latest frame immediately and
+ * never wait on AcquireNextFrame, even when the desktop is idle. Frame
+ * pixels are leased from a pool and go back to it when the last reader
+ * lets go, so steady-state capture allocates nothing large.
+ *
+ * Regions are zero-copy views into the published frame. Only before the
+ * first frame is a region read from the source directly, and then only
+ * the region's pixels are transferred.
+ *
+ * Screenshots for AI providers are encoded by a per-provider
+ * EncodePolicy: downscaled (SIMD area average) to the resolution the
+ * provider's model works at, then PNG, JPEG, or PNG falling back to
+ * JPEG when it would exceed the provider's payload-size target.
+ * Recent encodings are cached by content (see EncodeCache), so an
+ * unchanged desktop is not encoded twice.
  */
 class ScreenCapture {
 public:
     ScreenCapture();
     ~ScreenCapture();
     
-    // Initialize Desktop Duplication API
+    // Initialize Desktop Duplication API for every output and start the
+    // capture threads. Succeeds if at least one output can be captured.
     bool Initialize();
     
-    // Capture current screen frame
-    ImageData CaptureScreen();
+    // Latest published frame. Returns at once; only in the first 500ms
+    // after Initialize, while some output has neither delivered a first
+    // frame nor failed, does it wait (at most until then, or the
+    // deadline). Null if no frame is available.
+    std::shared_ptr<const CapturedFrame> GetLatestFrame(const Deadline& deadline = Deadline());
+    
+    // Outputs being captured and where they are now. A copy: a display
+    // mode change lays the desktop out again.
+    DesktopLayout GetLayout();
+    
+    // Called on a capture thread with the new layout whenever a mode
+    // change has rebuilt it. Replaces any earlier listener; once this
+    // returns, that one is no longer running. Null to stop listening.
+    using LayoutListener = std::function<void(const DesktopLayout&)>;
+    void SetLayoutListener(LayoutListener listener);
+    
+    // One output (by OutputInfo::index) of a frame, without copying.
+    // Empty if there is no such output. Null frame means the latest.
+    FrameView GetOutputView(int index, std::shared_ptr<const CapturedFrame> frame = nullptr);
+    
+    // Copy of the latest frame's pixels (see GetLatestFrame). Allocates a
+    // whole-desktop buffer; prefer GetLatestFrame.
+    ImageData CaptureScreen(const Deadline& deadline = Deadline());
+    
+    // Region of the latest frame, clipped to the screen, without copying:
+    // the view keeps the frame alive. Empty if there is no frame or the
+    // region lies off screen. Pass a null frame to use the latest one.
+    FrameView GetRegionView(const Rect& region, std::shared_ptr<const CapturedFrame> frame = nullptr);
     
-    // Capture specific region
-    ImageData CaptureRegion(const Rect& region);
+    // Capture specific region (packed copy of just the region). The
+    // region is clipped to the screen in place.
+    ImageData CaptureRegion(Rect& region, const Deadline& deadline = Deadline());
     
-    // Encode image to PNG (base64)
-    std::string EncodeToPNG(const ImageData& pixels, int width, int height);
+    // How screenshots for a provider are encoded. Providers without a
+    // policy get the default one (lossless PNG, no size target).
+    void SetEncodePolicy(const std::string& provider, const EncodePolicy& policy);
+    EncodePolicy GetEncodePolicy(const std::string& provider);
     
-    // Get screen dimensions
+    // Encode a view by a policy (see ImageEncoder). False if the view is
+    // empty.
+    bool Encode(const FrameView& view, const EncodePolicy& policy, EncodedImage& out);
+    
+    // Same, through the encode cache: if these pixels were encoded by the
+    // same policy recently, that encoding is returned at once. generation
+    // is that of the frame the view belongs to (0 if none). With base64
+    // the text is produced and cached too. Null if the view is empty;
+    // hit, if given, reports whether the cache answered.
+    std::shared_ptr<const CachedEncoding> EncodeCached(const FrameView& view, uint64_t generation,
+                                                       const EncodePolicy& policy, bool base64,
+                                                       bool* hit = nullptr);
+    
+    // A cache hit's bytes were copied out after all; see EncodeCache::ChargeCopy
+    void ChargeEncodeCacheCopy(double ms) { encodeCache_.ChargeCopy(ms); }
+    
+    // Encode cache hit rate and savings
+    EncodeCache::Stats GetEncodeCacheStats() const { return encodeCache_.GetStats(); }
+    
+    // Frame pool usage, including high-water marks
+    PixelPool::Stats GetPoolStats() const { return framePool_.GetStats(); }
+    
+    // Get screen dimensions (the whole virtual desktop)
     void GetScreenDimensions(int& width, int& height);
     
-private:
-    // D3D11 device and context
-    ID3D11Device* device_;
-    ID3D11DeviceContext* context_;
+    // Capture health of one output. While failing, its part of every
+    // frame is what it showed before the failure.
+    struct OutputStatus {
+        int index;              // OutputInfo::index
+        bool failing;
+        uint64_t failures;      // times capture started failing
+        uint64_t recoveries;    // times it came back
+    };
+    std::vector<OutputStatus> GetOutputStatus() const;
     
-    // Desktop duplication interface
-    IDXGIOutputDuplication* duplication_;
+private:
+    // One duplicated output and the thread capturing it
+    struct Output {
+        std::unique_ptr<FrameSource> source;
+        Rect placement;         // where it lands in frame_ (under captureMutex_)
+        bool settled = false;   // first frame folded in, or failed (under firstFrameMutex_)
+        OutputInfo info;        // as of layout_ (under captureMutex_)
+        std::atomic<bool> failing{false};
+        std::atomic<uint64_t> failures{0};
+        std::atomic<uint64_t> recoveries{0};
+        std::thread thread;
+    };
+    std::vector<std::unique_ptr<Output>> outputs_;
+    DesktopLayout layout_;
     
-    // Staging texture for reading pixels
-    ID3D11Texture2D* stagingTexture_;
+    // CPU copy of the virtual desktop, updated incrementally
+    FrameBuffer frame_;
     
-    // Screen dimensions
+    // Screen dimensions (under captureMutex_ once capture runs)
     int screenWidth_;
     int screenHeight_;
     
     // Whether initialized
     bool initialized_;
     
-    // Create staging texture
-    bool CreateStagingTexture(int width, int height);
+    // Guards frame_, the slots and the layout. Each source is used
+    // only by its capture thread, which takes the lock just to fold a
+    // frame in and publish it, never while waiting for one.
+    std::mutex captureMutex_;
+    
+    // Frame wait per loop iteration; bounds how long shutdown takes
+    static constexpr int kCaptureWaitMs = 100;
+    
+    // A failing output is duplicated again after kCaptureWaitMs, doubling
+    // up to this between attempts
+    static constexpr int kMaxRetryMs = 3200;
+    
+    std::atomic<bool> running_{false};
+    
+    // Backing store for published frames. Leases outlive the pool if a
+    // reader still holds a frame at shutdown.
+    PixelPool framePool_;
+    
+    // Published frame, swapped with std::atomic_store. Readers hold
+    // their own reference, so a slot is rewritten only once nobody but
+    // the pool refers to it.
+    static constexpr size_t kFrameSlots = 3;
+    std::array<std::shared_ptr<CapturedFrame>, kFrameSlots> slots_;
+    std::shared_ptr<const CapturedFrame> latest_;
+    
+    // Outputs yet to settle (deliver a first frame or fail); signalled
+    // when it reaches 0. Readers wait for them only until firstFrameBy_,
+    // so an output that never delivers costs one startup wait, not one
+    // per request.
+    static constexpr int kFirstFrameWaitMs = 500;
+    std::mutex firstFrameMutex_;
+    std::condition_variable firstFrame_;
+    int waitingOutputs_ = 0;
+    std::chrono::steady_clock::time_point firstFrameBy_;
+    
+    // Shared by all encoding callers; thread-safe
+    ImageEncoder imageEncoder_;
+    
+    std::mutex policyMutex_;
+    std::map<std::string, EncodePolicy> encodePolicies_;
+    
+    EncodeCache encodeCache_;
+    
+    std::mutex listenerMutex_;
+    LayoutListener layoutListener_;
+    
+    void CaptureLoop(Output* output);
+    
+    // Capture thread. Stop counting the output as waited for.
+    void Settle(Output& output);
+    
+    // Capture thread. Fold the output's next frame (if one arrives within
+    // timeoutMs) into frame_ and publish it. False on capture error.
+    bool Refresh(Output& output, int timeoutMs);
+    
+    // Called under captureMutex_. An output's source now delivers frames
+    // of width x height: rebuild layout_ around that, with the outputs'
+    // current desktop positions, and rebuild frame_ keeping what the
+    // other outputs show. Published frames keep the layout they had.
+    // False if the output already has that size.
+    bool RelayoutLocked(Output& resized, int width, int height, const std::vector<DxgiOutput>& current);
     
-    // Copy frame to staging texture and read pixels
-    ImageData ReadPixels(IDXGIResource* resource);
+    // Called under captureMutex_. Copy frame_ into a free slot (only the
+    // tiles changed since that slot was last written) and publish it.
+    void PublishLocked();
 };
 
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <iterator>
+#include <mutex>
+
+/**
+ * Size Pool
+ *
+ * Idle GPU/shared-memory surfaces (staging textures, XShm images) kept
+ * by width and height for reuse, since creating one costs far more than
+ * the small region reads they serve. Requests for a size that was used
+ * recently get the idle surface back; the pool keeps at most maxIdle
+ * surfaces and destroys the least recently returned one beyond that.
+ *
+ * Resource is a handle type (pointer) where a default-constructed value
+ * means "none". Thread-safe.
+ */
+template <typename Resource>
+class SizePool {
+public:
+    using Create = std::function<Resource(int width, int height)>;
+    using Destroy = std::function<void(Resource)>;
+
+    SizePool(Create create, Destroy destroy, size_t maxIdle = 8)
+        : create_(std::move(create)), destroy_(std::move(destroy)), maxIdle_(maxIdle) {}
+
+    ~SizePool() { Clear(); }
+
+    SizePool(const SizePool&) = delete;
+    SizePool& operator=(const SizePool&) = delete;
+
+    // An idle surface of exactly this size, or a new one. Resource() if
+    // creation fails. Hand it back with Release when done.
+    Resource Acquire(int width, int height) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            // Most recently returned first: the likeliest to be reused again
+            for (auto it = idle_.rbegin(); it != idle_.rend(); ++it) {
+                if (it->width == width && it->height == height) {
+                    Resource resource = it->resource;
+                    idle_.erase(std::next(it).base());
+                    return resource;
+                }
+            }
+        }
+        return create_(width, height);
+    }
+
+    void Release(int width, int height, Resource resource) {
+        if (!resource) return;
+
+        Resource evicted = Resource();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            idle_.push_back({width, height, resource});
+            if (idle_.size() > maxIdle_) {
+                evicted = idle_.front().resource;
+                idle_.pop_front();
+            }
+        }
+        if (evicted) destroy_(evicted);
+    }
+
+    // Destroy every idle surface
+    void Clear() {
+        std::deque<Entry> idle;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            idle.swap(idle_);
+        }
+        for (const auto& entry : idle) {
+            destroy_(entry.resource);
+        }
+    }
+
+    size_t IdleCount() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return idle_.size();
+    }
+
+private:
+    struct Entry {
+        int width;
+        int height;
+        Resource resource;
+    };
+
+    Create create_;
+    Destroy destroy_;
+    size_t maxIdle_;
+
+    mutable std::mutex mutex_;
+    std::deque<Entry> idle_;   // oldest first
+};
@@ -0,0 +1,142 @@
+#include "tile_delta.h"
+#include "hash.h"
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+TileDeltaTracker::TileDeltaTracker(int tileSize, size_t maxSessions)
+    : tileSize_(std::max(tileSize, 8)), maxSessions_(std::max<size_t>(maxSessions, 1)) {
+}
+
+TileDelta TileDeltaTracker::Update(const std::string& session, uint64_t clientBaseline, const FrameView& view) {
+    TileDelta delta;
+    delta.tileSize = tileSize_;
+    delta.columns = (view.Width() + tileSize_ - 1) / tileSize_;
+    delta.rows = (view.Height() + tileSize_ - 1) / tileSize_;
+
+    // Hashed outside the lock; the compare is cheap
+    std::vector<uint64_t> hashes = HashTiles(view, tileSize_);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++stats_.updates;
+    auto it = std::find_if(sessions_.begin(), sessions_.end(),
+                           [&session](const Session& s) { return s.id == session; });
+    if (it == sessions_.end()) {
+        sessions_.emplace_front();
+        sessions_.front().id = session;
+        if (sessions_.size() > maxSessions_) {
+            sessions_.pop_back();
+        }
+    } else {
+        sessions_.splice(sessions_.begin(), sessions_, it);
+    }
+    Session& state = sessions_.front();
+
+    if (clientBaseline != 0 && clientBaseline == state.baseline &&
+        state.width == view.Width() && state.height == view.Height()) {
+        for (size_t i = 0; i < hashes.size(); ++i) {
+            if (hashes[i] != state.hashes[i]) {
+                delta.tiles.push_back(static_cast<int>(i));
+            }
+        }
+        delta.full = delta.tiles.size() > kMaxDeltaShare * hashes.size();
+    }
+    if (delta.full) {
+        delta.tiles.clear();
+        ++stats_.fullImages;
+    } else {
+        stats_.tilesSent += delta.tiles.size();
+        stats_.tilesSkipped += hashes.size() - delta.tiles.size();
+    }
+
+    state.baseline = delta.baseline = ++nextBaseline_;
+    state.width = view.Width();
+    state.height = view.Height();
+    state.hashes = std::move(hashes);
+    return delta;
+}
+
+void TileDeltaTracker::Forget(const std::string& session) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    sessions_.remove_if([&session](const Session& s) { return s.id == session; });
+}
+
+std::vector<uint64_t> TileDeltaTracker::HashTiles(const FrameView& view, int tileSize) {
+    if (view.Empty() || tileSize <= 0) {
+        return {};
+    }
+    int columns = (view.Width() + tileSize - 1) / tileSize;
+    int rows = (view.Height() + tileSize - 1) / tileSize;
+    std::vector<uint64_t> hashes(static_cast<size_t>(columns) * rows);
+
+    // Row by row across a band of tiles, so the frame is read in order
+    // and the tiles' independent hashes overlap in the pipeline
+    for (int ty = 0; ty < rows; ++ty) {
+        uint64_t* band = hashes.data() + static_cast<size_t>(ty) * columns;
+        for (int tx = 0; tx < columns; ++tx) {
+            band[tx] = kHashSeed ^ (static_cast<uint64_t>(ty * columns + tx) * kHashMultiplier);
+        }
+        int bottom = std::min((ty + 1) * tileSize, view.Height());
+        for (int y = ty * tileSize; y < bottom; ++y) {
+            const uint8_t* row = view.Row(y);
+            for (int tx = 0; tx < columns; ++tx) {
+                int left = tx * tileSize;
+                size_t bytes = static_cast<size_t>(std::min(tileSize, view.Width() - left)) * 4;
+                const uint8_t* p = row + static_cast<size_t>(left) * 4;
+                uint64_t h = band[tx];
+                size_t i = 0;
+                for (; i + 8 <= bytes; i += 8) {
+                    uint64_t word;
+                    std::memcpy(&word, p + i, 8);
+                    h = HashMix(h, word);
+                }
+                if (i < bytes) {
+                    uint32_t pixel;
+                    std::memcpy(&pixel, p + i, 4);
+                    h = HashMix(h, pixel);
+                }
+                band[tx] = h;
+            }
+        }
+        for (int tx = 0; tx < columns; ++tx) {
+            band[tx] = HashFinish(band[tx]);
+        }
+    }
+    return hashes;
+}
+
+void TileDeltaTracker::PackTiles(const FrameView& view, const TileDelta& delta, int atlasColumns,
+                                 std::vector<uint8_t>& out, int& width, int& height) {
+    int count = static_cast<int>(delta.tiles.size());
+    int tileSize = delta.tileSize;
+    if (count == 0 || view.Empty() || tileSize <= 0) {
+        out.clear();
+        width = height = 0;
+        return;
+    }
+    atlasColumns = std::max(1, std::min(atlasColumns, count));
+    width = atlasColumns * tileSize;
+    height = (count + atlasColumns - 1) / atlasColumns * tileSize;
+    size_t stride = static_cast<size_t>(width) * 4;
+    out.assign(stride * height, 0);
+
+    for (int k = 0; k < count; ++k) {
+        int tile = delta.tiles[k];
+        int left = tile % delta.columns * tileSize;
+        int top = tile / delta.columns * tileSize;
+        size_t bytes = static_cast<size_t>(std::min(tileSize, view.Width() - left)) * 4;
+        int tileRows = std::min(tileSize, view.Height() - top);
+        uint8_t* cell = out.data() + static_cast<size_t>(k / atlasColumns) * tileSize * stride +
+                        static_cast<size_t>(k % atlasColumns) * tileSize * 4;
+        for (int y = 0; y < tileRows; ++y) {
+            std::memcpy(cell + y * stride, view.Row(top + y) + static_cast<size_t>(left) * 4, bytes);
+        }
+    }
+}
+
+TileDeltaTracker::Stats TileDeltaTracker::GetStats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Stats stats = stats_;
+    stats.sessions = sessions_.size();
+    return stats;
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "frame_view.h"
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// What to send a session's client in place of a whole screenshot
+struct TileDelta {
+    uint64_t baseline = 0;      // id of the image the client holds once it applies this
+    bool full = true;           // send the whole image: no usable baseline, or most of it changed
+    int tileSize = 0;
+    int columns = 0;            // tile grid of the image
+    int rows = 0;
+    std::vector<int> tiles;     // changed tiles, row-major indices; empty if full
+};
+
+/**
+ * Tile Delta Tracker
+ *
+ * Lets a multi-turn session send only what changed on screen. Images
+ * are split into fixed square tiles and each tile is hashed; per
+ * session the tracker remembers the hashes of the last image sent (the
+ * baseline) under an id the client echoes back. When the client still
+ * holds that baseline, only tiles whose hash differs need sending,
+ * packed side by side into one atlas image (PackTiles); anything else
+ * gets a full image and starts a new baseline.
+ *
+ * Deltas compare pixel content, not positions or frame generations, so
+ * they stay correct whichever region or output a request asks for. If
+ * more than kMaxDeltaShare of the tiles changed the whole image is sent,
+ * which compresses better than an atlas of nearly all of it.
+ *
+ * Up to maxSessions sessions are remembered, least recently used
+ * dropped first.
+ *
+ * Platform-neutral and thread-safe.
+ */
+class TileDeltaTracker {
+public:
+    static constexpr int kDefaultTileSize = 64;
+    static constexpr double kMaxDeltaShare = 0.75;
+
+    explicit TileDeltaTracker(int tileSize = kDefaultTileSize, size_t maxSessions = 16);
+
+    TileDeltaTracker(const TileDeltaTracker&) = delete;
+    TileDeltaTracker& operator=(const TileDeltaTracker&) = delete;
+
+    // Delta of view against the session's baseline, if clientBaseline is
+    // that baseline's id (0 = the client holds none). view becomes the
+    // session's new baseline either way.
+    TileDelta Update(const std::string& session, uint64_t clientBaseline, const FrameView& view);
+
+    // Forget a session's baseline
+    void Forget(const std::string& session);
+
+    // Hash of every tile of view, row-major
+    static std::vector<uint64_t> HashTiles(const FrameView& view, int tileSize);
+
+    // The delta's tiles of view packed into a BGRA atlas (stride width *
+    // 4), atlasColumns to a row in tileSize cells. Edge tiles are smaller
+    // than a cell; the rest of their cell is black.
+    static void PackTiles(const FrameView& view, const TileDelta& delta, int atlasColumns,
+                          std::vector<uint8_t>& out, int& width, int& height);
+
+    struct Stats {
+        uint64_t updates;       // Update calls
+        uint64_t fullImages;    // ... answered with a whole image
+        uint64_t tilesSent;     // tiles in deltas
+        uint64_t tilesSkipped;  // unchanged tiles deltas left out
+        size_t sessions;
+    };
+    Stats GetStats() const;
+
+private:
+    struct Session {
+        std::string id;
+        uint64_t baseline = 0;
+        int width = 0;
+        int height = 0;
+        std::vector<uint64_t> hashes;
+    };
+
+    int tileSize_;
+    size_t maxSessions_;
+
+    mutable std::mutex mutex_;
+    std::list<Session> sessions_;   // most recently used first
+    uint64_t nextBaseline_ = 0;
+    Stats stats_ = {};
+};
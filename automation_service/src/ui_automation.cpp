@@ -39,7 +39,7 @@ bool UIAutomation::Initialize() {
     return true;
 }
 
-json UIAutomation::GetUITree(HWND hwnd) {
+json UIAutomation::GetUITree(HWND hwnd, const CancellationToken* cancel, const Deadline& deadline) {
     if (!initialized_) {
         throw std::runtime_error("UIAutomation not initialized");
     }
@@ -59,14 +59,19 @@ json UIAutomation::GetUITree(HWND hwnd) {
         throw std::runtime_error("Failed to get root element");
     }
     
-    json tree = BuildUITree(rootElement);
+    json tree = BuildUITree(rootElement, 5, 0, cancel, deadline);
     rootElement->Release();
+
+    if (deadline.Expired() && tree.is_object()) {
+        tree["truncated"] = true;
+    }
     
     return tree;
 }
 
-json UIAutomation::BuildUITree(IUIAutomationElement* element, int maxDepth, int currentDepth) {
-    if (!element || currentDepth >= maxDepth) {
+json UIAutomation::BuildUITree(IUIAutomationElement* element, int maxDepth, int currentDepth,
+                               const CancellationToken* cancel, const Deadline& deadline) {
+    if (!element || currentDepth >= maxDepth || (cancel && cancel->IsCancelled()) || deadline.Expired()) {
         return json::object();
     }
     
@@ -106,7 +111,7 @@ json UIAutomation::BuildUITree(IUIAutomationElement* element, int maxDepth, int
                 hr = children->GetElement(i, &child);
                 
                 if (SUCCEEDED(hr) && child) {
-                    childArray.push_back(BuildUITree(child, maxDepth, currentDepth + 1));
+                    childArray.push_back(BuildUITree(child, maxDepth, currentDepth + 1, cancel, deadline));
                     child->Release();
                 }
             }
@@ -134,9 +139,11 @@ Rect UIAutomation::GetElementBounds(IUIAutomationElement* element) {
     RECT boundingRect;
     HRESULT hr = element->get_CurrentBoundingRectangle(&boundingRect);
     
+    // Screen coordinates to composite-desktop pixels
     if (SUCCEEDED(hr)) {
-        rect.x = boundingRect.left;
-        rect.y = boundingRect.top;
+        Rect desktop = desktop_;
+        rect.x = boundingRect.left - desktop.x;
+        rect.y = boundingRect.top - desktop.y;
         rect.width = boundingRect.right - boundingRect.left;
         rect.height = boundingRect.bottom - boundingRect.top;
     }
@@ -240,7 +247,8 @@ IUIAutomationElement* UIAutomation::GetElementAt(int x, int y) {
         return nullptr;
     }
     
-    POINT pt = {x, y};
+    Rect desktop = desktop_;
+    POINT pt = {x + desktop.x, y + desktop.y};
     IUIAutomationElement* element = nullptr;
     
     HRESULT hr = automation_->ElementFromPoint(pt, &element);
@@ -1,7 +1,10 @@
 #pragma once
 
 #include "common.h"
+#include "cancellation.h"
+#include "deadline.h"
 #include <UIAutomation.h>
+#include <atomic>
 #include <nlohmann/json.hpp>
 
 using json = nlohmann::json;
@@ -11,6 +14,11 @@ using json = nlohmann::json;
  * 
  * Provides high-level interface to Windows UIAutomation API
  * for inspecting and interacting with UI elements.
+ *
+ * Element bounds and points are composite-desktop pixels, the same
+ * coordinates as screenshots and clicks: (0, 0) is the top-left corner
+ * of the virtual desktop, which lies at negative screen coordinates when
+ * a monitor sits left of or above the primary.
  */
 class UIAutomation {
 public:
@@ -20,8 +28,16 @@ public:
     // Initialize UIAutomation
     bool Initialize();
     
-    // Get UI tree for desktop or specific window
-    json GetUITree(HWND hwnd = nullptr);
+    // Virtual desktop in screen coordinates; its top-left corner becomes
+    // (0, 0) of every bound reported. Defaults to the screen origin. May
+    // change (display mode change) while a tree is being walked.
+    void SetDesktopBounds(const Rect& bounds) { desktop_ = bounds; }
+    
+    // Get UI tree for desktop or specific window.
+    // If cancelled or past the deadline mid-walk, returns the part walked
+    // so far; a deadline cut also sets "truncated" on the root.
+    json GetUITree(HWND hwnd = nullptr, const CancellationToken* cancel = nullptr,
+                   const Deadline& deadline = Deadline());
     
     // Find element by automation ID, name, or class
     IUIAutomationElement* FindElement(const std::wstring& criteria);
@@ -37,7 +53,9 @@ public:
     
 private:
     // Build UI tree recursively
-    json BuildUITree(IUIAutomationElement* element, int maxDepth = 5, int currentDepth = 0);
+    json BuildUITree(IUIAutomationElement* element, int maxDepth = 5, int currentDepth = 0,
+                     const CancellationToken* cancel = nullptr,
+                     const Deadline& deadline = Deadline());
     
     // Convert IUIAutomationElement to UIElement struct
     UIElement ElementToStruct(IUIAutomationElement* element);
@@ -65,5 +83,8 @@ private:
     
     // Whether initialized
     bool initialized_;
+    
+    // Area bounds are reported relative to
+    std::atomic<Rect> desktop_{Rect{0, 0, 0, 0}};
 };
 
@@ -0,0 +1,163 @@
+#include "worker_pool.h"
+#include <algorithm>
+
+#if defined(_WIN32)
+#include "common.h"
+#endif
+
+WorkerPool::WorkerPool(size_t threadCount)
+    : threadCount_(std::max<size_t>(threadCount, 1))
+    , active_(0)
+    , peakQueued_(0)
+    , completed_(0)
+    , accepting_(true) {
+    workers_.reserve(threadCount_);
+    for (size_t i = 0; i < threadCount_; ++i) {
+        workers_.emplace_back(&WorkerPool::WorkerLoop, this);
+    }
+}
+
+WorkerPool::~WorkerPool() {
+    Shutdown();
+}
+
+bool WorkerPool::Post(Task task) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!accepting_) {
+            return false;
+        }
+        tasks_.push(std::move(task));
+        peakQueued_ = std::max(peakQueued_, tasks_.size());
+    }
+    cv_.notify_one();
+    return true;
+}
+
+void WorkerPool::Shutdown() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        accepting_ = false;
+    }
+    cv_.notify_all();
+    for (auto& worker : workers_) {
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+    workers_.clear();
+}
+
+WorkerPool::Stats WorkerPool::GetStats() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return {threadCount_, tasks_.size(), active_, peakQueued_, completed_};
+}
+
+WorkerPool& WorkerPool::Strips() {
+    static WorkerPool pool(std::max(1, static_cast<int>(std::thread::hardware_concurrency()) - 1));
+    return pool;
+}
+
+void WorkerPool::WorkerLoop() {
+#if defined(_WIN32)
+    // Handlers walk the UI tree through UI Automation, which needs COM on this thread
+    ComInitializer comInit;
+#endif
+
+    while (true) {
+        Task task;
+
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_.wait(lock, [this] { return !accepting_ || !tasks_.empty(); });
+
+            // Drain the queue before exiting so every accepted message gets a response
+            if (tasks_.empty()) break;
+
+            task = std::move(tasks_.front());
+            tasks_.pop();
+            ++active_;
+        }
+
+        try {
+            task();
+        } catch (const std::exception& e) {
+#if defined(_WIN32)
+            LOG_ERROR(L"Worker task failed: " << StringToWString(e.what()).c_str());
+#else
+            (void)e;
+#endif
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        --active_;
+        ++completed_;
+    }
+}
+
+TaskGroup::~TaskGroup() {
+    // Tasks hold references into the poster's frame; never leave before them
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [this] { return pending_ == 0; });
+}
+
+size_t TaskGroup::Run(WorkerPool::Task task) {
+    size_t index;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        index = finished_.size();
+        finished_.push_back(false);
+        ++pending_;
+    }
+    auto run = [this, index, task] {
+        std::exception_ptr error;
+        try {
+            task();
+        } catch (...) {
+            error = std::current_exception();
+        }
+        Finish(index, error);
+    };
+    bool posted = false;
+    try {
+        posted = pool_.Post(run);
+    } catch (...) {
+        // Queueing failed (out of memory); fall through and run it here
+    }
+    if (!posted) {
+        run();
+    }
+    return index;
+}
+
+void TaskGroup::Wait(size_t index) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [this, index] { return finished_[index]; });
+    Rethrow();
+}
+
+void TaskGroup::WaitAll() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [this] { return pending_ == 0; });
+    Rethrow();
+}
+
+void TaskGroup::Finish(size_t index, std::exception_ptr error) {
+    // Notify under the lock: once pending_ reaches zero the group may be
+    // destroyed as soon as the lock is released
+    std::lock_guard<std::mutex> lock(mutex_);
+    finished_[index] = true;
+    --pending_;
+    if (error && !error_) {
+        error_ = error;
+    }
+    cv_.notify_all();
+}
+
+void TaskGroup::Rethrow() {
+    if (error_) {
+        std::exception_ptr error = error_;
+        error_ = nullptr;
+        std::rethrow_exception(error);
+    }
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <queue>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <condition_variable>
+
+/**
+ * Worker Pool
+ *
+ * Fixed set of threads draining a FIFO of tasks.
+ * NativeMessaging uses it to run handlers while the reader
+ * thread keeps pulling new messages off stdin; the image encoders
+ * share one (Strips) for the strips of a single image.
+ */
+class WorkerPool {
+public:
+    using Task = std::function<void()>;
+
+    // Point-in-time counters for monitoring queue pressure
+    struct Stats {
+        size_t threads;      // concurrency limit
+        size_t queued;       // tasks waiting for a thread
+        size_t active;       // tasks currently running
+        size_t peakQueued;   // high-water mark of queued
+        uint64_t completed;  // tasks finished since start
+    };
+
+    explicit WorkerPool(size_t threadCount);
+    ~WorkerPool();
+
+    // Queue a task. Returns false if the pool is shutting down.
+    bool Post(Task task);
+
+    // Stop accepting tasks, finish everything already queued, join workers.
+    void Shutdown();
+
+    Stats GetStats();
+
+    // The pool the encoders run strip jobs on: one thread per core but
+    // one, since the thread that asked for the encode takes a strip too.
+    // Created on first use and shared by every encoder instance.
+    static WorkerPool& Strips();
+
+private:
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::queue<Task> tasks_;
+    std::vector<std::thread> workers_;
+    size_t threadCount_;
+    size_t active_;
+    size_t peakQueued_;
+    uint64_t completed_;
+    bool accepting_;
+
+    void WorkerLoop();
+};
+
+/**
+ * Task Group
+ *
+ * A batch of tasks posted to a WorkerPool that the poster waits on,
+ * one task at a time or all together. A task the pool refuses runs on
+ * the posting thread instead, so every task runs exactly once and no
+ * thread is left to join. An exception thrown by a task is rethrown
+ * by the next Wait or WaitAll on the posting thread.
+ */
+class TaskGroup {
+public:
+    explicit TaskGroup(WorkerPool& pool) : pool_(pool) {}
+    ~TaskGroup();
+
+    TaskGroup(const TaskGroup&) = delete;
+    TaskGroup& operator=(const TaskGroup&) = delete;
+
+    // Queue a task; returns its index for Wait
+    size_t Run(WorkerPool::Task task);
+
+    // Block until the task at index has finished
+    void Wait(size_t index);
+
+    // Block until every task has finished
+    void WaitAll();
+
+private:
+    WorkerPool& pool_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::vector<bool> finished_;
+    std::exception_ptr error_;
+    size_t pending_ = 0;
+
+    void Finish(size_t index, std::exception_ptr error);
+    void Rethrow();
+};
@@ -0,0 +1,192 @@
+#include "x11_frame_source.h"
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/extensions/XShm.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+X11FrameSource::X11FrameSource(const char* displayName, int screen)
+    : displayName_(displayName)
+    , screen_(screen)
+    , imagePool_([this](int width, int height) { return CreateImage(width, height); },
+                 [this](XImage* image) { DestroyImage(image); }) {
+}
+
+X11FrameSource::~X11FrameSource() {
+    imagePool_.Clear();
+    if (screenImage_) DestroyImage(screenImage_);
+    if (display_) XCloseDisplay(display_);
+}
+
+bool X11FrameSource::Initialize() {
+    if (display_) {
+        return true;
+    }
+
+    display_ = XOpenDisplay(displayName_);
+    if (!display_) {
+        std::fprintf(stderr, "Failed to open X display\n");
+        return false;
+    }
+
+    if (!XShmQueryExtension(display_)) {
+        std::fprintf(stderr, "X server lacks the MIT-SHM extension\n");
+        return false;
+    }
+
+    if (screen_ < 0) {
+        screen_ = DefaultScreen(display_);
+    }
+    if (screen_ >= ScreenCount(display_)) {
+        std::fprintf(stderr, "X display has no screen %d\n", screen_);
+        return false;
+    }
+
+    int screen = screen_;
+    int depth = DefaultDepth(display_, screen);
+    if (depth != 24 && depth != 32) {
+        std::fprintf(stderr, "Unsupported X display depth %d\n", depth);
+        return false;
+    }
+
+    root_ = RootWindow(display_, screen);
+    width_ = DisplayWidth(display_, screen);
+    height_ = DisplayHeight(display_, screen);
+
+    screenImage_ = CreateImage(width_, height_);
+    return screenImage_ != nullptr;
+}
+
+std::vector<OutputInfo> X11FrameSource::EnumerateOutputs(const char* displayName) {
+    std::vector<OutputInfo> outputs;
+    Display* display = XOpenDisplay(displayName);
+    if (!display) {
+        return outputs;
+    }
+
+    int x = 0;
+    for (int screen = 0; screen < ScreenCount(display); ++screen) {
+        OutputInfo info;
+        info.index = screen;
+        info.name = "screen " + std::to_string(screen);
+        info.bounds = {x, 0, DisplayWidth(display, screen), DisplayHeight(display, screen)};
+        info.primary = screen == DefaultScreen(display);
+        x += info.bounds.width;
+        outputs.push_back(info);
+    }
+
+    XCloseDisplay(display);
+    return outputs;
+}
+
+XImage* X11FrameSource::CreateImage(int width, int height) {
+    std::lock_guard<std::mutex> lock(displayMutex_);
+    int screen = screen_;
+    auto* shm = new XShmSegmentInfo();
+    XImage* image = XShmCreateImage(display_, DefaultVisual(display_, screen), DefaultDepth(display_, screen),
+                                    ZPixmap, nullptr, shm, width, height);
+    if (!image) {
+        delete shm;
+        return nullptr;
+    }
+    if (image->bits_per_pixel != 32) {
+        std::fprintf(stderr, "Unsupported X image format (%d bpp)\n", image->bits_per_pixel);
+        XDestroyImage(image);
+        delete shm;
+        return nullptr;
+    }
+
+    shm->shmid = shmget(IPC_PRIVATE, static_cast<size_t>(image->bytes_per_line) * height, IPC_CREAT | 0600);
+    if (shm->shmid < 0) {
+        XDestroyImage(image);
+        delete shm;
+        return nullptr;
+    }
+    shm->shmaddr = image->data = static_cast<char*>(shmat(shm->shmid, nullptr, 0));
+    shm->readOnly = False;
+
+    bool attached = shm->shmaddr != reinterpret_cast<char*>(-1) && XShmAttach(display_, shm);
+    if (attached) {
+        XSync(display_, False);
+    }
+    // Marked for removal now; it goes away once both sides detach
+    shmctl(shm->shmid, IPC_RMID, nullptr);
+
+    if (!attached) {
+        if (shm->shmaddr != reinterpret_cast<char*>(-1)) shmdt(shm->shmaddr);
+        image->data = nullptr;
+        XDestroyImage(image);
+        delete shm;
+        return nullptr;
+    }
+    return image;
+}
+
+void X11FrameSource::DestroyImage(XImage* image) {
+    std::lock_guard<std::mutex> lock(displayMutex_);
+    // XShmCreateImage keeps the segment info in obdata
+    auto* shm = reinterpret_cast<XShmSegmentInfo*>(image->obdata);
+    XShmDetach(display_, shm);
+    shmdt(shm->shmaddr);
+    image->data = nullptr;
+    XDestroyImage(image);
+    delete shm;
+}
+
+FrameStatus X11FrameSource::AcquireFrame(int timeoutMs, FrameUpdate& update) {
+    (void)timeoutMs;   // no change notification to wait on: always a new frame
+
+    update = FrameUpdate();
+    update.width = width_;
+    update.height = height_;
+
+    std::lock_guard<std::mutex> lock(displayMutex_);
+    if (!XShmGetImage(display_, root_, screenImage_, 0, 0, AllPlanes)) {
+        return FrameStatus::Error;
+    }
+
+    update.pixels = reinterpret_cast<const uint8_t*>(screenImage_->data);
+    update.pitch = static_cast<size_t>(screenImage_->bytes_per_line);
+    update.full = true;
+    return FrameStatus::Ok;
+}
+
+bool X11FrameSource::ReadRegion(Rect& region, std::vector<uint8_t>& pixels) {
+    int left = std::max(region.x, 0);
+    int top = std::max(region.y, 0);
+    int right = std::min(region.x + region.width, width_);
+    int bottom = std::min(region.y + region.height, height_);
+    if (right <= left || bottom <= top) {
+        return false;
+    }
+    region = {left, top, right - left, bottom - top};
+
+    // XShmGetImage reads exactly the image's size at (x, y), so images
+    // are pooled by exact region size
+    XImage* image = imagePool_.Acquire(region.width, region.height);
+    if (!image) {
+        return false;
+    }
+
+    bool ok;
+    {
+        std::lock_guard<std::mutex> lock(displayMutex_);
+        ok = XShmGetImage(display_, root_, image, region.x, region.y, AllPlanes);
+    }
+
+    if (ok) {
+        size_t rowBytes = static_cast<size_t>(region.width) * 4;
+        pixels.resize(rowBytes * region.height);
+        for (int row = 0; row < region.height; ++row) {
+            std::memcpy(pixels.data() + rowBytes * row,
+                        image->data + static_cast<size_t>(row) * image->bytes_per_line, rowBytes);
+        }
+    }
+
+    imagePool_.Release(region.width, region.height, image);
+    return ok;
+}
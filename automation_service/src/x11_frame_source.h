@@ -0,0 +1,64 @@
+#pragma once
+
+#include "desktop_layout.h"
+#include "frame_source.h"
+#include "size_pool.h"
+#include <mutex>
+
+// Xlib types, kept out of this header so it does not leak X11 macros
+// (None, Status, Bool) into code that includes it
+typedef struct _XDisplay Display;
+struct _XImage;
+
+/**
+ * X11 Frame Source
+ *
+ * Linux capture of the X root window through the MIT-SHM extension:
+ * XShmGetImage copies pixels straight into shared memory, and region
+ * reads ask the server for just that sub-rectangle into an XShm image
+ * of the region's size (pooled by size). The core protocol reports no
+ * damage here, so every AcquireFrame is a full frame.
+ *
+ * Each X screen of a multi-screen display (e.g. Xvfb with several
+ * -screen options) is one output, captured by its own source.
+ *
+ * Used to benchmark the capture pipeline off Windows; requires a 24/32
+ * bit TrueColor display, whose pixels are already BGRA in memory.
+ */
+class X11FrameSource : public FrameSource {
+public:
+    // displayName null means $DISPLAY; screen -1 means its default screen
+    explicit X11FrameSource(const char* displayName = nullptr, int screen = -1);
+    ~X11FrameSource() override;
+
+    // The display's screens as outputs, laid out left to right (X screens
+    // have no common coordinate space). OutputInfo::index is the screen.
+    static std::vector<OutputInfo> EnumerateOutputs(const char* displayName = nullptr);
+
+    bool Initialize() override;
+    int Width() const override { return width_; }
+    int Height() const override { return height_; }
+    FrameStatus AcquireFrame(int timeoutMs, FrameUpdate& update) override;
+    void ReleaseFrame() override {}
+    bool ReadRegion(Rect& region, std::vector<uint8_t>& pixels) override;
+
+private:
+    const char* displayName_;
+    int screen_;
+    Display* display_ = nullptr;
+    unsigned long root_ = 0;
+    int width_ = 0;
+    int height_ = 0;
+
+    // Xlib is used from the capture thread and region readers
+    std::mutex displayMutex_;
+
+    // Whole-screen image for AcquireFrame
+    _XImage* screenImage_ = nullptr;
+
+    SizePool<_XImage*> imagePool_;
+
+    // Shared-memory image attached to the server. Null on failure.
+    _XImage* CreateImage(int width, int height);
+    void DestroyImage(_XImage* image);
+};
@@ -169,6 +169,15 @@ def main():
         ]
     ))
 
+    # 8b. long-poll on an unknown ID returns at once
+    results.append(run_test(
+        "poll (wait_ms, unknown request_id)",
+        {"action": "poll", "request_id": "nonexistent", "wait_ms": 5000},
+        [
+            ("status is not_found", lambda r: r.get("status") == "not_found"),
+        ]
+    ))
+
     # 9. cancel — use a fake ID
     results.append(run_test(
         "cancel (unknown request_id)",
@@ -178,6 +187,29 @@ def main():
         ]
     ))
 
+    # 10. correlation id is echoed back
+    results.append(run_test(
+        "ping (correlation id)",
+        {"id": 42, "action": "ping"},
+        [
+            ("response has success=true", lambda r: r.get("success") is True),
+            ("id is echoed", lambda r: r.get("id") == 42),
+        ]
+    ))
+
+    # 11. pipelining — a ping sent after a slow batch is answered first
+    print(f"\n{'='*60}")
+    print("Test: pipelined dispatch")
+    print(f"{'='*60}")
+    responses = test_multi([
+        {"id": "slow", "action": "execute_actions",
+         "params": {"actions": [{"action": "wait", "params": {"ms": 2000}}]}},
+        {"id": "fast", "action": "ping"},
+    ])
+    ok = len(responses) == 2 and responses[0].get("id") == "fast"
+    print(f"  [{'PASS' if ok else 'FAIL'}] ping answered before slow batch")
+    results.append(ok)
+
     # Summary
     total = len(results)
     passed = sum(1 for r in results if r)
@@ -0,0 +1,29 @@
+#pragma once
+
+// Checks for the unit tests. Each test is a plain executable that ctest
+// runs; a failed CHECK prints where it failed and the test exits non-zero.
+
+#include <cstdio>
+
+namespace check {
+
+inline int& Failures() {
+    static int failures = 0;
+    return failures;
+}
+
+// Exit status for main: 0 if every check passed
+inline int Result() {
+    std::printf("%s\n", Failures() == 0 ? "all checks passed" : "CHECKS FAILED");
+    return Failures() == 0 ? 0 : 1;
+}
+
+}  // namespace check
+
+#define CHECK(condition)                                                            \
+    do {                                                                            \
+        if (!(condition)) {                                                         \
+            std::printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+            ++check::Failures();                                                    \
+        }                                                                           \
+    } while (0)
@@ -0,0 +1,168 @@
+// Desktop layout and compositing test
+//
+// Checks DesktopLayout's coordinate mapping on a layout with monitors
+// left of and above the primary (negative desktop coordinates) and a gap
+// between them, then composites synthetic monitors into one FrameBuffer
+// with ApplyAt: each output's part of the composite must be exactly that
+// output, gaps stay black, and updates never spill into a neighbour.
+// No display is needed; region_capture_bench repeats the compositing
+// check against real X screens.
+
+#include "check.h"
+#include "desktop_layout.h"
+#include "frame_buffer.h"
+#include "synthetic_frame_source.h"
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+namespace {
+
+bool SameRect(const Rect& a, const Rect& b) {
+    return a.x == b.x && a.y == b.y && a.width == b.width && a.height == b.height;
+}
+
+// The composite's pixels under placement, packed
+std::vector<uint8_t> Crop(const FrameBuffer& buffer, const Rect& placement) {
+    std::vector<uint8_t> pixels;
+    for (int y = placement.y; y < placement.y + placement.height; ++y) {
+        const uint8_t* row = buffer.Data() + static_cast<size_t>(y) * buffer.Stride() + static_cast<size_t>(placement.x) * 4;
+        pixels.insert(pixels.end(), row, row + static_cast<size_t>(placement.width) * 4);
+    }
+    return pixels;
+}
+
+// Whether the composite pixel belongs to no output and is black
+bool IsBlackGap(const DesktopLayout& layout, const FrameBuffer& buffer, int x, int y) {
+    uint32_t pixel;
+    std::memcpy(&pixel, buffer.Data() + static_cast<size_t>(y) * buffer.Stride() + static_cast<size_t>(x) * 4, 4);
+    return layout.OutputAt(x, y) < 0 && pixel == 0;
+}
+
+// Fold a source's next frame in at its placement
+bool Composite(SyntheticFrameSource& source, const DesktopLayout& layout, int position, FrameBuffer& buffer) {
+    FrameUpdate update;
+    if (source.AcquireFrame(0, update) != FrameStatus::Ok) {
+        return false;
+    }
+    Rect placement = layout.Placement(position);
+    bool changed = buffer.ApplyAt(update, placement.x, placement.y);
+    source.ReleaseFrame();
+    return changed;
+}
+
+void CheckMapping() {
+    // Primary at the origin, one monitor to its left and lower, one to
+    // its right and higher
+    DesktopLayout layout({
+        {0, "primary", {0, 0, 1920, 1080}, true},
+        {1, "left", {-1280, 200, 1280, 1024}, false},
+        {2, "above", {1920, -300, 1600, 900}, false},
+    });
+    CHECK(SameRect(layout.Bounds(), {-1280, -300, 4800, 1524}));
+    CHECK(SameRect(layout.Placement(0), {1280, 300, 1920, 1080}));
+    CHECK(SameRect(layout.Placement(1), {0, 500, 1280, 1024}));
+    CHECK(SameRect(layout.Placement(2), {3200, 0, 1600, 900}));
+    CHECK(SameRect(layout.Placement(3), {0, 0, 0, 0}));
+    CHECK(layout.Find(2) == 2 && layout.Find(7) == -1);
+
+    // Composite (0, 0) is the desktop's top-left corner, not the primary's
+    int x = 0, y = 0;
+    layout.CompositeToDesktop(x, y);
+    CHECK(x == -1280 && y == -300);
+    layout.DesktopToComposite(x, y);
+    CHECK(x == 0 && y == 0);
+
+    // Every output's corners map to it and back; gaps map to none
+    for (int position = 0; position < layout.Count(); ++position) {
+        Rect placement = layout.Placement(position);
+        for (int corner = 0; corner < 4; ++corner) {
+            int outputX = corner & 1 ? placement.width - 1 : 0;
+            int outputY = corner & 2 ? placement.height - 1 : 0;
+            int found = -1, backX = -1, backY = -1;
+            CHECK(layout.FromOutput(position, outputX, outputY, x, y));
+            CHECK(layout.ToOutput(x, y, found, backX, backY));
+            CHECK(found == position && backX == outputX && backY == outputY);
+        }
+        CHECK(!layout.FromOutput(position, placement.width, 0, x, y));
+        CHECK(!layout.FromOutput(position, 0, -1, x, y));
+    }
+    int position = 0, outputX = 0, outputY = 0;
+    CHECK(layout.OutputAt(0, 0) == -1);                 // above the left monitor
+    CHECK(layout.OutputAt(3199, 100) == -1);            // above the primary
+    CHECK(!layout.ToOutput(4800, 0, position, outputX, outputY));
+    CHECK(layout.OutputAt(1279, 500) == 1 && layout.OutputAt(1280, 500) == 0);
+
+    // A point on the left monitor, at negative desktop x, is a positive
+    // composite pixel
+    x = -100;
+    y = 600;
+    layout.DesktopToComposite(x, y);
+    CHECK(x == 1180 && y == 900 && layout.OutputAt(x, y) == 1);
+
+    // No outputs: nothing anywhere
+    DesktopLayout empty;
+    CHECK(empty.Empty() && empty.Width() == 0 && empty.OutputAt(0, 0) == -1);
+}
+
+void CheckCompositing() {
+    // The same arrangement, small
+    DesktopLayout layout({
+        {0, "primary", {0, 0, 40, 30}, true},
+        {1, "left", {-24, 10, 24, 20}, false},
+        {2, "above", {40, -8, 30, 16}, false},
+    });
+    std::vector<std::unique_ptr<SyntheticFrameSource>> sources;
+    for (const auto& output : layout.Outputs()) {
+        sources.push_back(std::make_unique<SyntheticFrameSource>(
+            output.bounds.width, output.bounds.height, 1000u + output.index));
+    }
+
+    FrameBuffer desktop(8);
+    desktop.Reset(layout.Width(), layout.Height());
+    CHECK(desktop.Width() == 94 && desktop.Height() == 38);
+    for (int i = 0; i < layout.Count(); ++i) {
+        CHECK(Composite(*sources[i], layout, i, desktop));
+    }
+    auto checkOutputs = [&] {
+        for (int i = 0; i < layout.Count(); ++i) {
+            CHECK(Crop(desktop, layout.Placement(i)) == sources[i]->Screen());
+        }
+    };
+    checkOutputs();
+    CHECK(IsBlackGap(layout, desktop, 0, 0));
+    CHECK(IsBlackGap(layout, desktop, 70, 16));
+    CHECK(IsBlackGap(layout, desktop, 93, 37));
+
+    // A dirty rect running past the left monitor's right edge, and a move
+    // whose source starts left of it, stay within that monitor
+    uint64_t since = desktop.Generation();
+    sources[1]->Move(-5, 0, {0, 0, 10, 10});
+    sources[1]->Paint({20, 12, 10, 10});
+    CHECK(Composite(*sources[1], layout, 1, desktop));
+    checkOutputs();
+    for (const Rect& region : desktop.ChangedRegions(since)) {
+        CHECK(region.x < 24);   // the left monitor's tile columns only
+    }
+
+    // A move off the top of the upper monitor drops what would come from
+    // outside it
+    sources[2]->Move(0, -4, {0, 0, 30, 16});
+    CHECK(Composite(*sources[2], layout, 2, desktop));
+    checkOutputs();
+    CHECK(IsBlackGap(layout, desktop, 70, 16));
+
+    // A full update of one monitor leaves the others as they were
+    sources[0]->Invalidate();
+    CHECK(Composite(*sources[0], layout, 0, desktop));
+    checkOutputs();
+}
+
+}  // namespace
+
+int main() {
+    CheckMapping();
+    CheckCompositing();
+    return check::Result();
+}
@@ -0,0 +1,137 @@
+// FrameBuffer test
+//
+// Drives a FrameBuffer from a synthetic FrameSource: a screen held in
+// memory that the test scrolls, drags and paints, reported frame by frame
+// as moves and dirty rects the way Desktop Duplication reports them.
+// After every frame the buffer must match the screen, and ChangedTiles and
+// ChangedRegions must name exactly the tiles changed since a generation.
+
+#include "check.h"
+#include "frame_buffer.h"
+#include "synthetic_frame_source.h"
+#include <cstdint>
+#include <vector>
+
+namespace {
+
+// Fold the source's next frame into the buffer; false if there was none
+bool Pump(SyntheticFrameSource& source, FrameBuffer& buffer) {
+    FrameUpdate update;
+    if (source.AcquireFrame(0, update) != FrameStatus::Ok) {
+        return false;
+    }
+    bool changed = buffer.Apply(update);
+    source.ReleaseFrame();
+    return changed;
+}
+
+bool SameRects(const std::vector<Rect>& actual, const std::vector<Rect>& expected) {
+    if (actual.size() != expected.size()) return false;
+    for (size_t i = 0; i < actual.size(); ++i) {
+        const Rect& a = actual[i];
+        const Rect& e = expected[i];
+        if (a.x != e.x || a.y != e.y || a.width != e.width || a.height != e.height) return false;
+    }
+    return true;
+}
+
+}  // namespace
+
+int main() {
+    // 200x150 in 64 px tiles: a 4x3 grid whose last column is 8 px wide
+    // and last row 22 px high
+    SyntheticFrameSource source(200, 150);
+    FrameBuffer buffer(64);
+
+    // First frame: everything
+    CHECK(Pump(source, buffer));
+    CHECK(buffer.Width() == 200 && buffer.Height() == 150);
+    CHECK(buffer.TilesX() == 4 && buffer.TilesY() == 3);
+    CHECK(buffer.Generation() == 1);
+    CHECK(buffer.Pixels() == source.Screen());
+    CHECK(buffer.ChangedTiles(0).size() == 12);
+    CHECK(buffer.ChangedTiles(1).empty());
+    CHECK(SameRects(buffer.ChangedRegions(0), {{0, 0, 200, 64}, {0, 64, 200, 64}, {0, 128, 200, 22}}));
+
+    // Nothing changed: no frame, no new generation
+    CHECK(!Pump(source, buffer));
+    CHECK(buffer.Generation() == 1);
+
+    // A dirty rect inside one tile
+    uint64_t since = buffer.Generation();
+    source.Paint({70, 10, 20, 20});
+    CHECK(Pump(source, buffer));
+    CHECK(buffer.Pixels() == source.Screen());
+    CHECK(buffer.ChangedTiles(since) == std::vector<int>({1}));
+    CHECK(SameRects(buffer.ChangedRegions(since), {{64, 0, 64, 64}}));
+
+    // One across four tiles: each tile row's run becomes one region
+    since = buffer.Generation();
+    source.Paint({60, 60, 10, 10});
+    CHECK(Pump(source, buffer));
+    CHECK(buffer.Pixels() == source.Screen());
+    CHECK(buffer.ChangedTiles(since) == std::vector<int>({0, 1, 4, 5}));
+    CHECK(SameRects(buffer.ChangedRegions(since), {{0, 0, 128, 64}, {0, 64, 128, 64}}));
+
+    // Scrolling down: the move overlaps itself by all but 5 rows, then
+    // the exposed strip at the top is painted
+    since = buffer.Generation();
+    source.Move(0, 0, {0, 5, 200, 100});
+    source.Paint({0, 0, 200, 5});
+    CHECK(Pump(source, buffer));
+    CHECK(buffer.Pixels() == source.Screen());
+    CHECK(buffer.ChangedTiles(since) == std::vector<int>({0, 1, 2, 3, 4, 5, 6, 7}));
+
+    // Scrolling up and dragging right within the same rows
+    source.Move(10, 20, {13, 17, 100, 50});
+    CHECK(Pump(source, buffer));
+    CHECK(buffer.Pixels() == source.Screen());
+
+    // Several moves in one frame, each seeing the one before
+    source.Move(0, 0, {40, 40, 60, 60});
+    source.Move(50, 50, {20, 30, 60, 60});
+    CHECK(Pump(source, buffer));
+    CHECK(buffer.Pixels() == source.Screen());
+
+    // Clipping: a move landing partly off screen, one whose source is
+    // partly off screen, and a dirty rect running past the corner
+    since = buffer.Generation();
+    source.Move(150, 100, {180, 120, 50, 50});
+    source.Move(-10, 0, {0, 0, 30, 30});
+    source.Paint({190, 140, 40, 40});
+    CHECK(Pump(source, buffer));
+    CHECK(buffer.Pixels() == source.Screen());
+    CHECK(buffer.ChangedTiles(since) == std::vector<int>({0, 6, 7, 10, 11}));
+    CHECK(SameRects(buffer.ChangedRegions(since), {{0, 0, 64, 64}, {128, 64, 72, 64}, {128, 128, 72, 22}}));
+
+    // Changes entirely off screen touch nothing, but still make a frame
+    since = buffer.Generation();
+    source.Paint({300, 300, 10, 10});
+    Pump(source, buffer);
+    CHECK(buffer.Pixels() == source.Screen());
+    CHECK(buffer.ChangedTiles(since).empty());
+
+    // Since an older generation: the union of everything after it (the
+    // bottom-left tiles were never touched)
+    CHECK(buffer.ChangedTiles(1) == std::vector<int>({0, 1, 2, 3, 4, 5, 6, 7, 10, 11}));
+    CHECK(buffer.ChangedTiles(buffer.Generation()).empty());
+
+    // No change info: every tile
+    since = buffer.Generation();
+    source.Invalidate();
+    CHECK(Pump(source, buffer));
+    CHECK(buffer.Pixels() == source.Screen());
+    CHECK(buffer.ChangedTiles(since).size() == 12);
+
+    // A resize takes the whole frame, whatever the update says
+    since = buffer.Generation();
+    source.Resize(130, 70);
+    CHECK(Pump(source, buffer));
+    CHECK(buffer.Width() == 130 && buffer.Height() == 70);
+    CHECK(buffer.TilesX() == 3 && buffer.TilesY() == 2);
+    CHECK(buffer.Pixels() == source.Screen());
+    CHECK(SameRects(buffer.ChangedRegions(since), {{0, 0, 130, 64}, {0, 64, 130, 6}}));
+    CHECK(buffer.TileRect(5).x == 128 && buffer.TileRect(5).width == 2 && buffer.TileRect(5).height == 6);
+
+    return check::Result();
+}
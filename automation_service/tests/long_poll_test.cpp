@@ -0,0 +1,95 @@
+// Long-poll test
+//
+// Parks more long-polls than the control lane has workers on a request
+// that never finishes by itself, with lanes sized like the dispatcher's.
+// A cancel on the control lane must still be answered at once, and it
+// must wake every parked poll. A poll over the waiter cap must answer
+// straight away instead of parking.
+
+#include "check.h"
+#include "async_request.h"
+#include "worker_pool.h"
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using namespace std::chrono_literals;
+
+// Dispatcher defaults: 8 control workers, 16 on the wait lane
+constexpr size_t kControlWorkers = 8;
+constexpr size_t kWaitWorkers = 16;
+
+void CheckCancelWhileParked() {
+    AsyncRequestManager manager(1);
+    WorkerPool controlLane(kControlWorkers);
+    WorkerPool waitLane(kWaitWorkers);
+
+    std::string id = manager.Submit([](CancellationToken& cancel) -> json {
+        while (!cancel.IsCancelled()) {
+            std::this_thread::sleep_for(5ms);
+        }
+        return {{"success", false}};
+    }).requestId;
+
+    // Wait for the work to start so the version parked polls see is final
+    json status;
+    for (int i = 0; i < 200; ++i) {
+        status = manager.Poll(id);
+        if (status["status"] == "processing") break;
+        std::this_thread::sleep_for(5ms);
+    }
+    CHECK(status["status"] == "processing");
+    int64_t version = status["version"];
+
+    // More parked polls than there are control workers
+    constexpr int kParked = AsyncRequestManager::kMaxPollWaiters;
+    static_assert(kParked > static_cast<int>(kControlWorkers), "must outnumber the control lane");
+    std::vector<std::future<json>> parked;
+    for (int i = 0; i < kParked; ++i) {
+        auto reply = std::make_shared<std::promise<json>>();
+        parked.push_back(reply->get_future());
+        waitLane.Post([&manager, id, version, reply] {
+            reply->set_value(manager.Poll(id, AsyncRequestManager::kMaxPollWaitMs, version));
+        });
+    }
+    std::this_thread::sleep_for(200ms);
+    for (auto& reply : parked) {
+        CHECK(reply.wait_for(0ms) == std::future_status::timeout);
+    }
+
+    // Over the cap: answers without waiting, version unchanged
+    auto overCap = std::make_shared<std::promise<json>>();
+    auto overCapReply = overCap->get_future();
+    waitLane.Post([&manager, id, version, overCap] {
+        overCap->set_value(manager.Poll(id, AsyncRequestManager::kMaxPollWaitMs, version));
+    });
+    CHECK(overCapReply.wait_for(2s) == std::future_status::ready);
+    CHECK(overCapReply.get()["version"] == version);
+
+    // Cancel is answered while the polls are parked
+    auto cancel = std::make_shared<std::promise<json>>();
+    auto cancelReply = cancel->get_future();
+    controlLane.Post([&manager, id, cancel] {
+        cancel->set_value(manager.Cancel(id));
+    });
+    CHECK(cancelReply.wait_for(2s) == std::future_status::ready);
+    CHECK(cancelReply.get()["status"] == "cancelled");
+
+    // And it wakes every parked poll
+    for (auto& reply : parked) {
+        CHECK(reply.wait_for(2s) == std::future_status::ready);
+        CHECK(reply.get()["status"] == "cancelled");
+    }
+}
+
+}  // namespace
+
+int main() {
+    CheckCancelWhileParked();
+    return check::Result();
+}
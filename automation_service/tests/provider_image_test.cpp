@@ -0,0 +1,109 @@
+// Provider image mapping test
+//
+// A 1920x1080 screenshot sent at 1280x720: UI tree bounds scale into the
+// sent image, and action coordinates come back to the centre of the
+// physical block under the image pixel. Coordinates outside the sent
+// image reject the action rather than landing on the screen's edge.
+
+#include "check.h"
+#include "provider_image.h"
+
+namespace {
+
+ProviderImage Image(int width, int height, int sourceWidth, int sourceHeight) {
+    ProviderImage image;
+    image.width = width;
+    image.height = height;
+    image.sourceWidth = sourceWidth;
+    image.sourceHeight = sourceHeight;
+    return image;
+}
+
+void CheckToPhysical() {
+    ProviderImage image = Image(1280, 720, 1920, 1080);
+    CHECK(image.Scaled());
+
+    // Pixel (0, 0) covers physical 0..1.5; its centre rounds down to 0.
+    // Pixel (1, 1) covers 1.5..3 and aims at 2.
+    json params = {{"x", 0}, {"y", 0}};
+    CHECK(image.ToPhysical(params));
+    CHECK(params["x"] == 0 && params["y"] == 0);
+    params = {{"x", 1}, {"y", 1}};
+    CHECK(image.ToPhysical(params));
+    CHECK(params["x"] == 2 && params["y"] == 2);
+
+    // The middle and the last pixel
+    params = {{"x", 640}, {"y", 360}};
+    CHECK(image.ToPhysical(params));
+    CHECK(params["x"] == 960 && params["y"] == 540);
+    params = {{"x", 1279}, {"y", 719}};
+    CHECK(image.ToPhysical(params));
+    CHECK(params["x"] == 1919 && params["y"] == 1079);
+
+    // A fractional coordinate at the far edge still lands on screen
+    params = {{"x", 1279.9}, {"y", 719.9}};
+    CHECK(image.ToPhysical(params));
+    CHECK(params["x"] == 1919 && params["y"] == 1079);
+
+    // Outside the sent image: rejected, params left alone. These pass
+    // ValidateAction's 0-10000 range, and used to be clamped to the edge.
+    for (const json& outside : {json{{"x", 1280}, {"y", 10}}, json{{"x", 10}, {"y", 720}},
+                                json{{"x", 1500}, {"y", 900}}, json{{"x", -1}, {"y", 10}},
+                                json{{"x", 10}, {"y", -0.5}}}) {
+        params = outside;
+        CHECK(!image.ToPhysical(params));
+        CHECK(params == outside);
+    }
+
+    // Scroll without a position has nothing to map; with one outside, it
+    // is rejected like a click
+    params = {{"delta", -3}};
+    CHECK(image.ToPhysical(params));
+    CHECK(params == json({{"delta", -3}}));
+    params = {{"delta", -3}, {"x", 2000}, {"y", 100}};
+    CHECK(!image.ToPhysical(params));
+
+    // Sent at full size: coordinates pass through, but the image still
+    // bounds them
+    ProviderImage full = Image(1920, 1080, 1920, 1080);
+    CHECK(!full.Scaled());
+    params = {{"x", 1919}, {"y", 1079}};
+    CHECK(full.ToPhysical(params));
+    CHECK(params["x"] == 1919 && params["y"] == 1079);
+    params = {{"x", 1920}, {"y", 0}};
+    CHECK(!full.ToPhysical(params));
+
+    // No screenshot: nothing to check against
+    ProviderImage none;
+    params = {{"x", 5000}, {"y", 5000}};
+    CHECK(none.ToPhysical(params));
+    CHECK(params["x"] == 5000);
+}
+
+void CheckToImageSpace() {
+    ProviderImage image = Image(1280, 720, 1920, 1080);
+    json tree = {
+        {"name", "root"},
+        {"bounds", {{"x", 0}, {"y", 0}, {"width", 1920}, {"height", 1080}}},
+        {"children", {
+            {{"name", "button"}, {"bounds", {{"x", 300}, {"y", 150}, {"width", 90}, {"height", 31}}}},
+        }},
+    };
+    json scaled = image.ToImageSpace(tree);
+    CHECK(scaled["bounds"] == json({{"x", 0}, {"y", 0}, {"width", 1280}, {"height", 720}}));
+    CHECK(scaled["children"][0]["bounds"] == json({{"x", 200}, {"y", 100}, {"width", 60}, {"height", 21}}));
+    CHECK(scaled["children"][0]["name"] == "button");
+
+    // The button's centre in the image maps back into the button
+    json params = {{"x", 200 + 60 / 2}, {"y", 100 + 21 / 2}};
+    CHECK(image.ToPhysical(params));
+    CHECK(params["x"] >= 300 && params["x"] < 390 && params["y"] >= 150 && params["y"] < 181);
+}
+
+}  // namespace
+
+int main() {
+    CheckToPhysical();
+    CheckToImageSpace();
+    return check::Result();
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include "frame_source.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// A screen in memory. Changes accumulate until AcquireFrame reports them
+// as one update, moves first, so a frame's moves must be made before its
+// paints (as on a real desktop, where dirty rects are read afterwards).
+class SyntheticFrameSource : public FrameSource {
+public:
+    // seed picks the content, so several sources can be told apart
+    SyntheticFrameSource(int width, int height, uint32_t seed = 12345) : seed_(seed) { Resize(width, height); }
+
+    bool Initialize() override { return true; }
+    int Width() const override { return width_; }
+    int Height() const override { return height_; }
+
+    FrameStatus AcquireFrame(int /*timeoutMs*/, FrameUpdate& update) override {
+        if (!full_ && moves_.empty() && dirty_.empty()) {
+            return FrameStatus::Timeout;
+        }
+        update = FrameUpdate();
+        update.width = width_;
+        update.height = height_;
+        update.pixels = screen_.data();
+        update.pitch = static_cast<size_t>(width_) * 4;
+        update.full = full_;
+        update.moves = std::move(moves_);
+        update.dirty = std::move(dirty_);
+        full_ = false;
+        moves_.clear();
+        dirty_.clear();
+        return FrameStatus::Ok;
+    }
+
+    void ReleaseFrame() override {}
+
+    bool ReadRegion(Rect& region, std::vector<uint8_t>& pixels) override {
+        int left = std::max(region.x, 0), top = std::max(region.y, 0);
+        int right = std::min(region.x + region.width, width_), bottom = std::min(region.y + region.height, height_);
+        if (right <= left || bottom <= top) return false;
+        region = {left, top, right - left, bottom - top};
+        pixels.resize(static_cast<size_t>(region.width) * region.height * 4);
+        for (int y = 0; y < region.height; ++y) {
+            std::memcpy(&pixels[static_cast<size_t>(y) * region.width * 4], Pixel(left, top + y),
+                        static_cast<size_t>(region.width) * 4);
+        }
+        return true;
+    }
+
+    // New size and content; the next update carries no change info
+    void Resize(int width, int height) {
+        width_ = width;
+        height_ = height;
+        screen_.assign(static_cast<size_t>(width) * height * 4, 0);
+        Fill({0, 0, width, height});
+        full_ = true;
+    }
+
+    // Fresh content everywhere, reported with no change info
+    void Invalidate() {
+        Fill({0, 0, width_, height_});
+        full_ = true;
+    }
+
+    // Paint rect with content no other paint produces. The dirty rect is
+    // reported as given, even where it runs off the screen.
+    void Paint(const Rect& rect) {
+        Fill(rect);
+        dirty_.push_back(rect);
+    }
+
+    // Move a region: each destination pixel on screen whose source is on
+    // screen too takes the source's old value
+    void Move(int sourceX, int sourceY, const Rect& dest) {
+        std::vector<uint8_t> before = screen_;
+        for (int y = dest.y; y < dest.y + dest.height; ++y) {
+            for (int x = dest.x; x < dest.x + dest.width; ++x) {
+                int fromX = sourceX + (x - dest.x), fromY = sourceY + (y - dest.y);
+                if (OnScreen(x, y) && OnScreen(fromX, fromY)) {
+                    std::memcpy(Pixel(x, y), &before[(static_cast<size_t>(fromY) * width_ + fromX) * 4], 4);
+                }
+            }
+        }
+        moves_.push_back({sourceX, sourceY, dest});
+    }
+
+    const std::vector<uint8_t>& Screen() const { return screen_; }
+
+private:
+    int width_ = 0;
+    int height_ = 0;
+    std::vector<uint8_t> screen_;
+    uint32_t seed_ = 12345;
+    bool full_ = false;
+    std::vector<MoveRect> moves_;
+    std::vector<Rect> dirty_;
+
+    bool OnScreen(int x, int y) const { return x >= 0 && y >= 0 && x < width_ && y < height_; }
+    uint8_t* Pixel(int x, int y) { return &screen_[(static_cast<size_t>(y) * width_ + x) * 4]; }
+
+    // Every pixel distinct, so a row moved from the wrong place shows
+    void Fill(const Rect& rect) {
+        for (int y = rect.y; y < rect.y + rect.height; ++y) {
+            for (int x = rect.x; x < rect.x + rect.width; ++x) {
+                if (!OnScreen(x, y)) continue;
+                seed_ = seed_ * 1664525u + 1013904223u;
+                uint32_t bgra = (seed_ >> 8) | 0xFF000000u;
+                std::memcpy(Pixel(x, y), &bgra, 4);
+            }
+        }
+    }
+};
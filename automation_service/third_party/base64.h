@@ -16,7 +16,7 @@ namespace base64 {
 
 inline std::string encode(const std::vector<unsigned char>& data) {
     static const char base64_chars[] =
-        "ABCDEFGHIJK LMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
     
     std::string ret;
     int i = 0;
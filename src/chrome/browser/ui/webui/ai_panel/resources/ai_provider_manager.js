@@ -9,6 +9,8 @@ class AIProviderManager {
     this.native = nativeMessaging;
     this.activeProvider = 'ollama';
     this.providerStatus = {};
+    // Resubmitting from this panel supersedes its unfinished request
+    this.sessionId = `panel-${Date.now().toString(36)}-${Math.random().toString(36).slice(2, 8)}`;
     this.ready = this.initialize();
   }
 
@@ -69,7 +71,7 @@ class AIProviderManager {
    */
   async getActions(userRequest) {
     const { request_id } = await this.native.requestActions(
-      this.activeProvider, userRequest
+      this.activeProvider, userRequest, this.sessionId
     );
     return this.native.pollUntilComplete(request_id);
   }
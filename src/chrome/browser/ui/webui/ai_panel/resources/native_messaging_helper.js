@@ -8,6 +8,13 @@ class NativeMessagingHelper {
   constructor() {
     this.hostName = 'com.browser_ai.automation';
     this.isConnected = false;
+
+    // Long-lived port to the service, opened on first use. Replies are
+    // matched to requests by the "id" the service echoes back.
+    this.port = null;
+    this.nextId = 1;
+    this.pending = new Map();   // id -> {resolve, reject}
+    this.streams = new Map();   // chunk stream -> {seq, parts}
   }
 
   /**
@@ -19,7 +26,19 @@ class NativeMessagingHelper {
     return new Promise((resolve, reject) => {
       try {
         // Check if chrome.runtime is available
-        if (typeof chrome === 'undefined' || !chrome.runtime || !chrome.runtime.sendNativeMessage) {
+        if (typeof chrome === 'undefined' || !chrome.runtime) {
+          reject(new Error('Chrome Native Messaging API not available'));
+          return;
+        }
+
+        // Responses over 1 MB (screenshots) arrive as several chunk
+        // frames, which only a port can receive
+        if (chrome.runtime.connectNative) {
+          this.sendOverPort(message, resolve, reject);
+          return;
+        }
+
+        if (!chrome.runtime.sendNativeMessage) {
           reject(new Error('Chrome Native Messaging API not available'));
           return;
         }
@@ -38,6 +57,11 @@ class NativeMessagingHelper {
               return;
             }
 
+            if (response.chunked) {
+              reject(new Error('Response too large for a one-shot native message'));
+              return;
+            }
+
             resolve(response);
           }
         );
@@ -47,6 +71,97 @@ class NativeMessagingHelper {
     });
   }
 
+  /**
+   * Send a message on the shared port, tagged with a fresh correlation id
+   */
+  sendOverPort(message, resolve, reject) {
+    if (!this.port) {
+      this.port = chrome.runtime.connectNative(this.hostName);
+      this.port.onMessage.addListener((frame) => this.handleFrame(frame));
+      this.port.onDisconnect.addListener(() => this.handleDisconnect());
+    }
+
+    const id = `nm-${this.nextId++}`;
+    this.pending.set(id, {resolve, reject});
+    this.port.postMessage({...message, id});
+  }
+
+  /**
+   * Handle one frame from the port. Chunk frames are collected per stream
+   * until the trailer, then their "data" strings are joined and parsed
+   * as the response.
+   */
+  handleFrame(frame) {
+    if (!frame || !frame.chunked) {
+      this.settle(frame);
+      return;
+    }
+
+    const stream = this.streams.get(frame.stream) || {seq: 0, parts: []};
+    if (frame.seq !== stream.seq) {
+      this.streams.delete(frame.stream);
+      this.fail(frame.id, new Error(`Chunk out of sequence on stream ${frame.stream}`));
+      return;
+    }
+    stream.seq++;
+
+    if (!frame.final) {
+      stream.parts.push(frame.data);
+      this.streams.set(frame.stream, stream);
+      return;
+    }
+
+    this.streams.delete(frame.stream);
+    let response;
+    try {
+      response = JSON.parse(stream.parts.join(''));
+    } catch (error) {
+      this.fail(frame.id, new Error(`Malformed chunked response: ${error.message}`));
+      return;
+    }
+    this.settle(response);
+  }
+
+  /**
+   * Resolve the request a complete response belongs to
+   */
+  settle(response) {
+    const request = response && this.pending.get(response.id);
+    if (!request) {
+      return;   // unsolicited, or its request already failed
+    }
+    this.pending.delete(response.id);
+    delete response.id;
+    request.resolve(response);
+  }
+
+  /**
+   * Reject one request
+   */
+  fail(id, error) {
+    const request = this.pending.get(id);
+    if (request) {
+      this.pending.delete(id);
+      request.reject(error);
+    }
+  }
+
+  /**
+   * The service exited or could not be started: fail everything in flight.
+   * The next message opens a new port.
+   */
+  handleDisconnect() {
+    const reason = chrome.runtime.lastError ? chrome.runtime.lastError.message : 'disconnected';
+    const error = new Error(`Native messaging error: ${reason}`);
+    this.port = null;
+    this.streams.clear();
+    const requests = [...this.pending.values()];
+    this.pending.clear();
+    for (const request of requests) {
+      request.reject(error);
+    }
+  }
+
   /**
    * Test connection to automation service
    * @returns {Promise<boolean>} - True if connected
@@ -178,18 +293,33 @@ class NativeMessagingHelper {
 
   /**
    * Request AI actions (async — returns request_id)
+   * With a sessionId, a newer request replaces one of the same session
+   * that is still queued or running.
    */
-  async requestActions(provider, userRequest) {
-    return this.sendMessage({
+  async requestActions(provider, userRequest, sessionId = undefined) {
+    const message = {
       action: 'get_actions', provider, user_request: userRequest
-    });
+    };
+    if (sessionId !== undefined) {
+      message.session_id = sessionId;
+    }
+    return this.sendMessage(message);
   }
 
   /**
-   * Poll for async request result
+   * Poll for async request result.
+   * With waitMs > 0 the service holds the reply until the status version
+   * moves past knownVersion (long-poll) or the wait expires.
    */
-  async pollRequest(requestId) {
-    return this.sendMessage({action: 'poll', request_id: requestId});
+  async pollRequest(requestId, waitMs = 0, knownVersion = undefined) {
+    const message = {action: 'poll', request_id: requestId};
+    if (waitMs > 0) {
+      message.wait_ms = waitMs;
+    }
+    if (knownVersion !== undefined) {
+      message.version = knownVersion;
+    }
+    return this.sendMessage(message);
   }
 
   /**
@@ -201,18 +331,23 @@ class NativeMessagingHelper {
 
   /**
    * Poll until a request completes. Returns the final result.
+   * Uses long-polling, so the result arrives as soon as it is ready.
    * @param {string} requestId
-   * @param {number} intervalMs - polling interval (default 500ms)
+   * @param {number} waitMs - max wait per long-poll (default 10000ms)
    * @param {number} timeoutMs - max wait time (default 120000ms)
    */
-  async pollUntilComplete(requestId, intervalMs = 500, timeoutMs = 120000) {
+  async pollUntilComplete(requestId, waitMs = 10000, timeoutMs = 120000) {
     const start = Date.now();
+    let version = undefined;
     while (Date.now() - start < timeoutMs) {
-      const result = await this.pollRequest(requestId);
-      if (result.status === 'complete' || result.status === 'error' || result.status === 'cancelled') {
+      const remaining = timeoutMs - (Date.now() - start);
+      const result = await this.pollRequest(
+          requestId, Math.max(1, Math.min(waitMs, remaining)), version);
+      if (result.status === 'complete' || result.status === 'error' ||
+          result.status === 'cancelled' || result.status === 'not_found') {
         return result;
       }
-      await new Promise(r => setTimeout(r, intervalMs));
+      version = result.version;
     }
     // Timeout — try to cancel
     await this.cancelRequest(requestId);